@@ -0,0 +1,323 @@
+// Analog clock face for the ST7789 display library
+
+#include "analog_face.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "pixel_ops.h"
+
+// Geometry, as fractions of the radius unless noted
+#define DIAL_RING_WIDTH 2.0f     // Pixels
+#define DIAL_MAJOR_LENGTH 10.0f  // Pixels, every fifth tick
+#define DIAL_MINOR_LENGTH 4.0f   // Pixels
+#define DIAL_TICK_INSET 6.0f     // Pixels between the ring and the ticks
+#define HOUR_LENGTH 0.50f
+#define MINUTE_LENGTH 0.78f
+#define SECOND_LENGTH 0.88f
+#define HAND_TAIL 0.12f          // Overhang behind the centre
+#define SECOND_TAIL 0.22f
+#define CAP_RADIUS 4.5f          // Pixels
+
+#define SUPERSAMPLE 4            // Samples per pixel along each axis; coverage is 0..16
+#define EDGE_REACH 0.75f         // Farthest a sample lies from its pixel centre, rounded up
+
+static const float TWO_PI = 6.28318530718f;
+
+// Distance from (px, py) to the segment (x0, y0)-(x1, y1)
+static float segment_distance(float px, float py, float x0, float y0, float x1, float y1) {
+    float dx = x1 - x0;
+    float dy = y1 - y0;
+    float length2 = dx * dx + dy * dy;
+    float t = length2 > 0 ? ((px - x0) * dx + (py - y0) * dy) / length2 : 0;
+    if (t < 0) t = 0;
+    if (t > 1) t = 1;
+    float ex = px - (x0 + t * dx);
+    float ey = py - (y0 + t * dy);
+    return sqrtf(ex * ex + ey * ey);
+}
+
+// fg over bg at coverage 0..16, in host-order RGB565
+static uint16_t blend(uint16_t fg, uint16_t bg, int alpha) {
+    int r = ((bg >> 11) * (16 - alpha) + (fg >> 11) * alpha + 8) >> 4;
+    int g = (((bg >> 5) & 0x3F) * (16 - alpha) + ((fg >> 5) & 0x3F) * alpha + 8) >> 4;
+    int b = ((bg & 0x1F) * (16 - alpha) + (fg & 0x1F) * alpha + 8) >> 4;
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+AnalogFace::AnalogFace(int cx, int cy, int radius, uint16_t dial_color, uint16_t hour_color,
+                       uint16_t minute_color, uint16_t second_color, uint16_t bg)
+    : _cx(cx), _cy(cy), _dialX(cx - radius - 1), _dialY(cy - radius - 1),
+      _dialSize(2 * radius + 3), _dial(new uint16_t[(2 * radius + 3) * (2 * radius + 3)]),
+      _dialWireOrder(false), _nextEvict(0), _lastValid(false) {
+    _colors[0] = hour_color;
+    _colors[1] = minute_color;
+    _colors[2] = second_color;
+    _colors[3] = dial_color;
+    renderDial(radius, dial_color, bg);
+
+    // Hands point clockwise from 12 o'clock, with a short tail behind the
+    // centre
+    const float lengths[ANALOG_HANDS] = {HOUR_LENGTH, MINUTE_LENGTH, SECOND_LENGTH};
+    const float tails[ANALOG_HANDS] = {HAND_TAIL, HAND_TAIL, SECOND_TAIL};
+    const float half_widths[ANALOG_HANDS] = {3.5f, 2.5f, 1.0f};
+    for (int hand = 0; hand < ANALOG_HANDS; hand++) {
+        for (int p = 0; p < ANALOG_POSITIONS; p++) {
+            float angle = p * TWO_PI / ANALOG_POSITIONS;
+            float dx = sinf(angle) * radius;
+            float dy = -cosf(angle) * radius;
+            rasterise(_hands[hand][p], -dx * tails[hand], -dy * tails[hand],
+                      dx * lengths[hand], dy * lengths[hand], half_widths[hand]);
+        }
+    }
+    rasterise(_cap, 0, 0, 0, 0, CAP_RADIUS);
+    invalidate();
+}
+
+AnalogFace::~AnalogFace() {
+    delete[] _dial;
+}
+
+void AnalogFace::invalidate() {
+    for (int i = 0; i < TEXT_WIDGET_BUFFERS; i++) {
+        _buffers[i].buffer = nullptr;
+    }
+    _lastValid = false;
+}
+
+// Ring and 60 ticks over bg, supersampled near the rim; the inside of the
+// dial is plain background
+void AnalogFace::renderDial(int radius, uint16_t dial_color, uint16_t bg) {
+    const float ring_inner = radius - DIAL_RING_WIDTH;
+    const float tick_outer = ring_inner - DIAL_TICK_INSET;
+    const float rim = tick_outer - DIAL_MAJOR_LENGTH - 2;
+    for (int y = 0; y < _dialSize; y++) {
+        for (int x = 0; x < _dialSize; x++) {
+            float dx = x + _dialX - _cx;
+            float dy = y + _dialY - _cy;
+            float centre_r = sqrtf(dx * dx + dy * dy);
+            int alpha = 0;
+            for (int s = 0; centre_r >= rim && centre_r <= radius + 2 &&
+                            s < SUPERSAMPLE * SUPERSAMPLE; s++) {
+                float sx = dx + (s % SUPERSAMPLE + 0.5f) / SUPERSAMPLE - 0.5f;
+                float sy = dy + (s / SUPERSAMPLE + 0.5f) / SUPERSAMPLE - 0.5f;
+                float r = sqrtf(sx * sx + sy * sy);
+                bool inside = r >= ring_inner && r <= radius;
+                if (!inside) {
+                    // Nearest tick
+                    float angle = atan2f(sx, -sy);
+                    int tick = (int)lroundf(angle / TWO_PI * ANALOG_POSITIONS);
+                    bool major = ((tick % 5) + 5) % 5 == 0;
+                    float tick_angle = tick * TWO_PI / ANALOG_POSITIONS;
+                    float tx = sinf(tick_angle);
+                    float ty = -cosf(tick_angle);
+                    float inner = tick_outer - (major ? DIAL_MAJOR_LENGTH : DIAL_MINOR_LENGTH);
+                    float half_width = major ? 1.5f : 0.75f;
+                    inside = segment_distance(sx, sy, tx * inner, ty * inner,
+                                              tx * tick_outer, ty * tick_outer) <= half_width;
+                }
+                alpha += inside;
+            }
+            _dial[y * _dialSize + x] = blend(dial_color, bg, alpha);
+        }
+    }
+    _dialWireOrder = false;
+}
+
+// Coverage of a capsule (segment plus half_width) as a sprite, trimmed to
+// the covered span of each row
+void AnalogFace::rasterise(Sprite& sprite, float x0, float y0, float x1, float y1, float half_width) {
+    int left = (int)floorf((x0 < x1 ? x0 : x1) - half_width) - 1;
+    int right = (int)ceilf((x0 > x1 ? x0 : x1) + half_width) + 1;
+    int top = (int)floorf((y0 < y1 ? y0 : y1) - half_width) - 1;
+    int bottom = (int)ceilf((y0 > y1 ? y0 : y1) + half_width) + 1;
+
+    sprite.y = top;
+    sprite.rows = bottom - top + 1;
+    sprite.firstRow = _rows.size();
+
+    std::vector<uint8_t> line(right - left + 1);
+    for (int y = top; y <= bottom; y++) {
+        int first = 0;
+        int last = 0;
+        bool covered = false;
+        for (int x = left; x <= right; x++) {
+            // Samples only where the edge crosses the pixel
+            float distance = segment_distance(x, y, x0, y0, x1, y1);
+            int alpha = distance <= half_width - EDGE_REACH ? SUPERSAMPLE * SUPERSAMPLE : 0;
+            for (int s = 0; distance > half_width - EDGE_REACH && distance < half_width + EDGE_REACH &&
+                            s < SUPERSAMPLE * SUPERSAMPLE; s++) {
+                float sx = x + (s % SUPERSAMPLE + 0.5f) / SUPERSAMPLE - 0.5f;
+                float sy = y + (s / SUPERSAMPLE + 0.5f) / SUPERSAMPLE - 0.5f;
+                alpha += segment_distance(sx, sy, x0, y0, x1, y1) <= half_width;
+            }
+            line[x - left] = alpha;
+            if (alpha > 0) {
+                if (!covered) first = x;
+                last = x;
+                covered = true;
+            }
+        }
+
+        SpriteRow row;
+        row.x = first;
+        row.w = covered ? last - first + 1 : 0;
+        row.alpha = _alpha.size();
+        std::vector<uint8_t>::const_iterator span = line.begin() + (covered ? first - left : 0);
+        _alpha.insert(_alpha.end(), span, span + row.w);
+        _rows.push_back(row);
+    }
+}
+
+// Screen rectangles covering a sprite, one per ANALOG_BAND_ROWS rows, so a
+// diagonal hand does not damage its whole bounding box
+int AnalogFace::addBands(const Sprite& sprite, DirtyRect* rects, int count, int max_rects) const {
+    for (int band = 0; band < sprite.rows; band += ANALOG_BAND_ROWS) {
+        int end = band + ANALOG_BAND_ROWS < sprite.rows ? band + ANALOG_BAND_ROWS : sprite.rows;
+        int x0 = 0;
+        int x1 = 0;
+        bool covered = false;
+        for (int i = band; i < end; i++) {
+            const SpriteRow& row = _rows[sprite.firstRow + i];
+            if (row.w == 0) {
+                continue;
+            }
+            if (!covered || row.x < x0) x0 = row.x;
+            if (!covered || row.x + row.w > x1) x1 = row.x + row.w;
+            covered = true;
+        }
+        if (covered) {
+            count = add_dirty_rect(rects, count, max_rects, _cx + x0, _cy + sprite.y + band,
+                                   x1 - x0, end - band);
+        }
+    }
+    return count;
+}
+
+// Blend a sprite in color over the framebuffer, inside clip only
+void AnalogFace::drawSprite(const Sprite& sprite, uint16_t color, const DirtyRect& clip) const {
+    uint16_t stored = framebuffer_wire_order ? wire_color(color) : color;
+    for (int i = 0; i < sprite.rows; i++) {
+        int y = _cy + sprite.y + i;
+        if (y < clip.y || y >= clip.y + clip.h) {
+            continue;
+        }
+        const SpriteRow& row = _rows[sprite.firstRow + i];
+        int x0 = _cx + row.x;
+        int x1 = x0 + row.w;
+        int span0 = x0 > clip.x ? x0 : clip.x;
+        int span1 = x1 < clip.x + clip.w ? x1 : clip.x + clip.w;
+        const uint8_t* alpha = &_alpha[row.alpha] - x0;
+        uint16_t* dst = framebuffer + y * DISPLAY_WIDTH;
+        for (int x = span0; x < span1; x++) {
+            int a = alpha[x];
+            if (a == SUPERSAMPLE * SUPERSAMPLE) {
+                dst[x] = stored;
+            } else if (a > 0) {
+                uint16_t under = framebuffer_wire_order ? wire_color(dst[x]) : dst[x];
+                uint16_t mixed = blend(color, under, a);
+                dst[x] = framebuffer_wire_order ? wire_color(mixed) : mixed;
+            }
+        }
+    }
+}
+
+// Put back the dial inside region, then every visible hand and the cap over
+// it; regions may overlap, since each is restored before it is drawn
+void AnalogFace::redrawRegion(const DirtyRect& region, const int* positions) const {
+    int x0 = region.x > _dialX ? region.x : _dialX;
+    int x1 = region.x + region.w < _dialX + _dialSize ? region.x + region.w : _dialX + _dialSize;
+    int y0 = region.y > _dialY ? region.y : _dialY;
+    int y1 = region.y + region.h < _dialY + _dialSize ? region.y + region.h : _dialY + _dialSize;
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+    for (int y = y0; y < y1; y++) {
+        memcpy(framebuffer + y * DISPLAY_WIDTH + x0,
+               _dial + (y - _dialY) * _dialSize + (x0 - _dialX), (x1 - x0) * sizeof(uint16_t));
+    }
+
+    DirtyRect clip = {x0, y0, x1 - x0, y1 - y0};
+    for (int hand = 0; hand < ANALOG_HANDS; hand++) {
+        if (positions[hand] >= 0) {
+            drawSprite(_hands[hand][positions[hand]], _colors[hand], clip);
+        }
+    }
+    drawSprite(_cap, _colors[ANALOG_HANDS], clip);
+}
+
+int AnalogFace::update(int hour, int minute, int second, DirtyRect* damage, int count, int max_rects) {
+    if (indexed_framebuffer || !framebuffer) {
+        return count;
+    }
+    if (_dialWireOrder != framebuffer_wire_order) {
+        // Keep the cache in the framebuffer's byte order, so restoring is a
+        // row copy
+        for (int i = 0; i < _dialSize * _dialSize; i++) {
+            _dial[i] = wire_color(_dial[i]);
+        }
+        _dialWireOrder = framebuffer_wire_order;
+        invalidate();
+    }
+
+    // The hour hand moves on by one position every 12 minutes
+    int positions[ANALOG_HANDS] = {
+        (hour % 12) * 5 + minute / 12,
+        minute % ANALOG_POSITIONS,
+        second < 0 ? -1 : second % ANALOG_POSITIONS,
+    };
+    const DirtyRect whole = {_dialX, _dialY, _dialSize, _dialSize};
+
+    Retained* slot = nullptr;
+    for (int i = 0; i < TEXT_WIDGET_BUFFERS && !slot; i++) {
+        if (_buffers[i].buffer == framebuffer) {
+            slot = &_buffers[i];
+        }
+    }
+    if (slot) {
+        // Old and new places of the hands this buffer shows elsewhere
+        DirtyRect regions[DAMAGE_MAX_RECTS];
+        int n = 0;
+        for (int hand = 0; hand < ANALOG_HANDS; hand++) {
+            int shown = slot->positions[hand];
+            if (shown == positions[hand]) {
+                continue;
+            }
+            if (shown >= 0) {
+                n = addBands(_hands[hand][shown], regions, n, DAMAGE_MAX_RECTS);
+            }
+            if (positions[hand] >= 0) {
+                n = addBands(_hands[hand][positions[hand]], regions, n, DAMAGE_MAX_RECTS);
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            redrawRegion(regions[i], positions);
+        }
+    } else {
+        // Unknown contents: the whole face
+        slot = &_buffers[_nextEvict];
+        _nextEvict = (_nextEvict + 1) % TEXT_WIDGET_BUFFERS;
+        slot->buffer = framebuffer;
+        redrawRegion(whole, positions);
+    }
+    memcpy(slot->positions, positions, sizeof(positions));
+
+    if (!_lastValid) {
+        count = add_dirty_rect(damage, count, max_rects, whole.x, whole.y, whole.w, whole.h);
+    } else {
+        for (int hand = 0; hand < ANALOG_HANDS; hand++) {
+            if (_last[hand] == positions[hand]) {
+                continue;
+            }
+            if (_last[hand] >= 0) {
+                count = addBands(_hands[hand][_last[hand]], damage, count, max_rects);
+            }
+            if (positions[hand] >= 0) {
+                count = addBands(_hands[hand][positions[hand]], damage, count, max_rects);
+            }
+        }
+    }
+    memcpy(_last, positions, sizeof(positions));
+    _lastValid = true;
+    return count;
+}
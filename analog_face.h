@@ -0,0 +1,86 @@
+// Analog clock face for the ST7789 display library
+// The static dial is rendered once into a cached layer, and every hand is
+// rasterised, anti-aliased, at all 60 positions up front. A tick restores
+// the dial under the hands that moved and draws them at their new
+// positions, and reports only the bands around those hands as damage.
+
+#ifndef ANALOG_FACE_H
+#define ANALOG_FACE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "gfx.h"
+
+#define ANALOG_POSITIONS 60   // Hand positions per revolution
+#define ANALOG_HANDS 3        // Hour, minute, second
+#define ANALOG_BAND_ROWS 8   // A hand's damage is split into bands this many rows high
+
+// Retained-mode analog face, like TextWidget: remembers the hand positions
+// last drawn into each framebuffer and touches only the hands that differ.
+// Draws into framebuffer (either byte order); the indexed framebuffer is not
+// supported.
+class AnalogFace {
+public:
+    // Dial of the given radius centred on pixel (cx, cy)
+    AnalogFace(int cx, int cy, int radius, uint16_t dial_color, uint16_t hour_color,
+               uint16_t minute_color, uint16_t second_color, uint16_t bg = COLOR_BLACK);
+    ~AnalogFace();
+
+    // Draw the hands for a time into the current framebuffer; second < 0
+    // leaves the second hand out. The areas that differ from the previous
+    // update() are appended to damage[count..max_rects); returns the new
+    // count.
+    int update(int hour, int minute, int second, DirtyRect* damage, int count, int max_rects);
+
+    // Forget every buffer, so the next update redraws and reports in full
+    void invalidate();
+
+    // Square the face covers, in screen coordinates
+    int left() const { return _dialX; }
+    int top() const { return _dialY; }
+    int size() const { return _dialSize; }
+
+private:
+    // A sprite is a run of rows, each one span of 0..16 coverage values;
+    // coordinates are relative to the centre pixel
+    struct SpriteRow {
+        int16_t x;
+        uint16_t w;
+        uint32_t alpha;  // Offset into _alpha
+    };
+    struct Sprite {
+        int16_t y;
+        uint16_t rows;
+        uint32_t firstRow;  // Index into _rows
+    };
+    struct Retained {
+        const void* buffer;
+        int positions[ANALOG_HANDS];
+    };
+
+    int _cx, _cy;
+    int _dialX, _dialY, _dialSize;
+    uint16_t* _dial;      // _dialSize squared, in framebuffer byte order
+    bool _dialWireOrder;
+    uint16_t _colors[ANALOG_HANDS + 1];  // Hands, then the centre cap
+    Sprite _hands[ANALOG_HANDS][ANALOG_POSITIONS];
+    Sprite _cap;
+    std::vector<SpriteRow> _rows;
+    std::vector<uint8_t> _alpha;
+    Retained _buffers[TEXT_WIDGET_BUFFERS];
+    int _nextEvict;
+    int _last[ANALOG_HANDS];
+    bool _lastValid;
+
+    void renderDial(int radius, uint16_t dial_color, uint16_t bg);
+    void rasterise(Sprite& sprite, float x0, float y0, float x1, float y1, float half_width);
+    int addBands(const Sprite& sprite, DirtyRect* rects, int count, int max_rects) const;
+    void drawSprite(const Sprite& sprite, uint16_t color, const DirtyRect& clip) const;
+    void redrawRegion(const DirtyRect& region, const int* positions) const;
+
+    AnalogFace(const AnalogFace&);
+    AnalogFace& operator=(const AnalogFace&);
+};
+
+#endif // ANALOG_FACE_H
@@ -0,0 +1,341 @@
+// Host-side benchmark for the ST7789 render and encode pipeline
+// Runs the clock frame and the test patterns against NullTransport, so it
+// needs neither a Pi nor the bcm2835 library
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+
+#include "analog_face.h"
+#include "gfx.h"
+#include "latency_histogram.h"
+#include "layout.h"
+#include "st7789.h"
+#include "st7789_trace.h"
+
+#define BENCH_DEFAULT_FRAMES 300
+#define BENCH_EPOCH 1700000000  // Fixed start time so every run draws the same digits
+
+struct BenchResult {
+    LatencyHistogram frameNs;
+    int64_t totalNs;
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t transfers;
+    uint64_t pinToggles;
+    uint64_t busToggles;
+
+    BenchResult() : totalNs(0), frames(0), bytes(0), transfers(0), pinToggles(0), busToggles(0) {}
+};
+
+static uint16_t frame[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+static IndexedFramebuffer indexed_frame;
+
+// The clock's built-in layout. full_layout is redrawn from scratch every
+// frame; the retained ones redraw only changed characters and append their
+// cells to hints, as the clock does (idle: HH:MM only, as in --idle mode).
+static FontFile no_font;
+static Layout full_layout;
+static Layout retained_layout;
+static Layout idle_layout;
+
+static void render_clock(time_t now) {
+    struct tm timeinfo;
+    gmtime_r(&now, &timeinfo);
+
+    draw_rect(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, COLOR_BLACK);
+    DirtyRect unused[DAMAGE_MAX_RECTS];
+    full_layout.invalidate();
+    full_layout.format(timeinfo);
+    full_layout.update(unused, 0, DAMAGE_MAX_RECTS);
+}
+
+static int render_clock_retained(time_t now, bool idle, DirtyRect* hints) {
+    struct tm timeinfo;
+    gmtime_r(&now, &timeinfo);
+
+    Layout& layout = idle ? idle_layout : retained_layout;
+    layout.format(timeinfo);
+    return layout.update(hints, 0, DAMAGE_MAX_RECTS);
+}
+
+enum BenchCase {
+    CASE_CLOCK_RENDER,    // Framebuffer only, nothing sent
+    CASE_CLOCK_FULL,      // Whole frame every tick
+    CASE_CLOCK_FULL_444,  // Whole frame, packed to 12 bits per pixel
+    CASE_CLOCK_FULL_WIRE, // Whole frame rendered in wire order, sent without encoding
+    CASE_CLOCK_PARTIAL,   // Damage-tracked windows of a fully redrawn frame
+    CASE_CLOCK_TILES,     // Same, changed 16x16 tiles found by hashing (--tiles)
+    CASE_CLOCK_RETAINED,  // Changed characters only, damage scanned within them, as the clock does
+    CASE_CLOCK_IDLE,      // Same with --idle: HH:MM, one frame per minute
+    CASE_CLOCK_ANALOG,    // --analog: moved hands only, damage scanned within them
+    CASE_INDEXED_RENDER,  // Framebuffer only, 4 bpp indexed
+    CASE_INDEXED_FULL,    // Indexed frame expanded to RGB565 while sending
+    CASE_SCROLL,          // One hardware scroll step of the full-width band
+    CASE_FILL,
+    CASE_COLOR_BARS,
+    CASE_GRADIENT,
+    CASE_CHECKERBOARD,
+    CASE_COUNT
+};
+
+static const char* const case_names[CASE_COUNT] = {
+    "clock render", "clock full", "clock full 444", "clock full wire", "clock partial",
+    "clock tiles",
+    "clock retained", "clock idle", "clock analog",
+    "indexed render", "indexed full", "scroll step",
+    "fill_screen", "color_bars", "gradient", "checkerboard 10"
+};
+
+static AnalogFace* analog_face = nullptr;
+
+static int render_clock_analog(time_t now, DirtyRect* hints) {
+    struct tm timeinfo;
+    gmtime_r(&now, &timeinfo);
+    return analog_face->update(timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec,
+                               hints, 0, DAMAGE_MAX_RECTS);
+}
+
+// recorder is non-null with --record: it wraps transport and marks every
+// frame with the case name
+static void run_case(int which, int frames, NullTransport& transport,
+                     RecordingTransport* recorder, BenchResult& result) {
+    ST7789_Driver display(recorder ? (ST7789_Transport&)*recorder : transport);
+    static DamageTracker damage;
+    static TileTracker tile_damage;
+    DirtyRect dirty[DAMAGE_MAX_RECTS];
+    ScrollRegion ticker(display, 0, DISPLAY_WIDTH);
+
+    if (which == CASE_CLOCK_FULL_444) {
+        display.setPixelFormat(ST7789_RGB444);
+    }
+    bool retained = which == CASE_CLOCK_RETAINED || which == CASE_CLOCK_IDLE ||
+                    which == CASE_CLOCK_ANALOG;
+    bool idle = which == CASE_CLOCK_IDLE;
+    time_t step = idle ? 60 : 1;
+    framebuffer_wire_order = which == CASE_CLOCK_FULL_WIRE || which == CASE_CLOCK_PARTIAL ||
+                             which == CASE_CLOCK_TILES || retained;
+    bool indexed = which == CASE_INDEXED_RENDER || which == CASE_INDEXED_FULL;
+    indexed_framebuffer = indexed ? &indexed_frame : nullptr;
+
+    // Partial refresh starts from a panel showing the previous second
+    damage.invalidate();
+    tile_damage.invalidate();
+    if (which == CASE_CLOCK_PARTIAL) {
+        render_clock(BENCH_EPOCH - 1);
+        damage.commit(frame);
+    } else if (which == CASE_CLOCK_TILES) {
+        render_clock(BENCH_EPOCH - 1);
+        tile_damage.commit(frame);
+    } else if (retained) {
+        DirtyRect hints[DAMAGE_MAX_RECTS];
+        draw_rect(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, COLOR_BLACK);
+        retained_layout.invalidate();
+        idle_layout.invalidate();
+        if (which == CASE_CLOCK_ANALOG) {
+            analog_face->invalidate();
+            render_clock_analog(BENCH_EPOCH - step, hints);
+        } else {
+            render_clock_retained(BENCH_EPOCH - step, idle, hints);
+        }
+        damage.commit(frame);
+    } else if (which == CASE_SCROLL) {
+        render_clock(BENCH_EPOCH);
+        ticker.begin();
+    }
+    // The replayed panel starts in RGB565 from a power-on reset
+    static ST7789_PixelFormat recorded_format = ST7789_RGB565;
+    bool reformat = display.pixelFormat() != recorded_format;
+    bool seeded = which == CASE_CLOCK_PARTIAL || which == CASE_CLOCK_TILES || retained;
+    if (recorder && (reformat || seeded || which == CASE_SCROLL)) {
+        // Give it the pixel format and starting picture the case assumes,
+        // outside the measured frames
+        if (reformat) {
+            display.writeCommand(ST7789_COLMOD);
+            display.writeData(display.pixelFormat() == ST7789_RGB444 ? ST7789_COLMOD_RGB444
+                                                                     : ST7789_COLMOD_RGB565);
+            recorded_format = display.pixelFormat();
+        }
+        if (seeded) {
+            display.pushWireRect(frame, DISPLAY_WIDTH, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+        }
+        char label[64];
+        snprintf(label, sizeof(label), "%s setup", case_names[which]);
+        recorder->mark(label);
+    }
+    transport.resetCounters();
+
+    int64_t start = monotonic_ns();
+    for (int i = 0; i < frames; i++) {
+        int64_t frame_start = monotonic_ns();
+        switch (which) {
+        case CASE_CLOCK_RENDER:
+            render_clock(BENCH_EPOCH + i);
+            break;
+        case CASE_CLOCK_FULL:
+        case CASE_CLOCK_FULL_444:
+            render_clock(BENCH_EPOCH + i);
+            display.pushFramebuffer(frame, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+            break;
+        case CASE_CLOCK_FULL_WIRE:
+            render_clock(BENCH_EPOCH + i);
+            display.pushWireRect(frame, DISPLAY_WIDTH, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+            break;
+        case CASE_CLOCK_PARTIAL: {
+            render_clock(BENCH_EPOCH + i);
+            int count = damage.collect(frame, dirty, DAMAGE_MAX_RECTS);
+            display.beginTransaction();
+            for (int r = 0; r < count; r++) {
+                display.pushWireRect(frame, DISPLAY_WIDTH, dirty[r].x, dirty[r].y, dirty[r].w, dirty[r].h);
+            }
+            display.endTransaction();
+            damage.commit(frame);
+            break;
+        }
+        case CASE_CLOCK_TILES: {
+            render_clock(BENCH_EPOCH + i);
+            int count = tile_damage.collect(frame, dirty, DAMAGE_MAX_RECTS);
+            display.beginTransaction();
+            for (int r = 0; r < count; r++) {
+                display.pushWireRect(frame, DISPLAY_WIDTH, dirty[r].x, dirty[r].y, dirty[r].w, dirty[r].h);
+            }
+            display.endTransaction();
+            tile_damage.commit(frame);
+            break;
+        }
+        case CASE_CLOCK_RETAINED:
+        case CASE_CLOCK_IDLE:
+        case CASE_CLOCK_ANALOG: {
+            DirtyRect hints[DAMAGE_MAX_RECTS];
+            int hint_count = which == CASE_CLOCK_ANALOG
+                ? render_clock_analog(BENCH_EPOCH + i * step, hints)
+                : render_clock_retained(BENCH_EPOCH + i * step, idle, hints);
+            int count = damage.collectWithin(frame, hints, hint_count, dirty, DAMAGE_MAX_RECTS);
+            display.beginTransaction();
+            for (int r = 0; r < count; r++) {
+                display.pushWireRect(frame, DISPLAY_WIDTH, dirty[r].x, dirty[r].y, dirty[r].w, dirty[r].h);
+            }
+            display.endTransaction();
+            damage.commitRects(frame, hints, hint_count);
+            break;
+        }
+        case CASE_INDEXED_RENDER:
+            render_clock(BENCH_EPOCH + i);
+            break;
+        case CASE_INDEXED_FULL:
+            render_clock(BENCH_EPOCH + i);
+            indexed_frame.push(display);
+            break;
+        case CASE_SCROLL: {
+            // Feed the frame back in column by column
+            uint16_t column[DISPLAY_HEIGHT];
+            int src = i % DISPLAY_WIDTH;
+            for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+                column[y] = frame[y * DISPLAY_WIDTH + src];
+            }
+            ticker.scroll(column);
+            break;
+        }
+        case CASE_FILL:
+            fill_screen(display, i & 1 ? COLOR_WHITE : COLOR_BLACK);
+            break;
+        case CASE_COLOR_BARS:
+            draw_color_bars(display);
+            break;
+        case CASE_GRADIENT:
+            draw_gradient(display);
+            break;
+        case CASE_CHECKERBOARD:
+            draw_checkerboard(display, 10);
+            break;
+        }
+        result.frameNs.record(monotonic_ns() - frame_start);
+        if (recorder) {
+            recorder->mark(case_names[which]);
+        }
+    }
+    result.totalNs = monotonic_ns() - start;
+    indexed_framebuffer = nullptr;
+    framebuffer_wire_order = false;
+
+    result.frames = frames;
+    result.bytes = transport.bytes;
+    result.transfers = transport.transfers;
+    result.pinToggles = transport.pinToggles;
+    result.busToggles = transport.busToggles;
+}
+
+static void print_usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [--frames N] [--record FILE]" << std::endl;
+    std::cerr << "  --frames N     Frames per case (default " << BENCH_DEFAULT_FRAMES << ")" << std::endl;
+    std::cerr << "  --record FILE  Also write a bus trace of every case for trace_replay" << std::endl;
+    std::cerr << "                 (timings then include the recording)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    int frames = BENCH_DEFAULT_FRAMES;
+    const char* record_path = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+            if (frames < 1) {
+                std::cerr << "Error: --frames must be at least 1" << std::endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    NullTransport transport;
+    RecordingTransport recorder(&transport);
+    if (record_path && !recorder.open(record_path)) {
+        return 1;
+    }
+
+    // Glyph atlases for both byte orders the full redraw runs in; the
+    // retained cases render in wire order only
+    framebuffer = frame;
+    full_layout.loadDefault(no_font, false);
+    framebuffer_wire_order = true;
+    full_layout.prepare();
+    retained_layout.loadDefault(no_font, false);
+    idle_layout.loadDefault(no_font, true);
+    framebuffer_wire_order = false;
+    analog_face = new AnalogFace(DISPLAY_WIDTH / 2, DISPLAY_HEIGHT / 2, 114, COLOR_WHITE,
+                                 COLOR_CYAN, COLOR_CYAN, COLOR_RED);
+
+    std::cout << "ST7789 pipeline benchmark (" << DISPLAY_WIDTH << "x" << DISPLAY_HEIGHT
+              << ", NullTransport, " << frames << " frames per case)" << std::endl;
+    std::cout << "All counts are per frame. ";
+    std::cout << "Bus toggles = SCLK + MOSI edges of the bit-banged link; "
+              << "pin toggles = DC, CS and RESET" << std::endl << std::endl;
+
+    printf("%-16s %10s %10s %10s %10s %12s %10s\n",
+           "case", "ns/frame", "p99", "bytes", "transfers", "bus toggles", "pin tgl");
+
+    for (int which = 0; which < CASE_COUNT; which++) {
+        BenchResult result;
+        run_case(which, frames, transport, record_path ? &recorder : nullptr, result);
+
+        char p99[16];
+        printf("%-16s %10lld %10s %10llu %10llu %12llu %10llu\n",
+               case_names[which],
+               (long long)(result.totalNs / result.frames),
+               format_duration(result.frameNs.percentile(99), p99, sizeof(p99)),
+               (unsigned long long)(result.bytes / result.frames),
+               (unsigned long long)(result.transfers / result.frames),
+               (unsigned long long)(result.busToggles / result.frames),
+               (unsigned long long)(result.pinToggles / result.frames));
+    }
+
+    delete analog_face;
+    return 0;
+}
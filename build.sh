@@ -201,15 +201,35 @@ clean_build() {
         print_info "Removed old test_display binary"
     fi
 
+    if [ -f libst7789.a ]; then
+        rm -f libst7789.a *.o
+        print_info "Removed old libst7789 display library"
+    fi
+
     print_success "Clean completed"
 }
 
+# Build the shared display library
+build_library() {
+    print_header "Building Display Library"
+
+    print_info "Compiling st7789.cpp and st7789_bcm2835.cpp into libst7789.a..."
+    make libst7789.a
+
+    if [ -f libst7789.a ]; then
+        print_success "Display library built successfully"
+    else
+        print_error "Failed to build display library"
+        return 1
+    fi
+}
+
 # Build the clock application
 build_clock() {
     print_header "Building Clock Application"
 
     print_info "Compiling clock.cpp with bcm2835 library..."
-    g++ -O3 -Wall -std=c++11 -o clock clock.cpp -lbcm2835 -lpthread
+    make clock
 
     if [ -f clock ]; then
         print_success "Clock application built successfully"
@@ -225,7 +245,7 @@ build_failsafe() {
     print_header "Building Failsafe Wrapper"
 
     print_info "Compiling failsafe.cpp with bcm2835 library..."
-    g++ -O3 -Wall -std=c++11 -o failsafe failsafe.cpp -lbcm2835
+    make failsafe
 
     if [ -f failsafe ]; then
         print_success "Failsafe wrapper built successfully"
@@ -241,7 +261,7 @@ build_test() {
     print_header "Building Test Application"
 
     print_info "Compiling test_display.cpp with bcm2835 library..."
-    g++ -O3 -Wall -std=c++11 -o test_display test_display.cpp -lbcm2835
+    make test_display
 
     if [ -f test_display ]; then
         print_success "Test application built successfully"
@@ -305,6 +325,7 @@ main() {
 
     # Build process
     clean_build
+    build_library || exit 1
     build_clock || exit 1
     build_failsafe || exit 1
     build_test || exit 1
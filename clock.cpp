@@ -1,296 +1,849 @@
 // Digital Clock for ST7789 Display (320x240, 90° rotation)
 // Using ST7789_TFT_RPI driver architecture with bcm2835 library
 
-#include <bcm2835.h>
+#include <atomic>
+#include <cerrno>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <ctime>
 #include <iostream>
+#include <limits>
+#include <semaphore.h>
 #include <signal.h>
+#include <thread>
 #include <unistd.h>
+#include <vector>
 
-// Display specifications (320x240 with 90° rotation = landscape)
-#define DISPLAY_WIDTH 320
-#define DISPLAY_HEIGHT 240
-#define DISPLAY_DRAWABLE_WIDTH 320
-#define DISPLAY_DRAWABLE_HEIGHT 240
-
-// GPIO Pin Configuration (Software SPI - matches ST7789_TFT_RPI SW SPI setup)
-#define TFT_CS_GPIO    RPI_BPLUS_GPIO_J8_32  // GPIO12 - CS/SS pin
-#define TFT_DC_GPIO    RPI_BPLUS_GPIO_J8_18  // GPIO24 - DC pin
-#define TFT_RST_GPIO   RPI_BPLUS_GPIO_J8_22  // GPIO25 - RESET pin
-#define TFT_SDATA_GPIO RPI_BPLUS_GPIO_J8_35  // GPIO19 - MOSI/SDA pin
-#define TFT_SCLK_GPIO  RPI_BPLUS_GPIO_J8_37  // GPIO26 - SCLK pin
-// Note: LED/Backlight connected to VCC (always on, no GPIO control needed)
-
-// SPI Communication Delay (for software SPI bit-banging)
-#define TFT_HIGHFREQ_DELAY 0  // Microseconds delay between bit operations
-
-// ST7789 Commands
-#define ST7789_NOP 0x00
-#define ST7789_SWRESET 0x01
-#define ST7789_SLPOUT 0x11
-#define ST7789_NORON 0x13
-#define ST7789_INVON 0x21
-#define ST7789_DISPON 0x29
-#define ST7789_CASET 0x2A
-#define ST7789_RASET 0x2B
-#define ST7789_RAMWR 0x2C
-#define ST7789_MADCTL 0x36
-#define ST7789_COLMOD 0x3A
-
-// Colors (RGB565 format)
-#define COLOR_BLACK 0x0000
-#define COLOR_WHITE 0xFFFF
-#define COLOR_RED 0xF800
-#define COLOR_GREEN 0x07E0
-#define COLOR_BLUE 0x001F
-#define COLOR_CYAN 0x07FF
-#define COLOR_MAGENTA 0xF81F
-#define COLOR_YELLOW 0xFFE0
+#include "analog_face.h"
+#include "failsafe.h"
+#include "font.h"
+#include "gfx.h"
+#include "latency_histogram.h"
+#include "layout.h"
+#include "pixel_ops.h"
+#include "realtime.h"
+#include "ring_logger.h"
+#include "shm_framebuffer.h"
+#include "st7789.h"
+#include "st7789_bcm2835.h"
+#include "st7789_te.h"
+
+// Frame handoff
+#define FRAME_SLOTS 3        // Render, flush and one completed frame in between
+#define FRAME_FRESH 0x4      // Set in the ready index until the flusher takes it
+
+// Tick scheduling
+#define TICK_HISTORY 8                 // Recent render+flush times used for the lead
+#define TICK_LEAD_MARGIN_NS 2000000LL  // Safety margin added to the measured lead
+#define TICK_LEAD_MAX_NS 900000000LL   // Never wake more than this before the edge
+#define ZONE_TABLE_YEARS 30  // Offset changes worked out this far ahead at startup
+
+// Instrumentation
+#define STATS_INTERVAL 60  // Seconds between periodic stats dumps
+
+// Shared framebuffer owner
+#define SHM_WAIT_MS 500  // Doorbell wait between checks for shutdown and stats
+
+// Analog face
+#define ANALOG_RADIUS 114  // Pixels; the face is centred on the display
 
 // Global variables
-volatile bool running = true;
-uint16_t framebuffer[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+std::atomic<bool> running(true);
+RingLogger logger;  // Stats and flush-thread messages; never blocks a tick
+std::atomic<bool> stats_requested(false);
 
 // Signal handler for clean shutdown
 void signal_handler(int signo) {
     running = false;
 }
 
-// ST7789 Display Driver Class (following ST7789_TFT_RPI architecture)
-class ST7789_Driver {
-private:
-    uint16_t _highFreqDelay;
-
-    // Software SPI bit-banging (matching ST7789_TFT_RPI implementation)
-    void spiWriteByte(uint8_t byte) {
-        for (int i = 7; i >= 0; i--) {
-            bcm2835_gpio_write(TFT_SCLK_GPIO, LOW);
-            if (byte & (1 << i)) {
-                bcm2835_gpio_write(TFT_SDATA_GPIO, HIGH);
-            } else {
-                bcm2835_gpio_write(TFT_SDATA_GPIO, LOW);
-            }
-            if (_highFreqDelay != 0) {
-                bcm2835_delayMicroseconds(_highFreqDelay);
-            }
-            bcm2835_gpio_write(TFT_SCLK_GPIO, HIGH);
-            if (_highFreqDelay != 0) {
-                bcm2835_delayMicroseconds(_highFreqDelay);
-            }
+// SIGUSR1: dump frame statistics at the next tick
+void stats_signal_handler(int signo) {
+    stats_requested = true;
+}
+
+// Per-tick timing probes, one histogram per stage
+enum FrameStage {
+    STAGE_FORMAT,  // Local time + layout digits
+    STAGE_TEXT,    // Glyph rendering of the changed characters
+    STAGE_RENDER,  // Whole render, wake to publish
+    STAGE_FLUSH,   // Flush thread: damage scan + transfer
+    STAGE_COUNT
+};
+
+const char* const stage_names[STAGE_COUNT] = {"format", "text", "render", "flush"};
+
+struct FrameStats {
+    LatencyHistogram stages[STAGE_COUNT];
+    std::atomic<uint64_t> framesRendered;
+    std::atomic<uint64_t> framesFlushed;
+    std::atomic<uint64_t> bytesSent;  // Copied from the driver by the flush thread
+    std::atomic<uint64_t> wakeups;    // Render loop wakeups, including interrupted sleeps
+
+    // Counters at the previous dump, for the per-interval rates
+    uint64_t _dumpWakeups;
+    uint64_t _dumpBytes;
+    int64_t _dumpNs;
+
+    // Threads rendering and (while it runs) sending to the panel; their
+    // scheduling is reported as achieved rather than as requested
+    pthread_t renderThread;
+    pthread_t flushThread;
+    std::atomic<bool> flushRunning;
+    const TearingSync* te;  // With --te
+
+    FrameStats()
+        : framesRendered(0), framesFlushed(0), bytesSent(0), wakeups(0),
+          _dumpWakeups(0), _dumpBytes(0), _dumpNs(monotonic_ns()), renderThread(pthread_self()),
+          flushRunning(false), te(nullptr) {}
+
+    // Policy and cores of the render and flush threads, and how much memory
+    // is locked
+    void logScheduling() {
+        char render[96], flush[96] = "not running";
+        describeThreadScheduling(renderThread, render, sizeof(render));
+        if (flushRunning.load()) {
+            describeThreadScheduling(flushThread, flush, sizeof(flush));
+        }
+        long locked = lockedMemoryKb();
+        if (locked > 0) {
+            logger.log("[stats]   sched: render %s, flush %s, %ld kB locked", render, flush,
+                       locked);
+        } else {
+            logger.log("[stats]   sched: render %s, flush %s, memory not locked", render, flush);
         }
     }
 
-    void writeCommand(uint8_t cmd) {
-        bcm2835_gpio_write(TFT_DC_GPIO, LOW);  // Command mode
-        bcm2835_gpio_write(TFT_CS_GPIO, LOW);  // CS low (select)
-        spiWriteByte(cmd);
-        bcm2835_gpio_write(TFT_CS_GPIO, HIGH); // CS high (deselect)
+    void dump(const char* reason, unsigned dropped) {
+        char p50[16], p99[16], max[16];
+        logger.log("[stats] %s: frames=%llu flushed=%llu dropped=%u bytes=%llu", reason,
+                   (unsigned long long)framesRendered.load(),
+                   (unsigned long long)framesFlushed.load(), dropped,
+                   (unsigned long long)bytesSent.load());
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            const LatencyHistogram& h = stages[i];
+            logger.log("[stats]   %s n=%llu p50=%s p99=%s max=%s", stage_names[i],
+                       (unsigned long long)h.count(),
+                       format_duration(h.percentile(50), p50, sizeof(p50)),
+                       format_duration(h.percentile(99), p99, sizeof(p99)),
+                       format_duration(h.max(), max, sizeof(max)));
+        }
+        logScheduling();
+        if (te) {
+            logger.log("[stats]   te: %.1f Hz, blanks=%llu timeouts=%llu windows=%llu held=%llu"
+                       " raced=%llu", te->refreshHz(), (unsigned long long)te->blanks(),
+                       (unsigned long long)te->timeouts(), (unsigned long long)te->windows(),
+                       (unsigned long long)te->held(), (unsigned long long)te->raced());
+        }
+
+        // Wakeups and bus traffic per minute since the last dump: what idle
+        // mode is meant to bring down
+        int64_t now = monotonic_ns();
+        uint64_t woke = wakeups.load() - _dumpWakeups;
+        uint64_t sent = bytesSent.load() - _dumpBytes;
+        double minutes = (now - _dumpNs) / 60e9;
+        if (minutes > 0) {
+            logger.log("[stats]   interval %lld s: %.1f wakeups/min, %.0f bytes/min",
+                       (long long)((now - _dumpNs) / 1000000000LL), woke / minutes, sent / minutes);
+        }
+        _dumpWakeups += woke;
+        _dumpBytes += sent;
+        _dumpNs = now;
     }
 
-    void writeData(uint8_t data) {
-        bcm2835_gpio_write(TFT_DC_GPIO, HIGH); // Data mode
-        bcm2835_gpio_write(TFT_CS_GPIO, LOW);  // CS low (select)
-        spiWriteByte(data);
-        bcm2835_gpio_write(TFT_CS_GPIO, HIGH); // CS high (deselect)
+    // Start a new interval for the latency histograms; counters keep running
+    void resetLatencies() {
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            stages[i].reset();
+        }
     }
+};
 
-public:
-    ST7789_Driver() : _highFreqDelay(TFT_HIGHFREQ_DELAY) {}
-
-    // Setup GPIO pins for Software SPI (matching TFTSetupGPIO for SW SPI)
-    bool setupGPIO() {
-        std::cout << "Initializing bcm2835 library..." << std::endl;
-        if (!bcm2835_init()) {
-            std::cerr << "Error: bcm2835_init failed. Are you running as root?" << std::endl;
-            return false;
-        }
-
-        // Set GPIO pin modes to output
-        bcm2835_gpio_fsel(TFT_CS_GPIO, BCM2835_GPIO_FSEL_OUTP);
-        bcm2835_gpio_fsel(TFT_DC_GPIO, BCM2835_GPIO_FSEL_OUTP);
-        bcm2835_gpio_fsel(TFT_RST_GPIO, BCM2835_GPIO_FSEL_OUTP);
-        bcm2835_gpio_fsel(TFT_SDATA_GPIO, BCM2835_GPIO_FSEL_OUTP);
-        bcm2835_gpio_fsel(TFT_SCLK_GPIO, BCM2835_GPIO_FSEL_OUTP);
-
-        // Initialize pin states
-        bcm2835_gpio_write(TFT_CS_GPIO, HIGH);    // CS high (deselected)
-        bcm2835_gpio_write(TFT_SCLK_GPIO, LOW);   // Clock low
-        bcm2835_gpio_write(TFT_SDATA_GPIO, LOW);  // Data low
+FrameStats frame_stats;
 
-        std::cout << "GPIO Setup Complete - Software SPI Mode" << std::endl;
-        std::cout << "  CS:    GPIO12 (Pin 32)" << std::endl;
-        std::cout << "  DC:    GPIO24 (Pin 18)" << std::endl;
-        std::cout << "  RESET: GPIO25 (Pin 22)" << std::endl;
-        std::cout << "  MOSI:  GPIO19 (Pin 35)" << std::endl;
-        std::cout << "  SCLK:  GPIO26 (Pin 37)" << std::endl;
+// Wakes the render loop once per period (a second by default), just early
+// enough that rendering plus flushing completes on the wall-clock edge. The
+// lead time is the slowest of the last TICK_HISTORY frames plus a margin.
+class TickScheduler {
+private:
+    int64_t _history[TICK_HISTORY];
+    int _next;
+    int _period;  // Seconds between ticks; ticks land on multiples of it
+    time_t _lastTick;
+    int64_t _renderNs;
+    bool _rendered;  // A frame was rendered since its cost was last folded in
+    std::atomic<int64_t> _flushNs;  // Written by the flush thread
 
-        return true;
+public:
+    TickScheduler()
+        : _next(0), _period(1), _lastTick(0), _renderNs(0), _rendered(false), _flushNs(0) {
+        for (int i = 0; i < TICK_HISTORY; i++) {
+            _history[i] = 0;
+        }
     }
 
-    // Initialize display (matching ST7789_TFT_RPI initialization sequence)
-    void initDisplay() {
-        std::cout << "Initializing ST7789 display..." << std::endl;
+    // Tick every period seconds, on the wall-clock edges that are multiples
+    // of it (60: once a minute, on the minute)
+    void setPeriod(int seconds) {
+        _period = seconds;
+    }
 
-        // Hardware reset sequence
-        std::cout << "  - Performing hardware reset..." << std::endl;
-        bcm2835_gpio_write(TFT_RST_GPIO, HIGH);
-        bcm2835_delay(10);
-        bcm2835_gpio_write(TFT_RST_GPIO, LOW);
-        bcm2835_delay(50);
-        bcm2835_gpio_write(TFT_RST_GPIO, HIGH);
-        bcm2835_delay(150);
+    // Render loop: time spent drawing the frame just published
+    void recordRender(int64_t ns) {
+        _renderNs = ns;
+        _rendered = true;
+    }
 
-        // Software reset
-        std::cout << "  - Sending software reset..." << std::endl;
-        writeCommand(ST7789_SWRESET);
-        bcm2835_delay(200);
+    // Flush thread: time spent sending the last frame
+    void recordFlush(int64_t ns) {
+        _flushNs.store(ns, std::memory_order_relaxed);
+    }
 
-        // Sleep out
-        std::cout << "  - Waking up display..." << std::endl;
-        writeCommand(ST7789_SLPOUT);
-        bcm2835_delay(120);
+    int64_t leadNs() const {
+        int64_t lead = 0;
+        for (int i = 0; i < TICK_HISTORY; i++) {
+            if (_history[i] > lead) lead = _history[i];
+        }
+        lead += TICK_LEAD_MARGIN_NS;
+        return lead > TICK_LEAD_MAX_NS ? TICK_LEAD_MAX_NS : lead;
+    }
+
+    // Sleep until the next tick and return the second to display, or 0 if
+    // interrupted by a signal. A second that has already started (first
+    // tick, or a late frame) is returned immediately.
+    time_t waitForNextTick() {
+        // Fold the last frame's cost into the history before picking a lead,
+        // once per frame: a wait a signal cut short comes back here without
+        // a new frame
+        if (_rendered) {
+            _history[_next] = _renderNs + _flushNs.load(std::memory_order_relaxed);
+            _next = (_next + 1) % TICK_HISTORY;
+            _rendered = false;
+        }
 
-        // Configure display orientation and format
-        std::cout << "  - Configuring display (90° rotation)..." << std::endl;
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
 
-        // Memory Access Control (90° rotation)
-        writeCommand(ST7789_MADCTL);
-        writeData(0x60);  // 90° rotation, RGB order
+        time_t target = _lastTick - _lastTick % _period + _period;
+        if (target <= now.tv_sec) {
+            // Behind (first tick or a late frame): show the current second
+            _lastTick = now.tv_sec;
+            return now.tv_sec;
+        }
+        if (target > now.tv_sec + 2 * _period) {
+            // Wall clock was stepped backwards: aim for the next edge
+            target = now.tv_sec - now.tv_sec % _period + _period;
+        }
 
-        // Pixel Format: 16 bits/pixel (RGB565)
-        writeCommand(ST7789_COLMOD);
-        writeData(0x55);  // 16-bit color
+        int64_t wake_ns = (int64_t)target * 1000000000LL - leadNs();
+        struct timespec wake;
+        wake.tv_sec = wake_ns / 1000000000LL;
+        wake.tv_nsec = wake_ns % 1000000000LL;
+        if (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &wake, nullptr) != 0) {
+            return 0;
+        }
 
-        // Normal display mode
-        writeCommand(ST7789_NORON);
-        bcm2835_delay(10);
+        _lastTick = target;
+        return target;
+    }
+};
 
-        // Inversion on
-        writeCommand(ST7789_INVON);
-        bcm2835_delay(10);
+// Damage hints travelling with a frame: what the text widgets redrew since
+// the frame published before it
+struct FrameHints {
+    int count;  // -1: unknown, compare the whole frame
+    DirtyRect rects[DAMAGE_MAX_RECTS];
+};
 
-        // Display on
-        std::cout << "  - Turning on display..." << std::endl;
-        writeCommand(ST7789_DISPON);
-        bcm2835_delay(120);
+// Lock-free frame mailbox between the render loop and the flush thread.
+// Three buffers: the renderer owns one, the flusher owns one, and the
+// newest completed frame waits in the third. Publishing swaps the back
+// buffer into the ready slot; if the flusher had not taken the previous
+// frame yet it is simply overwritten and counted as dropped, so the panel
+// always receives the latest frame. With several panels a slot holds one
+// frame per panel, back to back, so they are handed over together. Each
+// frame carries its FrameHints and a sequence number, so the flusher can
+// tell whether the hints chain onto the frame it sent last.
+class FrameMailbox {
+private:
+    uint16_t* _frames;              // FRAME_SLOTS slots of _panels frames
+    FrameHints* _hints;             // FRAME_SLOTS slots of _panels hints
+    uint64_t _sequence[FRAME_SLOTS];
+    uint64_t _published;
+    int _panels;
+    std::atomic<unsigned> _ready;   // Slot index, | FRAME_FRESH when unconsumed
+    std::atomic<unsigned> _dropped;
+    unsigned _back;                 // Renderer's slot
+    unsigned _front;                // Flusher's slot
+    sem_t _doorbell;
 
-        std::cout << "Display initialization complete!" << std::endl;
+    uint16_t* slot(unsigned index) const {
+        return _frames + (size_t)index * _panels * DISPLAY_WIDTH * DISPLAY_HEIGHT;
     }
 
-    // Set address window
-    void setAddrWindow(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1) {
-        writeCommand(ST7789_CASET);
-        writeData(x0 >> 8);
-        writeData(x0 & 0xFF);
-        writeData(x1 >> 8);
-        writeData(x1 & 0xFF);
+    FrameMailbox(const FrameMailbox&);
+    FrameMailbox& operator=(const FrameMailbox&);
 
-        writeCommand(ST7789_RASET);
-        writeData(y0 >> 8);
-        writeData(y0 & 0xFF);
-        writeData(y1 >> 8);
-        writeData(y1 & 0xFF);
+public:
+    explicit FrameMailbox(int panels = 1)
+        : _frames(new uint16_t[(size_t)FRAME_SLOTS * panels * DISPLAY_WIDTH * DISPLAY_HEIGHT]()),
+          _hints(new FrameHints[FRAME_SLOTS * panels]),
+          _published(0), _panels(panels), _ready(1), _dropped(0), _back(0), _front(2) {
+        for (int i = 0; i < FRAME_SLOTS; i++) {
+            _sequence[i] = 0;
+        }
+        sem_init(&_doorbell, 0, 0);
+    }
 
-        writeCommand(ST7789_RAMWR);
+    // Touch every page of the frames and hints now, not during the first
+    // ticks
+    void prefault() {
+        prefaultMemory(_frames, sizeof(uint16_t) * FRAME_SLOTS * _panels *
+                                DISPLAY_WIDTH * DISPLAY_HEIGHT);
+        prefaultMemory(_hints, sizeof(FrameHints) * FRAME_SLOTS * _panels);
     }
 
-    // Push pixel data
-    void pushPixel(uint16_t color) {
-        bcm2835_gpio_write(TFT_DC_GPIO, HIGH); // Data mode
-        bcm2835_gpio_write(TFT_CS_GPIO, LOW);  // CS low
-        spiWriteByte(color >> 8);
-        spiWriteByte(color & 0xFF);
-        bcm2835_gpio_write(TFT_CS_GPIO, HIGH); // CS high
+    ~FrameMailbox() {
+        sem_destroy(&_doorbell);
+        delete[] _hints;
+        delete[] _frames;
     }
 
-    // Push framebuffer to display
-    void pushFramebuffer(uint16_t* framebuffer, int width, int height) {
-        setAddrWindow(0, 0, width - 1, height - 1);
+    // Renderer side: buffer to draw the next frame of a panel into
+    uint16_t* backBuffer(int panel = 0) {
+        return slot(_back) + (size_t)panel * DISPLAY_WIDTH * DISPLAY_HEIGHT;
+    }
 
-        bcm2835_gpio_write(TFT_DC_GPIO, HIGH); // Data mode
-        bcm2835_gpio_write(TFT_CS_GPIO, LOW);  // CS low
+    // Renderer side: damage hints of the frame being drawn
+    FrameHints* backHints(int panel = 0) {
+        return _hints + _back * _panels + panel;
+    }
 
-        for (int i = 0; i < width * height; i++) {
-            uint16_t pixel = framebuffer[i];
-            spiWriteByte(pixel >> 8);
-            spiWriteByte(pixel & 0xFF);
+    // Renderer side: hand the finished back buffer to the flusher
+    void publish() {
+        _sequence[_back] = ++_published;
+        unsigned prev = _ready.exchange(_back | FRAME_FRESH, std::memory_order_acq_rel);
+        if (prev & FRAME_FRESH) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
         }
+        _back = prev & ~FRAME_FRESH;
+        sem_post(&_doorbell);
+    }
 
-        bcm2835_gpio_write(TFT_CS_GPIO, HIGH); // CS high
+    // Flusher side: wait for a frame. Returns nullptr when woken without
+    // one (shutdown, signal, or a doorbell for a frame already taken).
+    // Panel i's frame follows at i * DISPLAY_WIDTH * DISPLAY_HEIGHT.
+    const uint16_t* acquire() {
+        if (sem_wait(&_doorbell) != 0 && errno == EINTR) {
+            return nullptr;
+        }
+        if (!(_ready.load(std::memory_order_acquire) & FRAME_FRESH)) {
+            return nullptr;
+        }
+        unsigned prev = _ready.exchange(_front, std::memory_order_acq_rel);
+        _front = prev & ~FRAME_FRESH;
+        return slot(_front);
     }
 
-    // Cleanup
-    void powerDown() {
-        bcm2835_close();
+    // Flusher side: hints and sequence number of the acquired frame
+    const FrameHints* frontHints(int panel = 0) const {
+        return _hints + _front * _panels + panel;
+    }
+
+    uint64_t frontSequence() const {
+        return _sequence[_front];
+    }
+
+    // Unblock the flusher, e.g. for shutdown
+    void wake() {
+        sem_post(&_doorbell);
+    }
+
+    unsigned dropped() const {
+        return _dropped.load(std::memory_order_relaxed);
     }
 };
 
-// Draw a filled rectangle
-void draw_rect(int x, int y, int w, int h, uint16_t color) {
-    for (int j = y; j < y + h && j < DISPLAY_HEIGHT; j++) {
-        for (int i = x; i < x + w && i < DISPLAY_WIDTH; i++) {
-            framebuffer[j * DISPLAY_WIDTH + i] = color;
+// Append the windows panel `frame` needs to rects, skipping any already
+// listed for another panel. Only the hinted areas are compared when hints
+// is non-null. Tracker is DamageTracker, or TileTracker with --tiles.
+template <class Tracker>
+static int collect_damage(Tracker& damage, const uint16_t* frame,
+                          const FrameHints* hints, DirtyRect* rects, int count) {
+    DirtyRect found[DAMAGE_MAX_RECTS];
+    int n = hints ? damage.collectWithin(frame, hints->rects, hints->count, found, DAMAGE_MAX_RECTS)
+                  : damage.collect(frame, found, DAMAGE_MAX_RECTS);
+    for (int i = 0; i < n; i++) {
+        bool listed = false;
+        for (int j = 0; j < count && !listed; j++) {
+            listed = rects[j].x == found[i].x && rects[j].y == found[i].y &&
+                     rects[j].w == found[i].w && rects[j].h == found[i].h;
+        }
+        if (!listed) {
+            rects[count++] = found[i];
         }
     }
+    return count;
 }
 
-// Simple 5x7 font drawing (digits only)
-const uint8_t font_5x7[10][7] = {
-    {0x1F, 0x11, 0x11, 0x11, 0x1F}, // 0
-    {0x00, 0x00, 0x1F, 0x00, 0x00}, // 1
-    {0x1D, 0x15, 0x15, 0x15, 0x17}, // 2
-    {0x11, 0x15, 0x15, 0x15, 0x1F}, // 3
-    {0x07, 0x04, 0x04, 0x1F, 0x04}, // 4
-    {0x17, 0x15, 0x15, 0x15, 0x1D}, // 5
-    {0x1F, 0x15, 0x15, 0x15, 0x1D}, // 6
-    {0x01, 0x01, 0x01, 0x01, 0x1F}, // 7
-    {0x1F, 0x15, 0x15, 0x15, 0x1F}, // 8
-    {0x17, 0x15, 0x15, 0x15, 0x1F}  // 9
-};
+// Send the windows of a frame in one transaction. With te, start right
+// after a vertical blank and go in scan order (ascending x, the panel's
+// line order), so each window is written ahead of the scan, or held until
+// the scan has passed it.
+static void send_windows(ST7789_Driver* display, const uint16_t* frame, DirtyRect* dirty,
+                         int count, TearingSync* te) {
+    if (te && count > 0) {
+        for (int i = 1; i < count; i++) {
+            DirtyRect rect = dirty[i];
+            int j = i;
+            for (; j > 0 && dirty[j - 1].x > rect.x; j--) {
+                dirty[j] = dirty[j - 1];
+            }
+            dirty[j] = rect;
+        }
+        te->waitForBlank();
+    }
+    int bytes_per_2px = display->pixelFormat() == ST7789_RGB444 ? 3 : 4;
+    display->beginTransaction();
+    for (int i = 0; i < count; i++) {
+        const DirtyRect& r = dirty[i];
+        uint64_t bytes = (uint64_t)r.w * r.h * bytes_per_2px / 2;
+        if (te) {
+            te->beforeWindow(r.x, r.x + r.w - 1, bytes);
+        }
+        int64_t start = monotonic_ns();
+        display->pushWireRect(frame, DISPLAY_WIDTH, r.x, r.y, r.w, r.h);
+        if (te) {
+            te->afterWindow(r.x, r.x + r.w - 1, bytes, start, monotonic_ns());
+        }
+    }
+    display->endTransaction();
+}
 
-void draw_char(int x, int y, char c, uint16_t color, int scale) {
-    if (c < '0' || c > '9') {
-        if (c == ':') {
-            // Draw colon as two dots
-            for (int dy = 0; dy < scale; dy++) {
-                for (int dx = 0; dx < scale; dx++) {
-                    framebuffer[(y + 1 * scale + dy) * DISPLAY_WIDTH + (x + 2 * scale + dx)] = color;
-                    framebuffer[(y + 5 * scale + dy) * DISPLAY_WIDTH + (x + 2 * scale + dx)] = color;
-                }
+// Flush thread: sends the latest published frame, partial-refreshing only
+// what differs from the panel contents. With several panels every panel
+// receives the windows any of them needs, each from its own frame, so the
+// multi-panel transport can clock all of them out at once. A panel left
+// blank by initDisplay(false) is switched on once the first frame is in
+// its memory, so it never shows stale contents. With cpu >= 0 the thread
+// pins itself first, so not even the first frame is sent from another core.
+template <class Tracker>
+void flush_thread(ST7789_Driver* display, MultiSoftSPITransport* lanes, int panels,
+                  FrameMailbox* mailbox, Tracker* damage, TickScheduler* scheduler,
+                  TearingSync* te, bool switch_on, int64_t started_ns, int cpu) {
+    if (cpu >= 0) {
+        pinThreadToCpu(pthread_self(), cpu);
+    }
+    frame_stats.flushThread = pthread_self();
+    frame_stats.flushRunning = true;
+    frame_stats.logScheduling();
+
+    DirtyRect dirty[DAMAGE_MAX_RECTS * ST7789_MAX_PANELS];
+    const uint16_t* frames[ST7789_MAX_PANELS];
+    const FrameHints* hints[ST7789_MAX_PANELS];
+    uint64_t last_sequence = 0;
+    bool first = true;
+
+    while (running) {
+        const uint16_t* frame = mailbox->acquire();
+        if (frame == nullptr) {
+            continue;
+        }
+        int64_t start = monotonic_ns();
+
+        // Hints describe changes since the previous frame, so they are only
+        // usable if that is the frame the panels show
+        bool chained = mailbox->frontSequence() == last_sequence + 1;
+        last_sequence = mailbox->frontSequence();
+
+        int dirty_count = 0;
+        for (int p = 0; p < panels; p++) {
+            frames[p] = frame + p * DISPLAY_WIDTH * DISPLAY_HEIGHT;
+            hints[p] = mailbox->frontHints(p);
+            if (!chained || hints[p]->count < 0) {
+                hints[p] = nullptr;
             }
+            dirty_count = collect_damage(damage[p], frames[p], hints[p], dirty, dirty_count);
         }
-        return;
-    }
-
-    int digit = c - '0';
-    for (int row = 0; row < 7; row++) {
-        for (int col = 0; col < 5; col++) {
-            if (font_5x7[digit][row] & (1 << col)) {
-                for (int dy = 0; dy < scale; dy++) {
-                    for (int dx = 0; dx < scale; dx++) {
-                        int px = x + col * scale + dx;
-                        int py = y + row * scale + dy;
-                        if (px < DISPLAY_WIDTH && py < DISPLAY_HEIGHT) {
-                            framebuffer[py * DISPLAY_WIDTH + px] = color;
-                        }
-                    }
-                }
+        if (lanes) {
+            lanes->setLaneFrames(frames, DISPLAY_WIDTH * DISPLAY_HEIGHT);
+        }
+        send_windows(display, frame, dirty, dirty_count, te);
+        if (lanes) {
+            lanes->setLaneFrames(nullptr, 0);
+        }
+        for (int p = 0; p < panels; p++) {
+            if (hints[p]) {
+                damage[p].commitRects(frames[p], hints[p]->rects, hints[p]->count);
+            } else {
+                damage[p].commit(frames[p]);
+            }
+        }
+
+        int64_t elapsed = monotonic_ns() - start;
+        scheduler->recordFlush(elapsed);
+        frame_stats.stages[STAGE_FLUSH].record(elapsed);
+        frame_stats.framesFlushed.fetch_add(1, std::memory_order_relaxed);
+        frame_stats.bytesSent.store(display->bytesSent(), std::memory_order_relaxed);
+
+        // Whichever frame arrives first: the renderer may already have
+        // replaced frame 1 before this thread took it
+        if (first) {
+            if (switch_on) {
+                display->displayOn();
+            }
+            logger.log("First frame on the panel %lld ms after start",
+                       (long long)((monotonic_ns() - started_ns) / 1000000));
+            first = false;
+        }
+    }
+    frame_stats.flushRunning = false;
+}
+
+// --shm: show what a client draws into the shared framebuffer instead of
+// the clock. Frames go to the panel straight from shared memory, through
+// the same damage tracking as the flush thread: the ring's rectangles are
+// the hints, and an unknown damage (first frame, ring overrun) compares the
+// whole frame. Frames the client submits faster than the panel takes them
+// are skipped and counted as dropped.
+template <class Tracker>
+void shm_owner_loop(ST7789_Driver* display, ShmFramebuffer* shm, Tracker* damage,
+                    TearingSync* te, bool switch_on, int64_t started_ns) {
+    DirtyRect hints[DAMAGE_MAX_RECTS];
+    DirtyRect dirty[DAMAGE_MAX_RECTS];
+    unsigned dropped = 0;
+    time_t last_stats = time(nullptr);
+
+    // The frame already in the segment goes up first: black, or what the
+    // client showed before an owner restart
+    uint32_t sequence = shm->latest();
+    uint32_t last_sequence = sequence - 1;
+    bool first = true;
+
+    while (running) {
+        if (stats_requested.exchange(false)) {
+            frame_stats.dump("SIGUSR1", dropped);
+        }
+        time_t now = time(nullptr);
+        if (now - last_stats >= STATS_INTERVAL) {
+            frame_stats.dump("periodic", dropped);
+            frame_stats.resetLatencies();
+            last_stats = now;
+        }
+
+        if (!first) {
+            sequence = shm->waitForFrame(SHM_WAIT_MS);
+            frame_stats.wakeups.fetch_add(1, std::memory_order_relaxed);
+            if (sequence == 0) {
+                continue;
             }
         }
+        int64_t start = monotonic_ns();
+
+        // Client frames since the last flush; all but this one were skipped
+        uint32_t submitted = sequence - last_sequence;
+        dropped += submitted - 1;
+        last_sequence = sequence;
+        frame_stats.framesRendered.fetch_add(submitted, std::memory_order_relaxed);
+
+        const uint16_t* frame = shm->frame(sequence);
+        int hint_count = shm->collectDamage(sequence, hints, DAMAGE_MAX_RECTS);
+        int count = hint_count < 0
+            ? damage->collect(frame, dirty, DAMAGE_MAX_RECTS)
+            : damage->collectWithin(frame, hints, hint_count, dirty, DAMAGE_MAX_RECTS);
+
+        send_windows(display, frame, dirty, count, te);
+        if (hint_count < 0) {
+            damage->commit(frame);
+        } else {
+            damage->commitRects(frame, hints, hint_count);
+        }
+        shm->markFlushed(sequence);
+
+        int64_t elapsed = monotonic_ns() - start;
+        frame_stats.stages[STAGE_FLUSH].record(elapsed);
+        frame_stats.framesFlushed.fetch_add(1, std::memory_order_relaxed);
+        frame_stats.bytesSent.store(display->bytesSent(), std::memory_order_relaxed);
+
+        if (first) {
+            if (switch_on) {
+                display->displayOn();
+            }
+            logger.log("First frame on the panel %lld ms after start",
+                       (long long)((monotonic_ns() - started_ns) / 1000000));
+            first = false;
+        }
     }
+    frame_stats.dump("exit", dropped);
 }
 
-void draw_text(int x, int y, const char* text, uint16_t color, int scale) {
-    int cursor_x = x;
-    for (int i = 0; text[i] != '\0'; i++) {
-        draw_char(cursor_x, y, text[i], color, scale);
-        cursor_x += (text[i] == ':' ? 4 : 6) * scale;
+// Point localtime() at a panel's time zone; nullptr means TZ unset
+static void use_time_zone(const char* zone) {
+    if (zone) {
+        setenv("TZ", zone, 1);
+    } else {
+        unsetenv("TZ");
     }
+    tzset();
 }
 
-int main() {
+// Seconds east of UTC at t in the zone localtime() uses
+static long utc_offset(time_t t) {
+    struct tm local;
+    localtime_r(&t, &local);
+    return local.tm_gmtoff;
+}
+
+// A panel's wall clock: its zone's UTC offsets are worked out once at
+// startup, so a tick only looks the offset up, adds it and splits the
+// result with gmtime_r, without touching TZ or the environment
+struct PanelClock {
+    struct Change {
+        time_t from;
+        long offset;
+    };
+    std::vector<Change> changes;  // By time; the first also covers anything earlier
+
+    // From the zone localtime() uses now: a day-by-day scan from a year
+    // back to ZONE_TABLE_YEARS ahead, each change then found to the second
+    void build(time_t now) {
+        const time_t day = 86400;
+        const time_t span = (time_t)ZONE_TABLE_YEARS * 365 * day;
+        const time_t latest = std::numeric_limits<time_t>::max() - day;
+        time_t t = now - 365 * day;
+        time_t end = now < latest - span ? now + span : latest;
+        long offset = utc_offset(t);
+        changes.clear();
+        changes.push_back(Change{t, offset});
+        while (t < end) {
+            time_t next = t + day;
+            if (utc_offset(next) == offset) {
+                t = next;
+                continue;
+            }
+            time_t before = t;
+            while (next - before > 1) {
+                time_t mid = before + (next - before) / 2;
+                if (utc_offset(mid) == offset) {
+                    before = mid;
+                } else {
+                    next = mid;
+                }
+            }
+            offset = utc_offset(next);
+            changes.push_back(Change{next, offset});
+            t = next;
+        }
+    }
+
+    void localTime(time_t now, struct tm& out) const {
+        size_t first = 0;
+        size_t last = changes.size();
+        while (last - first > 1) {
+            size_t mid = first + (last - first) / 2;
+            if (changes[mid].from <= now) {
+                first = mid;
+            } else {
+                last = mid;
+            }
+        }
+        time_t shifted = now + changes[first].offset;
+        gmtime_r(&shifted, &out);
+    }
+};
+
+// Hot standby: block until failsafe sends the start command on fd. warm
+// is set from the command; false means failsafe closed the pipe (it is
+// shutting down or gone) or we were asked to stop.
+static bool wait_for_start(int fd, bool& warm) {
+    char command;
+    while (true) {
+        ssize_t n = read(fd, &command, 1);
+        if (n == 1) {
+            close(fd);
+            warm = command == STANDBY_START_WARM;
+            return true;
+        }
+        if (n < 0 && errno == EINTR && running) {
+            continue;
+        }
+        return false;
+    }
+}
+
+void print_usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [--hw-spi] [--spi-divider N] [--rgb444]"
+              << " [--panel CS[,MOSI]]... [--zone TZ]... [--idle] [--warm] [--log FILE]"
+              << " [--standby FD] [--shm NAME] [--font FILE] [--layout FILE]"
+              << " [--tiles] [--analog] [--rt-priority N] [--rt-cpu N] [--mlock] [--te GPIO]"
+              << " [--te-chip PATH]"
+              << std::endl;
+    printTransportUsage();
+    printRealtimeUsage();
+    std::cerr << "  --rgb444         Send 12-bit pixels (25% fewer bytes per frame)" << std::endl;
+    std::cerr << "  --zone TZ        Time zone of the next panel, e.g. Europe/London" << std::endl;
+    std::cerr << "  --idle           Low-power mode: HH:MM once a minute, 8 colours, panel" << std::endl;
+    std::cerr << "                   driven only in the columns the text covers" << std::endl;
+    std::cerr << "  --log FILE       Also write stats to FILE (rotated at 1 MB)" << std::endl;
+    std::cerr << "  --warm           Skip the reset chain if the panel is still set up by a" << std::endl;
+    std::cerr << "                   previous run (" << ST7789_STATE_FILE << ")" << std::endl;
+    std::cerr << "  --standby FD     Set up, then wait for failsafe's start command on FD" << std::endl;
+    std::cerr << "  --font FILE      Anti-aliased text from a font baked by font_bake" << std::endl;
+    std::cerr << "  --layout FILE    Widgets and positions from a layout file instead of the" << std::endl;
+    std::cerr << "                   centred time and date (see README)" << std::endl;
+    std::cerr << "  --analog         Analog face instead of the digital time and date" << std::endl;
+    std::cerr << "  --tiles          Find changes by 16x16 tile hashes instead of a copy of" << std::endl;
+    std::cerr << "                   the panel contents" << std::endl;
+    std::cerr << "  --te GPIO        Start each update after the vertical blank signalled on" << std::endl;
+    std::cerr << "                   the panel's TE pin, wired to GPIO (single panel)" << std::endl;
+    std::cerr << "  --te-chip PATH   gpiochip of the TE line (default " << TE_DEFAULT_CHIP << ")" << std::endl;
+    std::cerr << "  --shm NAME       Show frames a client draws into shared memory NAME" << std::endl;
+    std::cerr << "                   (e.g. /st7789) instead of the clock" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    TransportConfig transport_config;
+    RealtimeConfig realtime_config;
+    ST7789_PixelFormat pixel_format = ST7789_RGB565;
+    const char* zones[ST7789_MAX_PANELS] = {};
+    int zone_count = 0;
+    bool warm_start = false;
+    bool idle = false;
+    const char* log_path = nullptr;
+    int standby_fd = -1;
+    const char* shm_name = nullptr;
+    const char* font_path = nullptr;
+    const char* layout_path = nullptr;
+    bool tiles = false;
+    bool analog = false;
+    int te_gpio = -1;
+    const char* te_chip = TE_DEFAULT_CHIP;
+    int64_t started_ns = monotonic_ns();
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--rgb444") == 0) {
+            pixel_format = ST7789_RGB444;
+            continue;
+        }
+        if (strcmp(argv[i], "--warm") == 0) {
+            warm_start = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--idle") == 0) {
+            idle = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--tiles") == 0) {
+            tiles = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--analog") == 0) {
+            analog = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            log_path = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--standby") == 0 && i + 1 < argc) {
+            standby_fd = atoi(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "--font") == 0 && i + 1 < argc) {
+            font_path = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--layout") == 0 && i + 1 < argc) {
+            layout_path = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--te") == 0 && i + 1 < argc) {
+            te_gpio = atoi(argv[++i]);
+            if (te_gpio < 0) {
+                std::cerr << "Error: --te needs a GPIO number" << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "--te-chip") == 0 && i + 1 < argc) {
+            te_chip = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+            shm_name = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--zone") == 0 && i + 1 < argc) {
+            if (zone_count == ST7789_MAX_PANELS) {
+                std::cerr << "Error: more --zone options than panels" << std::endl;
+                return 1;
+            }
+            zones[zone_count++] = argv[++i];
+            continue;
+        }
+        int parsed = parseRealtimeOption(argc, argv, i, realtime_config);
+        if (parsed == 0) {
+            parsed = parseTransportOption(argc, argv, i, transport_config);
+        }
+        if (parsed < 0) {
+            return 1;
+        }
+        if (parsed == 0) {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Panels on the multi-panel bus, or the single default panel
+    int panels = transport_config.panelCount > 0 ? transport_config.panelCount : 1;
+    if (zone_count > panels) {
+        std::cerr << "Error: " << zone_count << " --zone options for " << panels
+                  << " panel(s); add a --panel per display" << std::endl;
+        return 1;
+    }
+    if (panels > 1 && pixel_format != ST7789_RGB565) {
+        // 12-bit pixels are repacked outside the frames, so the transport
+        // could not tell the panels' data apart
+        std::cerr << "Error: --rgb444 supports a single panel only" << std::endl;
+        return 1;
+    }
+    if (te_gpio >= 0 && panels > 1) {
+        // Every panel scans on its own clock
+        std::cerr << "Error: --te supports a single panel only" << std::endl;
+        return 1;
+    }
+    if (layout_path && analog) {
+        std::cerr << "Error: --layout and --analog are alternative faces" << std::endl;
+        return 1;
+    }
+    if (shm_name && (panels > 1 || idle)) {
+        std::cerr << "Error: --shm drives a single panel in normal mode" << std::endl;
+        return 1;
+    }
+    // Zone tables are built before any thread is started: a --zone is
+    // read by pointing the process TZ at it, and TZ is then put back, so
+    // log lines stay in the zone the clock was started with. Panels
+    // without --zone keep that zone too.
+    PanelClock clocks[ST7789_MAX_PANELS];
+    static char startup_zone[256];
+    const char* zone = getenv("TZ");
+    if (zone) {
+        snprintf(startup_zone, sizeof(startup_zone), "%s", zone);
+        zone = startup_zone;
+    }
+    time_t started = time(nullptr);
+    for (int p = 0; p < panels; p++) {
+        if (zone_count > 0) {
+            use_time_zone(p < zone_count ? zones[p] : zone);
+        }
+        clocks[p].build(started);
+    }
+    if (zone_count > 0) {
+        use_time_zone(zone);
+    }
+
     std::cout << "==============================================\n";
     std::cout << "Digital Clock for ST7789 Display\n";
     std::cout << "Using ST7789_TFT_RPI driver architecture\n";
@@ -299,64 +852,267 @@ int main() {
     // Setup signal handlers
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
+    signal(SIGUSR1, stats_signal_handler);
+
+    // Stats go through the logger's writer thread, so a slow terminal or
+    // disk never delays a tick. It runs under normal scheduling either way.
+    logger.open(log_path);
+    logger.installCrashHandler();
+
+    // The reset chain and the render loop run real-time, and the flush
+    // thread inherits it (failsafe may already have set it before exec)
+    applyRealtimePolicy(realtime_config);
+
+    // Baked font, mapped for the life of the clock
+    FontFile font;
+    if (font_path && !font.load(font_path)) {
+        return 1;
+    }
+
+    // Frames are rendered in wire order so the flush sends rows without
+    // re-encoding them; set before the layouts rasterise their glyphs
+    framebuffer_wire_order = true;
+
+    // The digital face, one copy per panel: positions, text buffers, glyph
+    // atlases and damage boxes are all worked out here, so a tick only
+    // writes digits. Idle mode drops the seconds.
+    Layout* layouts[ST7789_MAX_PANELS] = {};
+    for (int p = 0; !analog && p < panels; p++) {
+        layouts[p] = new Layout;
+        if (!layout_path) {
+            layouts[p]->loadDefault(font, idle);
+        } else if (!layouts[p]->load(layout_path, font, idle)) {
+            for (int q = 0; q <= p; q++) {
+                delete layouts[q];
+            }
+            return 1;
+        }
+    }
 
     // Create driver instance
-    ST7789_Driver display;
+    ST7789_Transport* transport = createTransport(transport_config);
+    ST7789_Driver display(*transport);
+    MultiSoftSPITransport* lanes = transport_config.panelCount > 0
+        ? static_cast<MultiSoftSPITransport*>(transport) : nullptr;
+
+    // Panel contents are unknown either way, so the first frame is sent in
+    // full; later frames only send what changed
+    DamageTracker* damage = tiles ? nullptr : new DamageTracker[panels];
+    TileTracker* tile_damage = tiles ? new TileTracker[panels] : nullptr;
+
+    // Render into the mailbox back buffer; the flush thread owns the display
+    // from here until it is joined
+    FrameMailbox mailbox(panels);
+    TickScheduler scheduler;
+
+    // --analog: dial and hand sprites are rendered here, once per panel
+    AnalogFace* faces[ST7789_MAX_PANELS] = {};
+    for (int p = 0; analog && p < panels; p++) {
+        faces[p] = new AnalogFace(DISPLAY_WIDTH / 2, DISPLAY_HEIGHT / 2, ANALOG_RADIUS, COLOR_WHITE,
+                                  COLOR_CYAN, COLOR_CYAN, COLOR_RED);
+    }
+
+    // Everything allocated above, on every way out from here
+    auto release = [&]() {
+        for (int p = 0; p < panels; p++) {
+            delete layouts[p];
+            delete faces[p];
+        }
+        delete[] damage;
+        delete[] tile_damage;
+        delete transport;
+        logger.close();
+    };
+
+    // A standby clock maps the GPIO registers now, but stays off the pins
+    // until failsafe starts it: the running clock still owns them. Failsafe
+    // picks warm or cold per crash.
+    if (standby_fd >= 0) {
+        if (!st7789_init_bcm2835()) {
+            release();
+            return EXIT_DISPLAY_ERROR;
+        }
+        std::cout << "Standby: waiting for failsafe" << std::endl;
+        if (!wait_for_start(standby_fd, warm_start)) {
+            release();
+            return 0;
+        }
+        started_ns = monotonic_ns();
+        std::cout << "Standby: started " << (warm_start ? "warm" : "cold") << std::endl;
+    }
+
+    // The TE line is only free once a previous clock has let go of it. The
+    // clock runs without it, unpaced, if it cannot be had.
+    TearingSync te_sync;
+    TearingSync* te = nullptr;
+    if (te_gpio >= 0) {
+        if (te_sync.open(te_gpio, te_chip)) {
+            te = &te_sync;
+            frame_stats.te = te;
+        } else {
+            std::cerr << "Warning: continuing without TE sync" << std::endl;
+        }
+    }
 
-    // Setup GPIO and initialize display
+    // Setup GPIO (a standby only configures its pins here) and initialize
+    // display
     if (!display.setupGPIO()) {
-        return 1;
+        release();
+        return EXIT_DISPLAY_ERROR;
     }
 
-    display.initDisplay();
+    // Warm start keeps the panel on; a cold start leaves it blank until the
+    // flush thread has uploaded the first frame
+    display.setPixelFormat(pixel_format);
+    display.setStateFile(ST7789_STATE_FILE);
+    bool resumed = warm_start && display.resumeDisplay();
+    if (!resumed) {
+        display.initDisplay(false);
+    }
+    if (te) {
+        display.tearingEffect(true);
+    }
+
+    // Everything a tick touches is allocated by now; threads started later
+    // get their stacks locked as they are mapped
+    if (realtime_config.lockMemory) {
+        lockProcessMemory();
+        mailbox.prefault();
+        if (tiles) {
+            prefaultMemory(tile_damage, sizeof(TileTracker) * panels);
+        } else {
+            prefaultMemory(damage, sizeof(DamageTracker) * panels);
+        }
+        prefaultStack();
+    }
+
+    if (shm_name) {
+        // A client draws instead of the clock; the flush thread and the
+        // mailbox are not used
+        ShmFramebuffer shm;
+        int status = 1;
+        if (shm.create(shm_name)) {
+            std::cout << "Display initialized. Showing shared framebuffer " << shm_name << std::endl;
+            // This thread sends the frames itself
+            if (realtime_config.cpu >= 0) {
+                pinThreadToCpu(pthread_self(), realtime_config.cpu);
+            }
+            frame_stats.flushThread = pthread_self();
+            frame_stats.flushRunning = true;
+            frame_stats.logScheduling();
+            if (tiles) {
+                shm_owner_loop(&display, &shm, &tile_damage[0], te, !resumed, started_ns);
+            } else {
+                shm_owner_loop(&display, &shm, &damage[0], te, !resumed, started_ns);
+            }
+            shm.close();
+            status = 0;
+        }
+        std::cout << "\nShutting down..." << std::endl;
+        display.powerDown();
+        release();
+        return status;
+    }
 
     std::cout << "Display initialized. Starting clock..." << std::endl;
 
-    time_t last_second = 0;
+    if (idle) {
+        // Drive only the panel lines (display columns) under the text, in
+        // 8 colours: cyan, yellow and black survive unchanged. One tick a
+        // minute, on the minute.
+        int first = 0;
+        int last = DISPLAY_WIDTH - 1;
+        if (analog) {
+            first = faces[0]->left();
+            last = faces[0]->left() + faces[0]->size() - 1;
+            if (first < 0) first = 0;
+            if (last > DISPLAY_WIDTH - 1) last = DISPLAY_WIDTH - 1;
+        } else if (!layouts[0]->columns(first, last)) {
+            first = 0;
+            last = DISPLAY_WIDTH - 1;
+        }
+        display.partialMode(first, last);
+        display.idleMode(true);
+        scheduler.setPeriod(60);
+        std::cout << "Idle mode: columns " << first << "-" << last
+                  << " driven, 8 colours, one update per minute" << std::endl;
+    }
+    std::thread flusher = tiles
+        ? std::thread(flush_thread<TileTracker>, &display, lanes, panels, &mailbox, tile_damage,
+                      &scheduler, te, !resumed, started_ns, realtime_config.cpu)
+        : std::thread(flush_thread<DamageTracker>, &display, lanes, panels, &mailbox, damage,
+                      &scheduler, te, !resumed, started_ns, realtime_config.cpu);
+
+    time_t last_stats = 0;
 
     while (running) {
-        time_t now = time(nullptr);
+        if (stats_requested.exchange(false)) {
+            frame_stats.dump("SIGUSR1", mailbox.dropped());
+        }
 
-        // Update only when second changes
-        if (now != last_second) {
-            last_second = now;
+        // Sleep until just before the next second edge
+        time_t now = scheduler.waitForNextTick();
+        frame_stats.wakeups.fetch_add(1, std::memory_order_relaxed);
+        if (now == 0) {
+            continue;
+        }
+        int64_t render_start = monotonic_ns();
+        int64_t stage_start = render_start;
 
-            struct tm* timeinfo = localtime(&now);
-            char time_str[16];
-            snprintf(time_str, sizeof(time_str), "%02d:%02d:%02d",
-                     timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec);
+        for (int panel = 0; panel < panels; panel++) {
+            framebuffer = mailbox.backBuffer(panel);
+            struct tm timeinfo;
+            clocks[panel].localTime(now, timeinfo);
+            if (layouts[panel]) {
+                layouts[panel]->format(timeinfo);
+            }
+
+            int64_t stage_end = monotonic_ns();
+            frame_stats.stages[STAGE_FORMAT].record(stage_end - stage_start);
+            stage_start = stage_end;
 
-            char date_str[32];
-            snprintf(date_str, sizeof(date_str), "%04d-%02d-%02d",
-                     timeinfo->tm_year + 1900, timeinfo->tm_mon + 1, timeinfo->tm_mday);
+            // Redraw only the characters (or hands) that changed; their
+            // areas become the frame's damage hints
+            FrameHints* hints = mailbox.backHints(panel);
+            if (faces[panel]) {
+                hints->count = faces[panel]->update(timeinfo.tm_hour, timeinfo.tm_min,
+                                                    idle ? -1 : timeinfo.tm_sec,
+                                                    hints->rects, 0, DAMAGE_MAX_RECTS);
+            } else {
+                hints->count = layouts[panel]->update(hints->rects, 0, DAMAGE_MAX_RECTS);
+            }
 
-            // Clear framebuffer
-            draw_rect(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, COLOR_BLACK);
+            stage_end = monotonic_ns();
+            frame_stats.stages[STAGE_TEXT].record(stage_end - stage_start);
+            stage_start = stage_end;
+        }
 
-            // Draw time (large, centered)
-            int time_scale = 8;
-            int time_width = strlen(time_str) * 6 * time_scale;
-            int time_x = (DISPLAY_WIDTH - time_width) / 2;
-            int time_y = 60;
-            draw_text(time_x, time_y, time_str, COLOR_CYAN, time_scale);
+        // Hand the frames to the flush thread; the next tick renders into a
+        // fresh back buffer
+        mailbox.publish();
 
-            // Draw date (smaller, centered below)
-            int date_scale = 3;
-            int date_width = strlen(date_str) * 6 * date_scale;
-            int date_x = (DISPLAY_WIDTH - date_width) / 2;
-            int date_y = 160;
-            draw_text(date_x, date_y, date_str, COLOR_YELLOW, date_scale);
+        int64_t render_ns = monotonic_ns() - render_start;
+        scheduler.recordRender(render_ns);
+        frame_stats.stages[STAGE_RENDER].record(render_ns);
+        frame_stats.framesRendered.fetch_add(1, std::memory_order_relaxed);
 
-            // Update display
-            display.pushFramebuffer(framebuffer, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+        // Periodic dump to the log, one interval per dump
+        if (last_stats == 0) {
+            last_stats = now;
+        } else if (now - last_stats >= STATS_INTERVAL) {
+            frame_stats.dump("periodic", mailbox.dropped());
+            frame_stats.resetLatencies();
+            last_stats = now;
         }
-
-        usleep(100000); // Sleep 100ms
     }
 
     // Cleanup
     std::cout << "\nShutting down..." << std::endl;
+    mailbox.wake();
+    flusher.join();
+    frame_stats.dump("exit", mailbox.dropped());
     display.powerDown();
+    release();
 
     return 0;
 }
@@ -2,43 +2,35 @@
 // Monitors and recovers from display errors
 // Using ST7789_TFT_RPI driver architecture with bcm2835 library
 
-#include <bcm2835.h>
 #include <sys/wait.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <iostream>
 #include <signal.h>
-#include <fstream>
-
-// GPIO Pin Configuration (Software SPI - matches ST7789_TFT_RPI SW SPI setup)
-#define TFT_CS_GPIO    RPI_BPLUS_GPIO_J8_32  // GPIO12 - CS/SS pin
-#define TFT_DC_GPIO    RPI_BPLUS_GPIO_J8_18  // GPIO24 - DC pin
-#define TFT_RST_GPIO   RPI_BPLUS_GPIO_J8_22  // GPIO25 - RESET pin
-#define TFT_SDATA_GPIO RPI_BPLUS_GPIO_J8_35  // GPIO19 - MOSI/SDA pin
-#define TFT_SCLK_GPIO  RPI_BPLUS_GPIO_J8_37  // GPIO26 - SCLK pin
-// Note: LED/Backlight connected to VCC (always on, no GPIO control needed)
-
-#define TFT_HIGHFREQ_DELAY 0  // Microseconds delay between bit operations
-
-#define ST7789_SWRESET 0x01
-#define ST7789_SLPOUT 0x11
-#define ST7789_NORON 0x13
-#define ST7789_INVON 0x21
-#define ST7789_DISPON 0x29
-#define ST7789_CASET 0x2A
-#define ST7789_RASET 0x2B
-#define ST7789_RAMWR 0x2C
-#define ST7789_MADCTL 0x36
-#define ST7789_COLMOD 0x3A
-
-#define COLOR_RED 0xF800
-#define DISPLAY_WIDTH 320
-#define DISPLAY_HEIGHT 240
+#include <vector>
+
+#include "failsafe.h"
+#include "realtime.h"
+#include "ring_logger.h"
+#include "st7789.h"
+#include "st7789_bcm2835.h"
+
+// Crash restarts back off exponentially: the first is immediate, the next
+// waits RESTART_BACKOFF_MS, doubling per further crash in the restart window
+#define RESTART_BACKOFF_MS 100
+#define RESTART_BACKOFF_MAX_MS 8000
 
 volatile bool running = true;
 pid_t child_pid = 0;
-uint16_t _highFreqDelay = TFT_HIGHFREQ_DELAY;
+pid_t standby_pid = 0;   // Pre-started child waiting on standby_fd
+int standby_fd = -1;     // Write end of its start pipe
+ST7789_Transport* transport = nullptr;
+ST7789_Driver* display = nullptr;
+RingLogger logger;
+RealtimeConfig child_realtime;  // The child's --rt-priority, applied before exec
 
 void signal_handler(int signo) {
     running = false;
@@ -47,58 +39,10 @@ void signal_handler(int signo) {
     }
 }
 
+// Timestamped to stdout and /tmp/clock_failsafe.log by the logger's
+// writer thread
 void log_message(const char* message) {
-    time_t now = time(nullptr);
-    char timestamp[32];
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
-    std::cout << "[" << timestamp << "] " << message << std::endl;
-
-    // Also log to file
-    std::ofstream log_file("/tmp/clock_failsafe.log", std::ios::app);
-    if (log_file.is_open()) {
-        log_file << "[" << timestamp << "] " << message << std::endl;
-        log_file.close();
-    }
-}
-
-// Software SPI bit-banging (matching ST7789_TFT_RPI implementation)
-void spiWriteByte(uint8_t byte) {
-    for (int i = 7; i >= 0; i--) {
-        bcm2835_gpio_write(TFT_SCLK_GPIO, LOW);
-        if (byte & (1 << i)) {
-            bcm2835_gpio_write(TFT_SDATA_GPIO, HIGH);
-        } else {
-            bcm2835_gpio_write(TFT_SDATA_GPIO, LOW);
-        }
-        if (_highFreqDelay != 0) {
-            bcm2835_delayMicroseconds(_highFreqDelay);
-        }
-        bcm2835_gpio_write(TFT_SCLK_GPIO, HIGH);
-        if (_highFreqDelay != 0) {
-            bcm2835_delayMicroseconds(_highFreqDelay);
-        }
-    }
-}
-
-void spi_write_command(uint8_t cmd) {
-    bcm2835_gpio_write(TFT_DC_GPIO, LOW);  // Command mode
-    bcm2835_gpio_write(TFT_CS_GPIO, LOW);  // CS low (select)
-    spiWriteByte(cmd);
-    bcm2835_gpio_write(TFT_CS_GPIO, HIGH); // CS high (deselect)
-}
-
-void spi_write_data(const uint8_t* data, int len) {
-    bcm2835_gpio_write(TFT_DC_GPIO, HIGH); // Data mode
-    bcm2835_gpio_write(TFT_CS_GPIO, LOW);  // CS low (select)
-    for (int i = 0; i < len; i++) {
-        spiWriteByte(data[i]);
-    }
-    bcm2835_gpio_write(TFT_CS_GPIO, HIGH); // CS high (deselect)
-}
-
-void spi_write_data_u16(uint16_t data) {
-    uint8_t bytes[2] = {(uint8_t)(data >> 8), (uint8_t)(data & 0xFF)};
-    spi_write_data(bytes, 2);
+    logger.log("%s", message);
 }
 
 void display_error_screen(const char* error_msg) {
@@ -106,59 +50,13 @@ void display_error_screen(const char* error_msg) {
 
     // Note: Backlight is connected to VCC (always on)
 
-    // Thorough hardware reset
-    log_message("Performing hardware reset for error screen");
-    bcm2835_gpio_write(TFT_RST_GPIO, HIGH);
-    bcm2835_delay(10);
-    bcm2835_gpio_write(TFT_RST_GPIO, LOW);
-    bcm2835_delay(50);
-    bcm2835_gpio_write(TFT_RST_GPIO, HIGH);
-    bcm2835_delay(150);
-
-    // Software reset
-    log_message("Performing software reset for error screen");
-    spi_write_command(ST7789_SWRESET);
-    bcm2835_delay(200);
-
-    // Wake up display
-    spi_write_command(ST7789_SLPOUT);
-    bcm2835_delay(120);
-
-    // Configure display
-    spi_write_command(ST7789_MADCTL);
-    uint8_t madctl = 0x60; // 90° rotation
-    spi_write_data(&madctl, 1);
-
-    spi_write_command(ST7789_COLMOD);
-    uint8_t colmod = 0x55;
-    spi_write_data(&colmod, 1);
-
-    spi_write_command(ST7789_NORON);
-    bcm2835_delay(10);
-
-    spi_write_command(ST7789_INVON);
-    bcm2835_delay(10);
-
-    // Turn on display
-    spi_write_command(ST7789_DISPON);
-    bcm2835_delay(120);
+    // Thorough hardware reset, software reset and configuration
+    log_message("Performing full display initialization for error screen");
+    display->initDisplay();
 
     // Fill screen with red (error indicator)
     log_message("Filling error screen with red");
-    spi_write_command(ST7789_CASET);
-    spi_write_data_u16(0);
-    spi_write_data_u16(DISPLAY_WIDTH - 1);
-
-    spi_write_command(ST7789_RASET);
-    spi_write_data_u16(0);
-    spi_write_data_u16(DISPLAY_HEIGHT - 1);
-
-    spi_write_command(ST7789_RAMWR);
-
-    uint16_t red_pixel = COLOR_RED;
-    for (int i = 0; i < DISPLAY_WIDTH * DISPLAY_HEIGHT; i++) {
-        spi_write_data_u16(red_pixel);
-    }
+    display->fillRect(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, COLOR_RED);
 
     log_message("Error screen displayed");
 }
@@ -167,45 +65,155 @@ void reset_display_hardware() {
     log_message("Performing thorough hardware reset");
 
     // Note: Backlight is connected to VCC (always on)
-
-    // Thorough reset sequence
-    bcm2835_gpio_write(TFT_RST_GPIO, HIGH);
-    bcm2835_delay(10);
-    bcm2835_gpio_write(TFT_RST_GPIO, LOW);
-    bcm2835_delay(50);
-    bcm2835_gpio_write(TFT_RST_GPIO, HIGH);
-    bcm2835_delay(200);
+    display->hardwareReset(200);
 
     log_message("Hardware reset complete");
 }
 
 void cleanup_gpio() {
     log_message("Cleaning up GPIO");
-    bcm2835_close();
+    display->powerDown();
+}
+
+// Pick the same transport as the child so the error screen reaches the
+// panel over the wiring the clock uses (e.g. "./failsafe ./clock --hw-spi")
+TransportConfig transport_config_from_child(int argc, char* argv[]) {
+    TransportConfig config;
+    for (int i = 2; i < argc; i++) {
+        parseTransportOption(argc, argv, i, config);
+    }
+    return config;
+}
+
+// Real-time options on the child's command line. Failsafe itself keeps
+// normal scheduling.
+RealtimeConfig realtime_config_from_child(int argc, char* argv[]) {
+    RealtimeConfig config;
+    for (int i = 2; i < argc; i++) {
+        parseRealtimeOption(argc, argv, i, config);
+    }
+    return config;
+}
+
+// In a forked child: SCHED_FIFO survives exec, so the clock runs real-time
+// from its first instruction, panel reset included
+void exec_child_realtime() {
+    if (!applyRealtimePolicy(child_realtime)) {
+        log_message("WARNING: child starts without real-time scheduling");
+    }
+}
+
+// The child was asked to warm start, i.e. to reuse a panel left configured
+bool child_warm_starts(int argc, char* argv[]) {
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--warm") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The child understands --standby, so the next one can be started ahead
+// of time (e.g. "./failsafe ./clock --standby --warm")
+bool child_has_standby(int argc, char* argv[]) {
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--standby") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Delay before restart number restart_count within the window
+unsigned int restart_backoff_ms(int restart_count) {
+    if (restart_count <= 1) {
+        return 0;
+    }
+    unsigned int delay = RESTART_BACKOFF_MS;
+    for (int i = 2; i < restart_count && delay < RESTART_BACKOFF_MAX_MS; i++) {
+        delay *= 2;
+    }
+    return delay < RESTART_BACKOFF_MAX_MS ? delay : RESTART_BACKOFF_MAX_MS;
 }
 
-bool check_bcm2835_available() {
-    // Try to initialize bcm2835 library
-    if (!bcm2835_init()) {
+// Fork the next child as a hot standby. child_argv has "--standby" followed
+// by fd_arg, which is filled in here with the read end of a fresh pipe. The
+// child execs, sets up everything but the panel and waits.
+bool spawn_standby(std::vector<char*>& child_argv, char* fd_arg, size_t fd_arg_size) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        log_message("ERROR: pipe failed");
+        return false;
+    }
+    snprintf(fd_arg, fd_arg_size, "%d", fds[0]);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Only the read end survives the exec
+        fcntl(fds[0], F_SETFD, 0);
+        signal(SIGPIPE, SIG_DFL);
+        exec_child_realtime();
+        execvp(child_argv[0], child_argv.data());
+        log_message("ERROR: Failed to execute standby program");
+        _exit(1);
+    }
+    close(fds[0]);
+    if (pid < 0) {
+        close(fds[1]);
+        log_message("ERROR: fork failed");
         return false;
     }
+    standby_pid = pid;
+    standby_fd = fds[1];
     return true;
 }
 
-void setup_gpio() {
-    log_message("Setting up GPIO pins for Software SPI");
+// Reap a standby that exited while waiting, so a fresh one is started
+void check_standby() {
+    if (standby_pid > 0 && waitpid(standby_pid, nullptr, WNOHANG) == standby_pid) {
+        log_message("Standby child exited while waiting");
+        close(standby_fd);
+        standby_pid = 0;
+        standby_fd = -1;
+    }
+}
 
-    bcm2835_gpio_fsel(TFT_CS_GPIO, BCM2835_GPIO_FSEL_OUTP);
-    bcm2835_gpio_fsel(TFT_DC_GPIO, BCM2835_GPIO_FSEL_OUTP);
-    bcm2835_gpio_fsel(TFT_RST_GPIO, BCM2835_GPIO_FSEL_OUTP);
-    bcm2835_gpio_fsel(TFT_SDATA_GPIO, BCM2835_GPIO_FSEL_OUTP);
-    bcm2835_gpio_fsel(TFT_SCLK_GPIO, BCM2835_GPIO_FSEL_OUTP);
+// Promote the standby to the running child. If it died in the meantime
+// the write fails and waitpid() reports its exit like any other crash.
+void start_standby(bool warm) {
+    char command = warm ? STANDBY_START_WARM : STANDBY_START_COLD;
+    if (write(standby_fd, &command, 1) != 1) {
+        log_message("ERROR: standby child did not take the start command");
+    }
+    close(standby_fd);
+    child_pid = standby_pid;
+    standby_pid = 0;
+    standby_fd = -1;
+}
 
-    bcm2835_gpio_write(TFT_CS_GPIO, HIGH);
-    bcm2835_gpio_write(TFT_SCLK_GPIO, LOW);
-    bcm2835_gpio_write(TFT_SDATA_GPIO, LOW);
+void stop_standby() {
+    if (standby_pid > 0) {
+        // End of file on its pipe: the standby exits without touching the panel
+        close(standby_fd);
+        waitpid(standby_pid, nullptr, 0);
+        standby_pid = 0;
+        standby_fd = -1;
+    }
+}
+
+bool setup_gpio(const TransportConfig& config) {
+    log_message(config.hardwareSPI ? "Setting up GPIO pins for Hardware SPI"
+                                   : "Setting up GPIO pins for Software SPI");
+
+    transport = createTransport(config);
+    display = new ST7789_Driver(*transport);
+    display->setStateFile(ST7789_STATE_FILE);  // A reset here must stop the child warm starting
+    if (!display->setupGPIO()) {
+        return false;
+    }
 
     log_message("GPIO setup complete");
+    return true;
 }
 
 int main(int argc, char* argv[]) {
@@ -215,98 +223,165 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    logger.open("/tmp/clock_failsafe.log");
+    logger.installCrashHandler();
     log_message("========== Failsafe Monitor Started ==========");
 
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
 
-    // Check if bcm2835 library is available
-    if (!check_bcm2835_available()) {
+    // Initialize bcm2835 library and setup GPIO
+    if (!setup_gpio(transport_config_from_child(argc, argv))) {
         log_message("ERROR: bcm2835 library initialization failed");
         log_message("Are you running as root? Try: sudo ./failsafe");
         return 1;
     }
 
-    // Setup GPIO
-    setup_gpio();
+    child_realtime = realtime_config_from_child(argc, argv);
 
     int restart_count = 0;
     const int max_restarts = 10;
     const int restart_window = 60; // seconds
+    const int warm_restarts = 2;   // Crashes per window that may keep the panel as it is
+    const bool standby = child_has_standby(argc, argv);
+    const bool child_warm = child_warm_starts(argc, argv);
+    bool warm = child_warm;
     time_t first_restart_time = 0;
 
+    // Child command line for standby starts: "--standby" gains the pipe fd
+    char standby_fd_arg[16] = "";
+    std::vector<char*> child_argv;
+    for (int i = 1; i < argc; i++) {
+        child_argv.push_back(argv[i]);
+        if (i > 1 && strcmp(argv[i], "--standby") == 0) {
+            child_argv.push_back(standby_fd_arg);
+        }
+    }
+    child_argv.push_back(nullptr);
+
+    // A standby that died before its start command must not make the
+    // write to its pipe fatal
+    if (standby) {
+        signal(SIGPIPE, SIG_IGN);
+    }
+
     while (running) {
-        log_message("Starting child process");
-
-        child_pid = fork();
-
-        if (child_pid == 0) {
-            // Child process - execute the target program
-            execvp(argv[1], &argv[1]);
-            // If execvp returns, there was an error
-            log_message("ERROR: Failed to execute program");
-            exit(1);
-        } else if (child_pid > 0) {
-            // Parent process - monitor child
-            int status;
-            pid_t result = waitpid(child_pid, &status, 0);
-
-            if (!running) {
-                log_message("Shutdown requested");
+        if (standby) {
+            check_standby();
+            if (standby_pid == 0 && !spawn_standby(child_argv, standby_fd_arg, sizeof(standby_fd_arg))) {
                 break;
             }
+            log_message(warm ? "Starting standby child (warm)" : "Starting standby child (cold)");
+            start_standby(warm);
 
-            if (result == -1) {
-                log_message("ERROR: waitpid failed");
+            // The next one sets up while this one runs
+            spawn_standby(child_argv, standby_fd_arg, sizeof(standby_fd_arg));
+        } else {
+            log_message("Starting child process");
+
+            child_pid = fork();
+
+            if (child_pid == 0) {
+                // Child process - execute the target program
+                exec_child_realtime();
+                execvp(argv[1], &argv[1]);
+                // If execvp returns, there was an error
+                // No writer thread in the child: the logger writes directly,
+                // and _exit() skips the parent's static destructors
+                log_message("ERROR: Failed to execute program");
+                _exit(1);
+            } else if (child_pid < 0) {
+                log_message("ERROR: fork failed");
                 break;
             }
+        }
 
-            // Check exit status
-            if (WIFEXITED(status)) {
-                int exit_code = WEXITSTATUS(status);
-                char msg[128];
-                snprintf(msg, sizeof(msg), "Child exited with code %d", exit_code);
-                log_message(msg);
-
-                if (exit_code == 0) {
-                    log_message("Clean exit, shutting down");
-                    break;
-                }
-            } else if (WIFSIGNALED(status)) {
-                int signal = WTERMSIG(status);
-                char msg[128];
-                snprintf(msg, sizeof(msg), "Child killed by signal %d", signal);
-                log_message(msg);
-            }
+        // Monitor child
+        int status;
+        pid_t result = waitpid(child_pid, &status, 0);
 
-            // Track restart rate
-            time_t now = time(nullptr);
-            if (first_restart_time == 0 || (now - first_restart_time) > restart_window) {
-                first_restart_time = now;
-                restart_count = 0;
-            }
+        if (!running) {
+            log_message("Shutdown requested");
+            break;
+        }
 
-            restart_count++;
+        if (result == -1) {
+            log_message("ERROR: waitpid failed");
+            break;
+        }
 
-            if (restart_count > max_restarts) {
-                log_message("ERROR: Too many restarts in short period. Giving up.");
-                display_error_screen("Too many crashes");
-                sleep(10);
+        // Check exit status
+        bool display_error = false;
+        if (WIFEXITED(status)) {
+            int exit_code = WEXITSTATUS(status);
+            char msg[128];
+            snprintf(msg, sizeof(msg), "Child exited with code %d", exit_code);
+            log_message(msg);
+
+            if (exit_code == 0) {
+                log_message("Clean exit, shutting down");
                 break;
             }
+            display_error = exit_code == EXIT_DISPLAY_ERROR;
+        } else if (WIFSIGNALED(status)) {
+            int signal = WTERMSIG(status);
+            char msg[128];
+            snprintf(msg, sizeof(msg), "Child killed by signal %d", signal);
+            log_message(msg);
+        }
 
-            log_message("Attempting recovery...");
-            reset_display_hardware();
-            sleep(2);
+        // Track restart rate
+        time_t now = time(nullptr);
+        if (first_restart_time == 0 || (now - first_restart_time) > restart_window) {
+            first_restart_time = now;
+            restart_count = 0;
+        }
 
-        } else {
-            log_message("ERROR: fork failed");
+        restart_count++;
+
+        if (restart_count > max_restarts) {
+            log_message("ERROR: Too many restarts in short period. Giving up.");
+            stop_standby();
+            display_error_screen("Too many crashes");
+            sleep(10);
             break;
         }
+
+        // A crash that left the panel configured (state file still there)
+        // keeps it as it is; a display error, a panel that never came up
+        // or repeated crashes in the window get the full reset
+        if (!display_error && restart_count <= warm_restarts
+            && st7789_state_valid(ST7789_STATE_FILE)) {
+            log_message(standby || child_warm ? "Panel still configured: restarting warm"
+                                              : "Panel still configured: skipping the reset");
+            warm = true;
+        } else {
+            log_message("Attempting recovery...");
+            warm = false;
+            if (standby) {
+                // The cold start resets the panel itself; just make sure the
+                // state file is gone
+                st7789_state_remove(ST7789_STATE_FILE);
+            } else {
+                reset_display_hardware();
+            }
+        }
+
+        unsigned int backoff = restart_backoff_ms(restart_count);
+        if (backoff > 0) {
+            char msg[128];
+            snprintf(msg, sizeof(msg), "Restarting in %u ms", backoff);
+            log_message(msg);
+            usleep(backoff * 1000);
+        }
     }
 
+    stop_standby();
     cleanup_gpio();
+    delete display;
+    delete transport;
     log_message("========== Failsafe Monitor Stopped ==========");
+    logger.close();
 
     return 0;
 }
@@ -0,0 +1,16 @@
+// Protocol between failsafe and the clock it supervises
+
+#ifndef FAILSAFE_H
+#define FAILSAFE_H
+
+// Hot standby: failsafe starts the next clock ahead of time with
+// "--standby FD". It sets up everything except the panel, then blocks
+// reading FD until failsafe sends one of these bytes (end of file: exit).
+#define STANDBY_START_WARM 'w'  // Resume the panel if it is still configured
+#define STANDBY_START_COLD 'c'  // Full reset and initialisation
+
+// Clock exit code for a GPIO or panel failure. Failsafe resets the panel
+// before the next start; any other crash leaves a configured panel as it is.
+#define EXIT_DISPLAY_ERROR 3
+
+#endif // FAILSAFE_H
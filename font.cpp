@@ -0,0 +1,182 @@
+// Baked anti-aliased fonts for the ST7789 display library
+
+#include "font.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(FontFileHeader) == 16, "font file layout");
+static_assert(sizeof(FontSizeRecord) == 20, "font file layout");
+static_assert(sizeof(FontGlyph) == 16, "font file layout");
+static_assert(sizeof(FontKerning) == 4, "font file layout");
+
+// ---------------------------------------------------------------------------
+// FontFace
+// ---------------------------------------------------------------------------
+
+FontFace::FontFace() : _base(nullptr), _size(nullptr), _glyphs(nullptr), _kerning(nullptr) {}
+
+const FontGlyph* FontFace::glyph(char c) const {
+    unsigned char u = (unsigned char)c;
+    if (u < FONT_FIRST_CHAR || u > FONT_LAST_CHAR) {
+        return nullptr;
+    }
+    return &_glyphs[u - FONT_FIRST_CHAR];
+}
+
+int FontFace::kerning(char left, char right) const {
+    uint16_t key = ((unsigned char)left << 8) | (unsigned char)right;
+    int lo = 0;
+    int hi = (int)_size->kerningCount - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        uint16_t pair = (_kerning[mid].left << 8) | _kerning[mid].right;
+        if (pair == key) {
+            return _kerning[mid].adjust;
+        }
+        if (pair < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return 0;
+}
+
+int FontFace::advance(char c, char next) const {
+    const FontGlyph* g = glyph(c);
+    if (!g) {
+        // Unknown characters take the width of a space
+        g = glyph(' ');
+    }
+    return g->advance + (next ? kerning(c, next) : 0);
+}
+
+int FontFace::textWidth(const char* text) const {
+    int w = 0;
+    for (int i = 0; text[i] != '\0'; i++) {
+        w += advance(text[i], text[i + 1]);
+    }
+    return w;
+}
+
+// ---------------------------------------------------------------------------
+// FontFile
+// ---------------------------------------------------------------------------
+
+FontFile::FontFile() : _data(nullptr), _bytes(0), _count(0) {}
+
+FontFile::~FontFile() {
+    close();
+}
+
+bool FontFile::load(const char* path) {
+    close();
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Error: cannot open font " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(FontFileHeader)) {
+        std::cerr << "Error: " << path << " is not a font file" << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        std::cerr << "Error: cannot map font " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    _data = static_cast<const uint8_t*>(data);
+    _bytes = st.st_size;
+
+    if (!validate(path)) {
+        close();
+        return false;
+    }
+
+    const FontFileHeader* header = reinterpret_cast<const FontFileHeader*>(_data);
+    const FontSizeRecord* sizes = reinterpret_cast<const FontSizeRecord*>(header + 1);
+    _count = header->sizeCount;
+    for (int i = 0; i < _count; i++) {
+        FontFace& face = _faces[i];
+        face._base = _data;
+        face._size = &sizes[i];
+        face._glyphs = reinterpret_cast<const FontGlyph*>(_data + sizes[i].glyphsOffset);
+        face._kerning = reinterpret_cast<const FontKerning*>(_data + sizes[i].kerningOffset);
+    }
+    return true;
+}
+
+void FontFile::close() {
+    if (_data) {
+        munmap(const_cast<uint8_t*>(_data), _bytes);
+    }
+    _data = nullptr;
+    _bytes = 0;
+    _count = 0;
+}
+
+// Check every table and bitmap lies inside the file, so drawing can index
+// the mapping without bounds checks
+bool FontFile::validate(const char* path) const {
+    const FontFileHeader* header = reinterpret_cast<const FontFileHeader*>(_data);
+    const char* problem = nullptr;
+    if (header->magic != FONT_MAGIC) {
+        problem = "not a font file";
+    } else if (header->version != FONT_VERSION) {
+        problem = "unsupported font file version";
+    } else if (header->fileBytes != _bytes) {
+        problem = "truncated font file";
+    } else if (header->sizeCount < 1 || header->sizeCount > FONT_MAX_SIZES ||
+               sizeof(FontFileHeader) + header->sizeCount * sizeof(FontSizeRecord) > _bytes) {
+        problem = "bad size table";
+    }
+
+    const FontSizeRecord* sizes = reinterpret_cast<const FontSizeRecord*>(header + 1);
+    for (uint32_t s = 0; !problem && s < header->sizeCount; s++) {
+        const FontSizeRecord& size = sizes[s];
+        if (size.glyphsOffset % 4 != 0 || size.kerningOffset % 4 != 0 ||
+            size.glyphsOffset + (uint64_t)FONT_GLYPHS * sizeof(FontGlyph) > _bytes ||
+            size.kerningOffset + (uint64_t)size.kerningCount * sizeof(FontKerning) > _bytes) {
+            problem = "bad glyph or kerning table";
+            break;
+        }
+        const FontGlyph* glyphs = reinterpret_cast<const FontGlyph*>(_data + size.glyphsOffset);
+        for (int g = 0; g < FONT_GLYPHS; g++) {
+            uint64_t bytes = (uint64_t)(glyphs[g].width + 1) / 2 * glyphs[g].height;
+            if (glyphs[g].bitmapOffset + bytes > _bytes) {
+                problem = "glyph bitmap outside the file";
+                break;
+            }
+        }
+    }
+
+    if (problem) {
+        std::cerr << "Error: " << path << ": " << problem << std::endl;
+        return false;
+    }
+    return true;
+}
+
+const FontFace* FontFile::face(int pixelSize) const {
+    const FontFace* best = nullptr;
+    int best_distance = 0;
+    for (int i = 0; i < _count; i++) {
+        int distance = abs(_faces[i].pixelSize() - pixelSize);
+        if (!best || distance < best_distance) {
+            best = &_faces[i];
+            best_distance = distance;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,121 @@
+// Baked anti-aliased fonts for the ST7789 display library
+// A font file holds one or more pixel sizes of printable ASCII, rasterised
+// offline (font_bake) to 4-bit coverage, plus each size's kerning pairs.
+// The file is mapped read-only and used in place: no parsing, no
+// allocation, and every process drawing text shares the pages.
+
+#ifndef FONT_H
+#define FONT_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define FONT_MAGIC 0x544E4F46u  // "FONT"
+#define FONT_VERSION 1
+#define FONT_FIRST_CHAR 32      // ' '
+#define FONT_LAST_CHAR 126      // '~'
+#define FONT_GLYPHS (FONT_LAST_CHAR - FONT_FIRST_CHAR + 1)
+#define FONT_MAX_SIZES 8
+
+// On-disk layout, little-endian, every offset from the start of the file
+// and 4-byte aligned:
+//   FontFileHeader
+//   FontSizeRecord[sizeCount]
+//   per size: FontGlyph[FONT_GLYPHS], FontKerning[kerningCount]
+//   glyph bitmaps: 4 bits per pixel, high nibble first, rows padded to
+//   whole bytes, 0 = background and 15 = full coverage
+struct FontFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sizeCount;
+    uint32_t fileBytes;
+};
+
+struct FontSizeRecord {
+    uint16_t pixelSize;   // Em height the size was baked at
+    int16_t ascent;       // Baseline, from the top of the line
+    int16_t lineHeight;   // Ascent plus descent
+    uint16_t reserved;
+    uint32_t glyphsOffset;
+    uint32_t kerningOffset;
+    uint32_t kerningCount;
+};
+
+struct FontGlyph {
+    uint16_t width;        // Bitmap size; 0 x 0 for blank glyphs
+    uint16_t height;
+    int16_t left;          // Bitmap origin relative to the pen position
+    int16_t top;           // Rows above the baseline
+    int16_t advance;       // Pen movement to the next character
+    uint16_t reserved;
+    uint32_t bitmapOffset;
+};
+
+// Pen adjustment between two characters; sorted by (left, right)
+struct FontKerning {
+    uint8_t left;
+    uint8_t right;
+    int16_t adjust;
+};
+
+// One baked size; a view into the mapped file
+class FontFace {
+public:
+    FontFace();
+
+    int pixelSize() const { return _size->pixelSize; }
+    int ascent() const { return _size->ascent; }
+    int lineHeight() const { return _size->lineHeight; }
+
+    // Glyph of c, or nullptr for characters outside printable ASCII
+    const FontGlyph* glyph(char c) const;
+
+    // 4-bit coverage rows of a glyph, (width + 1) / 2 bytes each
+    const uint8_t* bitmap(const FontGlyph* glyph) const { return _base + glyph->bitmapOffset; }
+
+    // Kerning between two characters (0 if the pair has none)
+    int kerning(char left, char right) const;
+
+    // Pen movement from c to next, kerning included; next may be '\0'
+    int advance(char c, char next) const;
+
+    // Pixels text takes
+    int textWidth(const char* text) const;
+
+private:
+    friend class FontFile;
+
+    const uint8_t* _base;
+    const FontSizeRecord* _size;
+    const FontGlyph* _glyphs;
+    const FontKerning* _kerning;
+};
+
+class FontFile {
+public:
+    FontFile();
+    ~FontFile();
+
+    // Map and validate a file written by font_bake. Returns false (with a
+    // message on stderr) if it cannot be read or is malformed.
+    bool load(const char* path);
+    void close();
+
+    int sizeCount() const { return _count; }
+
+    // The baked size closest to pixelSize, nullptr if nothing is loaded
+    const FontFace* face(int pixelSize) const;
+
+private:
+    const uint8_t* _data;
+    size_t _bytes;
+    FontFace _faces[FONT_MAX_SIZES];
+    int _count;
+
+    bool validate(const char* path) const;
+
+    FontFile(const FontFile&);
+    FontFile& operator=(const FontFile&);
+};
+
+#endif // FONT_H
@@ -0,0 +1,171 @@
+// Offline font baker for the ST7789 display library
+// Rasterises printable ASCII of a TrueType/OpenType font at one or more
+// pixel sizes with FreeType and writes the mmap-able 4-bit atlas file
+// read by FontFile (font.h). Runs on the build machine, not on the Pi.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "font.h"
+
+#define BAKE_MAX_PIXELS 240  // Display height
+
+static void align4(std::vector<uint8_t>& out) {
+    while (out.size() % 4 != 0) {
+        out.push_back(0);
+    }
+}
+
+template <class T>
+static T* at(std::vector<uint8_t>& out, size_t offset) {
+    return reinterpret_cast<T*>(&out[offset]);
+}
+
+// 26.6 fixed point to whole pixels, rounded
+static int round_26_6(long value) {
+    return (int)((value + (value >= 0 ? 32 : -32)) / 64);
+}
+
+// Bake one size: glyph table and kerning pairs at the end of out, bitmaps
+// appended after them. Fills in record.
+static bool bake_size(FT_Face face, int pixel_size, std::vector<uint8_t>& out, size_t record) {
+    if (FT_Set_Pixel_Sizes(face, 0, pixel_size) != 0) {
+        std::cerr << "Error: cannot scale the font to " << pixel_size << " px" << std::endl;
+        return false;
+    }
+
+    int ascent = round_26_6(face->size->metrics.ascender);
+    int descent = -round_26_6(face->size->metrics.descender);
+    at<FontSizeRecord>(out, record)->pixelSize = pixel_size;
+    at<FontSizeRecord>(out, record)->ascent = ascent;
+    at<FontSizeRecord>(out, record)->lineHeight = ascent + descent;
+
+    size_t glyphs = out.size();
+    at<FontSizeRecord>(out, record)->glyphsOffset = glyphs;
+    out.resize(out.size() + FONT_GLYPHS * sizeof(FontGlyph));
+
+    // Kerning pairs, already in (left, right) order
+    size_t kerning = out.size();
+    uint32_t pairs = 0;
+    if (FT_HAS_KERNING(face)) {
+        for (int left = FONT_FIRST_CHAR; left <= FONT_LAST_CHAR; left++) {
+            FT_UInt left_index = FT_Get_Char_Index(face, left);
+            for (int right = FONT_FIRST_CHAR; right <= FONT_LAST_CHAR; right++) {
+                FT_Vector delta;
+                FT_UInt right_index = FT_Get_Char_Index(face, right);
+                if (FT_Get_Kerning(face, left_index, right_index, FT_KERNING_DEFAULT, &delta) != 0) {
+                    continue;
+                }
+                int adjust = round_26_6(delta.x);
+                if (adjust == 0) {
+                    continue;
+                }
+                out.resize(out.size() + sizeof(FontKerning));
+                FontKerning* pair = at<FontKerning>(out, out.size() - sizeof(FontKerning));
+                pair->left = left;
+                pair->right = right;
+                pair->adjust = adjust;
+                pairs++;
+            }
+        }
+    }
+    at<FontSizeRecord>(out, record)->kerningOffset = kerning;
+    at<FontSizeRecord>(out, record)->kerningCount = pairs;
+
+    for (int c = FONT_FIRST_CHAR; c <= FONT_LAST_CHAR; c++) {
+        if (FT_Load_Char(face, c, FT_LOAD_RENDER | FT_LOAD_TARGET_NORMAL) != 0) {
+            std::cerr << "Warning: no glyph for '" << (char)c << "', left blank" << std::endl;
+            continue;
+        }
+        const FT_GlyphSlot slot = face->glyph;
+        const FT_Bitmap& bitmap = slot->bitmap;
+
+        align4(out);
+        size_t offset = out.size();
+        int row_bytes = (bitmap.width + 1) / 2;
+        out.resize(out.size() + row_bytes * bitmap.rows, 0);
+        for (unsigned int y = 0; y < bitmap.rows; y++) {
+            const uint8_t* src = bitmap.buffer + y * bitmap.pitch;
+            uint8_t* dst = &out[offset + y * row_bytes];
+            for (unsigned int x = 0; x < bitmap.width; x++) {
+                // 8-bit grey to 4-bit coverage
+                uint8_t alpha = (src[x] * 15 + 127) / 255;
+                dst[x / 2] |= x % 2 == 0 ? alpha << 4 : alpha;
+            }
+        }
+
+        FontGlyph* glyph = at<FontGlyph>(out, glyphs + (c - FONT_FIRST_CHAR) * sizeof(FontGlyph));
+        glyph->width = bitmap.width;
+        glyph->height = bitmap.rows;
+        glyph->left = slot->bitmap_left;
+        glyph->top = slot->bitmap_top;
+        glyph->advance = round_26_6(slot->advance.x);
+        glyph->bitmapOffset = offset;
+    }
+    align4(out);
+
+    std::cout << "  " << pixel_size << " px: line " << ascent + descent << ", "
+              << pairs << " kerning pairs" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " <font.ttf> <output.font> <pixels> [pixels...]" << std::endl;
+        std::cerr << "Example: " << argv[0]
+                  << " /usr/share/fonts/truetype/dejavu/DejaVuSans.ttf clock.font 21 56" << std::endl;
+        return 1;
+    }
+    int size_count = argc - 3;
+    if (size_count > FONT_MAX_SIZES) {
+        std::cerr << "Error: at most " << FONT_MAX_SIZES << " sizes per file" << std::endl;
+        return 1;
+    }
+
+    FT_Library library;
+    FT_Face face;
+    if (FT_Init_FreeType(&library) != 0 || FT_New_Face(library, argv[1], 0, &face) != 0) {
+        std::cerr << "Error: cannot load font " << argv[1] << std::endl;
+        return 1;
+    }
+    std::cout << "Baking " << face->family_name << " " << face->style_name << std::endl;
+
+    std::vector<uint8_t> out(sizeof(FontFileHeader) + size_count * sizeof(FontSizeRecord), 0);
+    align4(out);
+    for (int i = 0; i < size_count; i++) {
+        int pixel_size = atoi(argv[3 + i]);
+        if (pixel_size < 4 || pixel_size > BAKE_MAX_PIXELS) {
+            std::cerr << "Error: size " << argv[3 + i] << " out of range" << std::endl;
+            return 1;
+        }
+        size_t record = sizeof(FontFileHeader) + i * sizeof(FontSizeRecord);
+        if (!bake_size(face, pixel_size, out, record)) {
+            return 1;
+        }
+    }
+
+    FontFileHeader* header = at<FontFileHeader>(out, 0);
+    header->magic = FONT_MAGIC;
+    header->version = FONT_VERSION;
+    header->sizeCount = size_count;
+    header->fileBytes = out.size();
+
+    FILE* file = fopen(argv[2], "wb");
+    if (!file || fwrite(out.data(), 1, out.size(), file) != out.size()) {
+        std::cerr << "Error: cannot write " << argv[2] << std::endl;
+        return 1;
+    }
+    fclose(file);
+    std::cout << "Wrote " << argv[2] << " (" << out.size() << " bytes)" << std::endl;
+
+    FT_Done_Face(face);
+    FT_Done_FreeType(library);
+    return 0;
+}
@@ -0,0 +1,1023 @@
+// Framebuffer drawing for the ST7789 display library
+
+#include "gfx.h"
+
+#include <cstring>
+
+#include "pixel_ops.h"
+
+uint16_t* framebuffer = nullptr;
+bool framebuffer_wire_order = false;
+IndexedFramebuffer* indexed_framebuffer = nullptr;
+
+GlyphCache glyph_cache;
+
+// ---------------------------------------------------------------------------
+// DamageTracker
+// ---------------------------------------------------------------------------
+
+int add_dirty_rect(DirtyRect* rects, int count, int max_rects, int x, int y, int w, int h) {
+    int x0 = x < 0 ? 0 : x;
+    int x1 = x + w < DISPLAY_WIDTH ? x + w : DISPLAY_WIDTH;
+    int y0 = y < 0 ? 0 : y;
+    int y1 = y + h < DISPLAY_HEIGHT ? y + h : DISPLAY_HEIGHT;
+    if (x0 >= x1 || y0 >= y1) {
+        return count;
+    }
+
+    if (count < max_rects) {
+        rects[count].x = x0;
+        rects[count].y = y0;
+        rects[count].w = x1 - x0;
+        rects[count].h = y1 - y0;
+        return count + 1;
+    }
+
+    // Out of slots: grow the last rect to the bounding box of both
+    DirtyRect& last = rects[count - 1];
+    int lx1 = last.x + last.w;
+    int ly1 = last.y + last.h;
+    if (x0 > last.x) x0 = last.x;
+    if (y0 > last.y) y0 = last.y;
+    if (x1 < lx1) x1 = lx1;
+    if (y1 < ly1) y1 = ly1;
+    last.x = x0;
+    last.y = y0;
+    last.w = x1 - x0;
+    last.h = y1 - y0;
+    return count;
+}
+
+DamageTracker::DamageTracker() : _valid(false) {}
+
+bool DamageTracker::rowDirty(const uint16_t* fb, int row, int x0, int x1) const {
+    int offset = row * DISPLAY_WIDTH + x0;
+    return memcmp(fb + offset, _shadow + offset, (x1 - x0 + 1) * sizeof(uint16_t)) != 0;
+}
+
+bool DamageTracker::columnDirty(const uint16_t* fb, int col, int y0, int y1) const {
+    for (int row = y0; row <= y1; row++) {
+        int offset = row * DISPLAY_WIDTH + col;
+        if (fb[offset] != _shadow[offset]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Split a band of consecutive dirty rows into column runs, trimming each
+// run to the rows that actually changed.
+int DamageTracker::splitBand(const uint16_t* fb, int y0, int y1, int x0, int x1,
+                             DirtyRect* rects, int max_rects) const {
+    int count = 0;
+    int col = x0;
+    while (col <= x1) {
+        if (!columnDirty(fb, col, y0, y1)) {
+            col++;
+            continue;
+        }
+
+        // Extend the run until DAMAGE_MERGE_GAP clean columns in a row
+        int run_start = col;
+        int run_end = col;
+        int gap = 0;
+        for (col = col + 1; col <= x1 && gap <= DAMAGE_MERGE_GAP; col++) {
+            if (columnDirty(fb, col, y0, y1)) {
+                run_end = col;
+                gap = 0;
+            } else {
+                gap++;
+            }
+        }
+        col = run_end + 1;
+
+        if (count == max_rects) {
+            // Out of slots: fold the rest of the band into the last rect
+            DirtyRect& last = rects[count - 1];
+            last.y = y0;
+            last.w = x1 - last.x + 1;
+            last.h = y1 - y0 + 1;
+            return count;
+        }
+
+        int top = y0;
+        while (!rowDirty(fb, top, run_start, run_end)) top++;
+        int bottom = y1;
+        while (!rowDirty(fb, bottom, run_start, run_end)) bottom--;
+
+        rects[count].x = run_start;
+        rects[count].y = top;
+        rects[count].w = run_end - run_start + 1;
+        rects[count].h = bottom - top + 1;
+        count++;
+    }
+    return count;
+}
+
+void DamageTracker::invalidate() {
+    _valid = false;
+}
+
+void DamageTracker::assumeFilled(uint16_t color) {
+    fill_pixels(_shadow, color, DISPLAY_WIDTH * DISPLAY_HEIGHT);
+    _valid = true;
+}
+
+int DamageTracker::collect(const uint16_t* fb, DirtyRect* rects, int max_rects) const {
+    if (!_valid) {
+        rects[0].x = 0;
+        rects[0].y = 0;
+        rects[0].w = DISPLAY_WIDTH;
+        rects[0].h = DISPLAY_HEIGHT;
+        return 1;
+    }
+
+    int count = 0;
+    int row = 0;
+    while (row < DISPLAY_HEIGHT && count < max_rects) {
+        if (!rowDirty(fb, row, 0, DISPLAY_WIDTH - 1)) {
+            row++;
+            continue;
+        }
+
+        // Grow a band of consecutive dirty rows, tracking its column extent
+        int band_start = row;
+        int min_x = DISPLAY_WIDTH;
+        int max_x = -1;
+        for (; row < DISPLAY_HEIGHT; row++) {
+            const uint16_t* line = fb + row * DISPLAY_WIDTH;
+            const uint16_t* prev = _shadow + row * DISPLAY_WIDTH;
+            int first = 0;
+            while (first < DISPLAY_WIDTH && line[first] == prev[first]) first++;
+            if (first == DISPLAY_WIDTH) break;
+            int last = DISPLAY_WIDTH - 1;
+            while (line[last] == prev[last]) last--;
+            if (first < min_x) min_x = first;
+            if (last > max_x) max_x = last;
+        }
+
+        count += splitBand(fb, band_start, row - 1, min_x, max_x,
+                           rects + count, max_rects - count);
+    }
+
+    if (row < DISPLAY_HEIGHT) {
+        // Out of slots: cover everything below with one full-width window
+        DirtyRect& last = rects[count - 1];
+        last.x = 0;
+        last.w = DISPLAY_WIDTH;
+        last.h = DISPLAY_HEIGHT - last.y;
+    }
+    return count;
+}
+
+int DamageTracker::collectWithin(const uint16_t* fb, const DirtyRect* hints, int hint_count,
+                                 DirtyRect* rects, int max_rects) const {
+    if (!_valid) {
+        return collect(fb, rects, max_rects);
+    }
+
+    int count = 0;
+    for (int i = 0; i < hint_count; i++) {
+        const DirtyRect& hint = hints[i];
+        int x1 = hint.x + hint.w - 1;
+        if (count == max_rects) {
+            // Out of slots: cover the remaining hints with the last rect
+            count = add_dirty_rect(rects, count, max_rects, hint.x, hint.y, hint.w, hint.h);
+            continue;
+        }
+
+        // Trim the hint to its changed rows, then split it into column runs
+        int top = hint.y;
+        int bottom = hint.y + hint.h - 1;
+        while (top <= bottom && !rowDirty(fb, top, hint.x, x1)) top++;
+        if (top > bottom) {
+            continue;
+        }
+        while (!rowDirty(fb, bottom, hint.x, x1)) bottom--;
+
+        count += splitBand(fb, top, bottom, hint.x, x1, rects + count, max_rects - count);
+    }
+    return count;
+}
+
+void DamageTracker::commit(const uint16_t* fb) {
+    memcpy(_shadow, fb, sizeof(_shadow));
+    _valid = true;
+}
+
+void DamageTracker::commitRects(const uint16_t* fb, const DirtyRect* rects, int count) {
+    if (!_valid) {
+        commit(fb);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        size_t bytes = rects[i].w * sizeof(uint16_t);
+        for (int row = rects[i].y; row < rects[i].y + rects[i].h; row++) {
+            int offset = row * DISPLAY_WIDTH + rects[i].x;
+            memcpy(_shadow + offset, fb + offset, bytes);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// TileTracker
+// ---------------------------------------------------------------------------
+
+static_assert(DISPLAY_WIDTH % TILE_SIZE == 0 && DISPLAY_HEIGHT % TILE_SIZE == 0,
+              "the display must be a whole number of tiles");
+
+TileTracker::TileTracker() : _valid(false) {
+    memset(_pendingKnown, 0, sizeof(_pendingKnown));
+}
+
+// Hash of a tile of fb, computed at most once per collect/commit
+uint32_t TileTracker::pendingHash(const uint16_t* fb, int tile) {
+    if (!_pendingKnown[tile]) {
+        _pending[tile] = hash_pixel_rect(fb, DISPLAY_WIDTH, tile % TILE_COLS * TILE_SIZE,
+                                         tile / TILE_COLS * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+        _pendingKnown[tile] = true;
+    }
+    return _pending[tile];
+}
+
+// Runs of dirty tiles along each tile row; a run exactly below a window of
+// the row above extends that window instead of opening another
+int TileTracker::coalesce(const bool* dirty, DirtyRect* rects, int max_rects) const {
+    int count = 0;
+    for (int ty = 0; ty < TILE_ROWS; ty++) {
+        int y = ty * TILE_SIZE;
+        int tx = 0;
+        while (tx < TILE_COLS) {
+            if (!dirty[ty * TILE_COLS + tx]) {
+                tx++;
+                continue;
+            }
+            int run_start = tx;
+            while (tx < TILE_COLS && dirty[ty * TILE_COLS + tx]) tx++;
+            int x = run_start * TILE_SIZE;
+            int w = (tx - run_start) * TILE_SIZE;
+
+            bool stacked = false;
+            for (int i = 0; i < count && !stacked; i++) {
+                if (rects[i].x == x && rects[i].w == w && rects[i].y + rects[i].h == y) {
+                    rects[i].h += TILE_SIZE;
+                    stacked = true;
+                }
+            }
+            if (!stacked) {
+                count = add_dirty_rect(rects, count, max_rects, x, y, w, TILE_SIZE);
+            }
+        }
+    }
+    return count;
+}
+
+void TileTracker::invalidate() {
+    _valid = false;
+}
+
+void TileTracker::assumeFilled(uint16_t color) {
+    uint16_t tile[TILE_SIZE * TILE_SIZE];
+    fill_pixels(tile, color, TILE_SIZE * TILE_SIZE);
+    uint32_t hash = hash_pixel_rect(tile, TILE_SIZE, 0, 0, TILE_SIZE, TILE_SIZE);
+    for (int i = 0; i < TILE_ROWS * TILE_COLS; i++) {
+        _hashes[i] = hash;
+    }
+    memset(_pendingKnown, 0, sizeof(_pendingKnown));
+    _valid = true;
+}
+
+int TileTracker::collect(const uint16_t* fb, DirtyRect* rects, int max_rects) {
+    bool dirty[TILE_ROWS * TILE_COLS];
+    for (int i = 0; i < TILE_ROWS * TILE_COLS; i++) {
+        dirty[i] = pendingHash(fb, i) != _hashes[i];
+    }
+    if (!_valid) {
+        rects[0].x = 0;
+        rects[0].y = 0;
+        rects[0].w = DISPLAY_WIDTH;
+        rects[0].h = DISPLAY_HEIGHT;
+        return 1;
+    }
+    return coalesce(dirty, rects, max_rects);
+}
+
+int TileTracker::collectWithin(const uint16_t* fb, const DirtyRect* hints, int hint_count,
+                               DirtyRect* rects, int max_rects) {
+    if (!_valid) {
+        return collect(fb, rects, max_rects);
+    }
+
+    bool dirty[TILE_ROWS * TILE_COLS] = {};
+    for (int i = 0; i < hint_count; i++) {
+        const DirtyRect& hint = hints[i];
+        for (int ty = hint.y / TILE_SIZE; ty <= (hint.y + hint.h - 1) / TILE_SIZE; ty++) {
+            for (int tx = hint.x / TILE_SIZE; tx <= (hint.x + hint.w - 1) / TILE_SIZE; tx++) {
+                int tile = ty * TILE_COLS + tx;
+                dirty[tile] = pendingHash(fb, tile) != _hashes[tile];
+            }
+        }
+    }
+    return coalesce(dirty, rects, max_rects);
+}
+
+void TileTracker::commit(const uint16_t* fb) {
+    for (int i = 0; i < TILE_ROWS * TILE_COLS; i++) {
+        _hashes[i] = pendingHash(fb, i);
+    }
+    memset(_pendingKnown, 0, sizeof(_pendingKnown));
+    _valid = true;
+}
+
+void TileTracker::commitRects(const uint16_t* fb, const DirtyRect* rects, int count) {
+    if (!_valid) {
+        commit(fb);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        const DirtyRect& r = rects[i];
+        for (int ty = r.y / TILE_SIZE; ty <= (r.y + r.h - 1) / TILE_SIZE; ty++) {
+            for (int tx = r.x / TILE_SIZE; tx <= (r.x + r.w - 1) / TILE_SIZE; tx++) {
+                int tile = ty * TILE_COLS + tx;
+                _hashes[tile] = pendingHash(fb, tile);
+            }
+        }
+    }
+    memset(_pendingKnown, 0, sizeof(_pendingKnown));
+}
+
+// ---------------------------------------------------------------------------
+// Glyphs
+// ---------------------------------------------------------------------------
+
+// Simple 5x7 font drawing (digits only): one byte per row, top row first,
+// bit 4 is the leftmost column
+static const uint8_t font_5x7[10][7] = {
+    {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}, // 0
+    {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E}, // 1
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}, // 2
+    {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E}, // 3
+    {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}, // 4
+    {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E}, // 5
+    {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}, // 6
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}, // 7
+    {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}, // 8
+    {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C}  // 9
+};
+
+GlyphCache::GlyphCache() : _used(0), _nextEvict(0) {}
+
+GlyphCache::~GlyphCache() {
+    for (int i = 0; i < _used; i++) {
+        delete[] _slots[i].storage;
+    }
+}
+
+void GlyphCache::fillCell(uint16_t* tile, int width, int col, int row, int scale, uint16_t color) {
+    for (int dy = 0; dy < scale; dy++) {
+        uint16_t* line = tile + (row * scale + dy) * width + col * scale;
+        for (int dx = 0; dx < scale; dx++) {
+            line[dx] = color;
+        }
+    }
+}
+
+void GlyphCache::rasterise(GlyphAtlas& atlas, int scale, uint16_t fg, uint16_t bg) {
+    atlas.scale = scale;
+    atlas.fg = fg;
+    atlas.bg = bg;
+    atlas.height = 7 * scale;
+
+    int total = 0;
+    for (int g = 0; g < GLYPH_COUNT; g++) {
+        atlas.widths[g] = (g == GLYPH_COLON ? 3 : 5) * scale;
+        total += atlas.widths[g] * atlas.height;
+    }
+    atlas.storage = new uint16_t[total];
+
+    uint16_t* tile = atlas.storage;
+    for (int g = 0; g < GLYPH_COUNT; g++) {
+        int width = atlas.widths[g];
+        atlas.tiles[g] = tile;
+        fill_pixels(tile, bg, width * atlas.height);
+
+        if (g == GLYPH_COLON) {
+            // Colon as two dots
+            fillCell(tile, width, 2, 1, scale, fg);
+            fillCell(tile, width, 2, 5, scale, fg);
+        } else if (g == GLYPH_DASH) {
+            for (int col = 0; col < 5; col++) {
+                fillCell(tile, width, col, 3, scale, fg);
+            }
+        } else {
+            for (int row = 0; row < 7; row++) {
+                for (int col = 0; col < 5; col++) {
+                    if (font_5x7[g][row] & (0x10 >> col)) {
+                        fillCell(tile, width, col, row, scale, fg);
+                    }
+                }
+            }
+        }
+        tile += width * atlas.height;
+    }
+}
+
+const GlyphAtlas& GlyphCache::get(int scale, uint16_t fg, uint16_t bg) {
+    for (int i = 0; i < _used; i++) {
+        const GlyphAtlas& atlas = _slots[i];
+        if (atlas.scale == scale && atlas.fg == fg && atlas.bg == bg) {
+            return atlas;
+        }
+    }
+
+    int slot;
+    if (_used < GLYPH_CACHE_SLOTS) {
+        slot = _used++;
+    } else {
+        slot = _nextEvict;
+        _nextEvict = (_nextEvict + 1) % GLYPH_CACHE_SLOTS;
+        delete[] _slots[slot].storage;
+    }
+    rasterise(_slots[slot], scale, fg, bg);
+    return _slots[slot];
+}
+
+// ---------------------------------------------------------------------------
+// IndexedFramebuffer
+// ---------------------------------------------------------------------------
+
+static int color_distance(uint16_t a, uint16_t b) {
+    int dr = (a >> 11) - (b >> 11);
+    int dg = ((a >> 5) & 0x3F) - ((b >> 5) & 0x3F);
+    int db = (a & 0x1F) - (b & 0x1F);
+    return 4 * dr * dr + dg * dg + 4 * db * db;  // Weighted so each channel counts in 6 bits
+}
+
+uint8_t IndexedFramebuffer::indexOf(uint16_t color) {
+    for (int i = 0; i < paletteUsed; i++) {
+        if (palette[i] == color) {
+            return i;
+        }
+    }
+    if (paletteUsed < PALETTE_SIZE) {
+        palette[paletteUsed] = color;
+        return paletteUsed++;
+    }
+
+    int best = 0;
+    for (int i = 1; i < PALETTE_SIZE; i++) {
+        if (color_distance(palette[i], color) < color_distance(palette[best], color)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+void IndexedFramebuffer::push(ST7789_Driver& display) const {
+    display.pushIndexedRect(pixels, palette, DISPLAY_WIDTH, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+}
+
+void IndexedFramebuffer::pushRect(ST7789_Driver& display, int x, int y, int w, int h) const {
+    display.pushIndexedRect(pixels, palette, DISPLAY_WIDTH, x, y, w, h);
+}
+
+// Set pixels [x0, x1) of one indexed row to index
+static void fill_indexed_row(uint8_t* row, int x0, int x1, uint8_t index) {
+    if (x0 & 1) {
+        row[x0 >> 1] = (row[x0 >> 1] & 0xF0) | index;
+        x0++;
+    }
+    if (x1 & 1) {
+        row[x1 >> 1] = (row[x1 >> 1] & 0x0F) | (index << 4);
+        x1--;
+    }
+    if (x1 > x0) {
+        memset(row + (x0 >> 1), index * 0x11, (x1 - x0) >> 1);
+    }
+}
+
+static inline void set_indexed_pixel(uint8_t* row, int x, uint8_t index) {
+    uint8_t& pair = row[x >> 1];
+    pair = (x & 1) ? (pair & 0xF0) | index : (pair & 0x0F) | (index << 4);
+}
+
+// ---------------------------------------------------------------------------
+// Framebuffer drawing
+// ---------------------------------------------------------------------------
+
+void draw_rect(int x, int y, int w, int h, uint16_t color) {
+    int x0 = x < 0 ? 0 : x;
+    int x1 = x + w < DISPLAY_WIDTH ? x + w : DISPLAY_WIDTH;
+    int y0 = y < 0 ? 0 : y;
+    int y1 = y + h < DISPLAY_HEIGHT ? y + h : DISPLAY_HEIGHT;
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    if (indexed_framebuffer) {
+        uint8_t index = indexed_framebuffer->indexOf(color);
+        for (int j = y0; j < y1; j++) {
+            fill_indexed_row(indexed_framebuffer->pixels + j * (DISPLAY_WIDTH / 2), x0, x1, index);
+        }
+        return;
+    }
+
+    if (framebuffer_wire_order) {
+        color = wire_color(color);
+    }
+    fill_pixel_rect(framebuffer, DISPLAY_WIDTH, x0, y0, x1 - x0, y1 - y0, color);
+}
+
+void blit_tile(int x, int y, const uint16_t* tile, int w, int h) {
+    int x0 = x < 0 ? 0 : x;
+    int x1 = x + w > DISPLAY_WIDTH ? DISPLAY_WIDTH : x + w;
+    int y0 = y < 0 ? 0 : y;
+    int y1 = y + h > DISPLAY_HEIGHT ? DISPLAY_HEIGHT : y + h;
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    size_t bytes = (x1 - x0) * sizeof(uint16_t);
+    for (int row = y0; row < y1; row++) {
+        memcpy(&framebuffer[row * DISPLAY_WIDTH + x0], tile + (row - y) * w + (x0 - x), bytes);
+    }
+}
+
+// Two-colour tile into the indexed frame: fg pixels become fg_index and
+// everything else bg_index. Even x writes whole bytes.
+void blit_tile_indexed(int x, int y, const uint16_t* tile, int w, int h,
+                       uint16_t fg, uint8_t fg_index, uint8_t bg_index) {
+    int x0 = x < 0 ? 0 : x;
+    int x1 = x + w > DISPLAY_WIDTH ? DISPLAY_WIDTH : x + w;
+    int y0 = y < 0 ? 0 : y;
+    int y1 = y + h > DISPLAY_HEIGHT ? DISPLAY_HEIGHT : y + h;
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    for (int row = y0; row < y1; row++) {
+        uint8_t* dst = indexed_framebuffer->pixels + row * (DISPLAY_WIDTH / 2);
+        const uint16_t* src = tile + (row - y) * w - x;
+        int col = x0;
+        if (col & 1) {
+            set_indexed_pixel(dst, col, src[col] == fg ? fg_index : bg_index);
+            col++;
+        }
+        for (; col + 1 < x1; col += 2) {
+            uint8_t hi = src[col] == fg ? fg_index : bg_index;
+            uint8_t lo = src[col + 1] == fg ? fg_index : bg_index;
+            dst[col >> 1] = (hi << 4) | lo;
+        }
+        if (col < x1) {
+            set_indexed_pixel(dst, col, src[col] == fg ? fg_index : bg_index);
+        }
+    }
+}
+
+// The atlas draw_char uses for these colours in the current byte order
+static const GlyphAtlas& glyph_atlas(int scale, uint16_t color, uint16_t bg) {
+    if (framebuffer_wire_order && !indexed_framebuffer) {
+        // Tiles rasterised from swapped colours are already in wire order
+        return glyph_cache.get(scale, wire_color(color), wire_color(bg));
+    }
+    return glyph_cache.get(scale, color, bg);
+}
+
+void prepare_glyphs(int scale, uint16_t color, uint16_t bg) {
+    glyph_atlas(scale, color, bg);
+}
+
+void draw_char(int x, int y, char c, uint16_t color, int scale, uint16_t bg) {
+    int glyph;
+    if (c >= '0' && c <= '9') {
+        glyph = c - '0';
+    } else if (c == ':') {
+        glyph = GLYPH_COLON;
+    } else if (c == '-') {
+        glyph = GLYPH_DASH;
+    } else {
+        return;
+    }
+
+    const GlyphAtlas& atlas = glyph_atlas(scale, color, bg);
+    if (indexed_framebuffer) {
+        blit_tile_indexed(x, y, atlas.tiles[glyph], atlas.widths[glyph], atlas.height,
+                          atlas.fg, indexed_framebuffer->indexOf(color),
+                          indexed_framebuffer->indexOf(bg));
+        return;
+    }
+    blit_tile(x, y, atlas.tiles[glyph], atlas.widths[glyph], atlas.height);
+}
+
+void draw_text(int x, int y, const char* text, uint16_t color, int scale, uint16_t bg) {
+    int cursor_x = x;
+    for (int i = 0; text[i] != '\0'; i++) {
+        draw_char(cursor_x, y, text[i], color, scale, bg);
+        cursor_x += (text[i] == ':' ? 4 : 6) * scale;
+    }
+}
+
+int text_width(const char* text, int scale) {
+    int w = 0;
+    for (int i = 0; text[i] != '\0'; i++) {
+        w += (text[i] == ':' ? 4 : 6) * scale;
+    }
+    return w;
+}
+
+int text_ink_width(const char* text, int scale) {
+    // Every glyph cell is followed by one dot of spacing
+    return text[0] == '\0' ? 0 : text_width(text, scale) - scale;
+}
+
+// ---------------------------------------------------------------------------
+// Anti-aliased text
+// ---------------------------------------------------------------------------
+
+// The 16 coverage levels of fg over bg as stored in the framebuffer, and
+// the same for both pixels of a bitmap byte at once
+struct CoverageLut {
+    uint16_t fg, bg;
+    bool wireOrder;
+    uint16_t colors[16];
+    uint16_t pairs[256][2];
+    uint8_t fgIndex;  // indexed_framebuffer: coverage 8 and up is fg
+    uint8_t bgIndex;
+};
+
+static CoverageLut coverage_luts[GLYPH_CACHE_SLOTS];
+static int coverage_luts_used = 0;
+static int coverage_luts_next = 0;
+
+// Table for fg over bg, built on first use; a few colour pairs are kept
+static const CoverageLut& coverage_lut(uint16_t fg, uint16_t bg) {
+    CoverageLut* lut = nullptr;
+    for (int i = 0; i < coverage_luts_used && !lut; i++) {
+        CoverageLut& cached = coverage_luts[i];
+        if (cached.fg == fg && cached.bg == bg && cached.wireOrder == framebuffer_wire_order) {
+            lut = &cached;
+        }
+    }
+    if (!lut) {
+        if (coverage_luts_used < GLYPH_CACHE_SLOTS) {
+            lut = &coverage_luts[coverage_luts_used++];
+        } else {
+            lut = &coverage_luts[coverage_luts_next];
+            coverage_luts_next = (coverage_luts_next + 1) % GLYPH_CACHE_SLOTS;
+        }
+        lut->fg = fg;
+        lut->bg = bg;
+        lut->wireOrder = framebuffer_wire_order;
+
+        int fr = fg >> 11, fgreen = (fg >> 5) & 0x3F, fb = fg & 0x1F;
+        int br = bg >> 11, bgreen = (bg >> 5) & 0x3F, bb = bg & 0x1F;
+        for (int a = 0; a < 16; a++) {
+            int r = (br * (15 - a) + fr * a + 7) / 15;
+            int g = (bgreen * (15 - a) + fgreen * a + 7) / 15;
+            int b = (bb * (15 - a) + fb * a + 7) / 15;
+            uint16_t color = (r << 11) | (g << 5) | b;
+            lut->colors[a] = framebuffer_wire_order ? wire_color(color) : color;
+        }
+        for (int byte = 0; byte < 256; byte++) {
+            lut->pairs[byte][0] = lut->colors[byte >> 4];
+            lut->pairs[byte][1] = lut->colors[byte & 0x0F];
+        }
+    }
+    if (indexed_framebuffer) {
+        // The palette may have changed since the table was built
+        lut->fgIndex = indexed_framebuffer->indexOf(fg);
+        lut->bgIndex = indexed_framebuffer->indexOf(bg);
+    }
+    return *lut;
+}
+
+// Paint the opaque cell of c, cell_w wide and a line high, top-left at
+// (x, y): background first, then the glyph's coverage through lut. The
+// glyph is clipped to its cell and the cell to the display.
+static void draw_glyph_cell(int x, int y, int cell_w, char c, const FontFace& face,
+                            const CoverageLut& lut) {
+    int x0 = x < 0 ? 0 : x;
+    int x1 = x + cell_w < DISPLAY_WIDTH ? x + cell_w : DISPLAY_WIDTH;
+    int y0 = y < 0 ? 0 : y;
+    int y1 = y + face.lineHeight() < DISPLAY_HEIGHT ? y + face.lineHeight() : DISPLAY_HEIGHT;
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    const FontGlyph* glyph = face.glyph(c);
+    int gx = x, gy = y, gw = 0, gh = 0;
+    const uint8_t* bits = nullptr;
+    if (glyph) {
+        gx = x + glyph->left;
+        gy = y + face.ascent() - glyph->top;
+        gw = glyph->width;
+        gh = glyph->height;
+        bits = face.bitmap(glyph);
+    }
+    int row_bytes = (gw + 1) / 2;
+
+    // Columns of the cell the glyph covers
+    int span0 = gx > x0 ? gx : x0;
+    int span1 = gx + gw < x1 ? gx + gw : x1;
+
+    for (int row = y0; row < y1; row++) {
+        int by = row - gy;
+        bool covered = bits && by >= 0 && by < gh && span0 < span1;
+        const uint8_t* src = covered ? bits + by * row_bytes : nullptr;
+
+        if (indexed_framebuffer) {
+            uint8_t* dst = indexed_framebuffer->pixels + row * (DISPLAY_WIDTH / 2);
+            fill_indexed_row(dst, x0, x1, lut.bgIndex);
+            for (int col = span0; covered && col < span1; col++) {
+                int bx = col - gx;
+                uint8_t alpha = bx % 2 == 0 ? src[bx / 2] >> 4 : src[bx / 2] & 0x0F;
+                if (alpha >= 8) {
+                    set_indexed_pixel(dst, col, lut.fgIndex);
+                }
+            }
+            continue;
+        }
+
+        uint16_t* dst = framebuffer + row * DISPLAY_WIDTH;
+        if (!covered) {
+            fill_pixels(dst + x0, lut.colors[0], x1 - x0);
+            continue;
+        }
+        if (span0 > x0) {
+            fill_pixels(dst + x0, lut.colors[0], span0 - x0);
+        }
+        // Two pixels per bitmap byte and lookup
+        int col = span0;
+        int bx = col - gx;
+        if (bx % 2 != 0) {
+            dst[col++] = lut.colors[src[bx / 2] & 0x0F];
+            bx++;
+        }
+        const uint8_t* pair = src + bx / 2;
+        for (; col + 1 < span1; col += 2) {
+            memcpy(dst + col, lut.pairs[*pair++], sizeof(lut.pairs[0]));
+        }
+        if (col < span1) {
+            dst[col] = lut.colors[*pair >> 4];
+        }
+        if (x1 > span1) {
+            fill_pixels(dst + span1, lut.colors[0], x1 - span1);
+        }
+    }
+}
+
+void draw_char(int x, int y, char c, char next, const FontFace& face, uint16_t color, uint16_t bg) {
+    draw_glyph_cell(x, y, face.advance(c, next), c, face, coverage_lut(color, bg));
+}
+
+void draw_text(int x, int y, const char* text, const FontFace& face, uint16_t color, uint16_t bg) {
+    const CoverageLut& lut = coverage_lut(color, bg);
+    int cursor_x = x;
+    for (int i = 0; text[i] != '\0'; i++) {
+        int advance = face.advance(text[i], text[i + 1]);
+        draw_glyph_cell(cursor_x, y, advance, text[i], face, lut);
+        cursor_x += advance;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// TextWidget
+// ---------------------------------------------------------------------------
+
+TextWidget::TextWidget(int x, int y, int scale, uint16_t color, uint16_t bg)
+    : _x(x), _y(y), _scale(scale), _face(nullptr), _color(color), _bg(bg), _maxWidth(0),
+      _nextEvict(0), _lastValid(false) {
+    invalidate();
+}
+
+TextWidget::TextWidget(int x, int y, const FontFace& face, uint16_t color, uint16_t bg)
+    : _x(x), _y(y), _scale(1), _face(&face), _color(color), _bg(bg), _maxWidth(0),
+      _nextEvict(0), _lastValid(false) {
+    invalidate();
+}
+
+void TextWidget::invalidate() {
+    for (int i = 0; i < TEXT_WIDGET_BUFFERS; i++) {
+        _buffers[i].buffer = nullptr;
+        _buffers[i].text[0] = '\0';
+    }
+    _last[0] = '\0';
+    _lastValid = false;
+}
+
+int TextWidget::height() const {
+    return _face ? _face->lineHeight() : 7 * _scale;
+}
+
+// Same spacing as draw_text: pen movement from text[i] to the next
+// character, kerning included
+int TextWidget::advance(const char* text, int i) const {
+    if (_face) {
+        return _face->advance(text[i], text[i + 1]);
+    }
+    return (text[i] == ':' ? 4 : 6) * _scale;
+}
+
+int TextWidget::width(const char* text) const {
+    int w = 0;
+    for (int i = 0; text[i] != '\0'; i++) {
+        w += advance(text, i);
+    }
+    return w;
+}
+
+// Span [x0, x1) relative to the widget where to looks different from from.
+// A character differs if its value, its position or its cell width
+// (kerning with the next one) changed; returns false when nothing does.
+bool TextWidget::changedRun(const char* from, const char* to, int& x0, int& x1) const {
+    int from_x = 0;
+    int to_x = 0;
+    x0 = -1;
+    x1 = 0;
+    int i = 0;
+    for (; from[i] != '\0' && to[i] != '\0'; i++) {
+        int from_advance = advance(from, i);
+        int to_advance = advance(to, i);
+        if (from[i] != to[i] || from_x != to_x || from_advance != to_advance) {
+            int start = from_x < to_x ? from_x : to_x;
+            int from_end = from_x + from_advance;
+            int to_end = to_x + to_advance;
+            if (x0 < 0) x0 = start;
+            if (from_end > x1) x1 = from_end;
+            if (to_end > x1) x1 = to_end;
+        }
+        from_x += from_advance;
+        to_x += to_advance;
+    }
+    if (from[i] != '\0' || to[i] != '\0') {
+        // One string is longer: its tail and anything it replaces differ
+        int start = from_x < to_x ? from_x : to_x;
+        int from_end = from_x + width(from + i);
+        int to_end = to_x + width(to + i);
+        if (x0 < 0) x0 = start;
+        if (from_end > x1) x1 = from_end;
+        if (to_end > x1) x1 = to_end;
+    }
+    return x0 >= 0;
+}
+
+// Draw the characters of text whose value, position or cell differs from
+// what the buffer shows (from), and clear what is left of a longer from
+void TextWidget::redraw(const char* from, const char* to) {
+    const int h = height();
+    int from_x = 0;
+    int to_x = 0;
+    bool from_done = false;
+    for (int i = 0; to[i] != '\0'; i++) {
+        char c = to[i];
+        int to_advance = advance(to, i);
+        if (from_done || from[i] != c || from_x != to_x || advance(from, i) != to_advance) {
+            if (_face) {
+                // The cell is painted opaque, spacing included
+                draw_char(_x + to_x, _y, c, to[i + 1], *_face, _color, _bg);
+            } else {
+                // draw_char paints the glyph cell opaque; clear the spacing
+                // after it, or the whole cell for characters without a glyph
+                bool glyph = (c >= '0' && c <= '9') || c == ':' || c == '-';
+                int glyph_w = glyph ? (c == ':' ? 3 : 5) * _scale : 0;
+                draw_char(_x + to_x, _y, c, _color, _scale, _bg);
+                draw_rect(_x + to_x + glyph_w, _y, to_advance - glyph_w, h, _bg);
+            }
+        }
+        to_x += to_advance;
+        if (!from_done) {
+            if (from[i] == '\0') {
+                from_done = true;
+            } else {
+                from_x += advance(from, i);
+            }
+        }
+    }
+    int old_width = width(from);
+    if (old_width > to_x) {
+        draw_rect(_x + to_x, _y, old_width - to_x, h, _bg);
+    }
+}
+
+int TextWidget::update(const char* text, DirtyRect* damage, int count, int max_rects) {
+    char shown[TEXT_WIDGET_MAX_CHARS + 1];
+    strncpy(shown, text, TEXT_WIDGET_MAX_CHARS);
+    shown[TEXT_WIDGET_MAX_CHARS] = '\0';
+    const int h = height();
+
+    const void* buffer = indexed_framebuffer ? (const void*)indexed_framebuffer
+                                             : (const void*)framebuffer;
+    Retained* slot = nullptr;
+    for (int i = 0; i < TEXT_WIDGET_BUFFERS && !slot; i++) {
+        if (_buffers[i].buffer == buffer) {
+            slot = &_buffers[i];
+        }
+    }
+    if (slot) {
+        redraw(slot->text, shown);
+    } else {
+        // Unknown contents: clear everything this widget may have drawn
+        slot = &_buffers[_nextEvict];
+        _nextEvict = (_nextEvict + 1) % TEXT_WIDGET_BUFFERS;
+        slot->buffer = buffer;
+        int w = width(shown);
+        draw_rect(_x, _y, w > _maxWidth ? w : _maxWidth, h, _bg);
+        redraw("", shown);
+    }
+    strcpy(slot->text, shown);
+
+    int w = width(shown);
+    int x0 = 0;
+    int x1 = 0;
+    bool changed;
+    if (_lastValid) {
+        changed = changedRun(_last, shown, x0, x1);
+    } else {
+        x1 = w > _maxWidth ? w : _maxWidth;
+        changed = x1 > 0;
+    }
+    if (w > _maxWidth) {
+        _maxWidth = w;
+    }
+    if (changed) {
+        count = add_dirty_rect(damage, count, max_rects, _x + x0, _y, x1 - x0, h);
+    }
+    strcpy(_last, shown);
+    _lastValid = true;
+    return count;
+}
+
+// ---------------------------------------------------------------------------
+// Test patterns
+// ---------------------------------------------------------------------------
+
+void fill_screen(ST7789_Driver& display, uint16_t color) {
+    display.fillRect(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, color);
+}
+
+void draw_gradient(ST7789_Driver& display) {
+    // Red depends only on x and blue only on x + y, so both come from
+    // tables and each row is a single OR pass
+    uint16_t red[DISPLAY_WIDTH];
+    uint16_t blue[DISPLAY_WIDTH + DISPLAY_HEIGHT];
+    for (int x = 0; x < DISPLAY_WIDTH; x++) {
+        red[x] = ((x * 31) / DISPLAY_WIDTH) << 11;
+    }
+    for (int i = 0; i < DISPLAY_WIDTH + DISPLAY_HEIGHT; i++) {
+        blue[i] = (i * 31) / (DISPLAY_WIDTH + DISPLAY_HEIGHT);
+    }
+
+    uint16_t line[DISPLAY_WIDTH];
+
+    display.beginTransaction();
+    display.setAddrWindow(0, 0, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1);
+
+    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+        uint16_t green = ((y * 63) / DISPLAY_HEIGHT) << 5;
+        const uint16_t* b = blue + y;
+        for (int x = 0; x < DISPLAY_WIDTH; x++) {
+            line[x] = red[x] | green | b[x];
+        }
+        display.pushPixels(line, DISPLAY_WIDTH);
+    }
+    display.endTransaction();
+}
+
+void draw_color_bars(ST7789_Driver& display) {
+    const uint16_t colors[] = {COLOR_WHITE, COLOR_YELLOW, COLOR_CYAN,
+                               COLOR_GREEN, COLOR_MAGENTA, COLOR_RED,
+                               COLOR_BLUE, COLOR_BLACK};
+    const int bar_width = DISPLAY_WIDTH / 8;
+
+    // Every row is identical
+    uint16_t line[DISPLAY_WIDTH];
+    for (int i = 0; i < 8; i++) {
+        int end = i == 7 ? DISPLAY_WIDTH : (i + 1) * bar_width;
+        fill_pixels(line + i * bar_width, colors[i], end - i * bar_width);
+    }
+
+    display.beginTransaction();
+    display.setAddrWindow(0, 0, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1);
+    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+        display.pushPixels(line, DISPLAY_WIDTH);
+    }
+    display.endTransaction();
+}
+
+void draw_checkerboard(ST7789_Driver& display, int square_size) {
+    // Rows alternate between two phases of the same pattern
+    uint16_t lines[2][DISPLAY_WIDTH];
+    for (int x = 0; x < DISPLAY_WIDTH; x += square_size) {
+        int n = x + square_size < DISPLAY_WIDTH ? square_size : DISPLAY_WIDTH - x;
+        bool is_white = (x / square_size) % 2 == 0;
+        fill_pixels(lines[0] + x, is_white ? COLOR_WHITE : COLOR_BLACK, n);
+        fill_pixels(lines[1] + x, is_white ? COLOR_BLACK : COLOR_WHITE, n);
+    }
+
+    display.beginTransaction();
+    display.setAddrWindow(0, 0, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1);
+    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+        display.pushPixels(lines[(y / square_size) % 2], DISPLAY_WIDTH);
+    }
+    display.endTransaction();
+}
@@ -0,0 +1,280 @@
+// Framebuffer drawing for the ST7789 display library (320x240, 90° rotation)
+// Glyph rendering, damage tracking and test patterns; no bcm2835
+// dependency, so the bench target can build it on any machine
+
+#ifndef GFX_H
+#define GFX_H
+
+#include <cstdint>
+
+#include "font.h"
+#include "st7789.h"
+
+// Partial refresh tuning
+#define DAMAGE_MAX_RECTS 32  // Upper bound on windows sent per frame
+#define DAMAGE_MERGE_GAP 8   // Clean columns bridged rather than opening a new window
+
+// Tile damage tracking
+#define TILE_SIZE 16         // Tiles are TILE_SIZE x TILE_SIZE pixels
+#define TILE_COLS (DISPLAY_WIDTH / TILE_SIZE)
+#define TILE_ROWS (DISPLAY_HEIGHT / TILE_SIZE)
+
+// Glyph cache
+#define GLYPH_COUNT 12       // '0'-'9', ':' and '-'
+#define GLYPH_COLON 10       // Atlas index of ':'
+#define GLYPH_DASH 11        // Atlas index of '-'
+#define GLYPH_CACHE_SLOTS 4  // (scale, colour) combinations kept rasterised
+
+// Indexed framebuffer
+#define PALETTE_SIZE 16      // 4 bits per pixel
+
+// Retained text
+#define TEXT_WIDGET_MAX_CHARS 16  // Longest string a TextWidget keeps
+#define TEXT_WIDGET_BUFFERS 4     // Framebuffers whose contents a TextWidget tracks
+
+// DISPLAY_WIDTH x DISPLAY_HEIGHT buffer the draw_* functions render into
+extern uint16_t* framebuffer;
+
+// When true, draw_* store colours in panel wire order (wire_color()) so the
+// frame can be sent with ST7789_Driver::pushWireRect. Colour arguments stay
+// host-order RGB565 either way.
+extern bool framebuffer_wire_order;
+
+// 4 bpp palette-indexed frame, two pixels per byte (even x in the high
+// nibble): 37.5 KB instead of 150 KB. Drawing maps RGB565 colours to
+// palette entries, so a colour theme change is a palette edit.
+struct IndexedFramebuffer {
+    uint8_t pixels[DISPLAY_WIDTH * DISPLAY_HEIGHT / 2];
+    uint16_t palette[PALETTE_SIZE];
+    int paletteUsed;
+
+    IndexedFramebuffer() : paletteUsed(0) {}
+
+    // Entry holding color, allocated on first use. When the palette is
+    // full the closest existing entry is returned.
+    uint8_t indexOf(uint16_t color);
+
+    // Send the frame, or a rectangle of it, expanded to RGB565
+    void push(ST7789_Driver& display) const;
+    void pushRect(ST7789_Driver& display, int x, int y, int w, int h) const;
+};
+
+// When set, the draw_* functions render into this frame instead of
+// framebuffer
+extern IndexedFramebuffer* indexed_framebuffer;
+
+// Rectangle in framebuffer coordinates
+struct DirtyRect {
+    int x, y, w, h;
+};
+
+// Append a rectangle, clipped to the display, to rects[0..count). When all
+// max_rects slots are used the last one grows to cover it. Returns the new
+// count.
+int add_dirty_rect(DirtyRect* rects, int count, int max_rects, int x, int y, int w, int h);
+
+// Damage tracker: keeps a copy of what the panel currently shows and reports
+// the rectangles that differ from a newly rendered frame.
+class DamageTracker {
+public:
+    DamageTracker();
+
+    // Forget the panel contents so the next frame is sent in full
+    void invalidate();
+
+    // Record that the whole panel was filled with one colour
+    void assumeFilled(uint16_t color);
+
+    // Compute changed rectangles between fb and the last committed frame
+    int collect(const uint16_t* fb, DirtyRect* rects, int max_rects) const;
+
+    // Same, but only looks inside hints; the rest of fb is taken to match
+    // the panel (e.g. hints are the cells a TextWidget redrew)
+    int collectWithin(const uint16_t* fb, const DirtyRect* hints, int hint_count,
+                      DirtyRect* rects, int max_rects) const;
+
+    // Record fb as the frame now shown on the panel
+    void commit(const uint16_t* fb);
+
+    // Same, for a frame that only differs from the last one inside rects
+    void commitRects(const uint16_t* fb, const DirtyRect* rects, int count);
+
+private:
+    uint16_t _shadow[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+    bool _valid;
+
+    bool rowDirty(const uint16_t* fb, int row, int x0, int x1) const;
+    bool columnDirty(const uint16_t* fb, int col, int y0, int y1) const;
+    int splitBand(const uint16_t* fb, int y0, int y1, int x0, int x1,
+                  DirtyRect* rects, int max_rects) const;
+};
+
+// Tile damage tracker: the same interface as DamageTracker, but instead of a
+// copy of the panel it keeps one hash per 16x16 tile of the last committed
+// frame (under 3 KB instead of 150 KB), and reads each frame once rather
+// than comparing two. Changed tiles are coalesced into as few windows as it can:
+// runs along a tile row, stacked with equal runs in the rows below. Windows
+// are whole tiles, so they can be a little larger than DamageTracker's.
+// A hash collision would leave a tile stale until it changes again.
+class TileTracker {
+public:
+    TileTracker();
+
+    void invalidate();
+    void assumeFilled(uint16_t color);
+
+    // Changed windows between fb and the last committed frame. The hashes
+    // computed here are reused by the next commit, so fb must not change
+    // in between.
+    int collect(const uint16_t* fb, DirtyRect* rects, int max_rects);
+
+    // Same, hashing only the tiles the hints touch
+    int collectWithin(const uint16_t* fb, const DirtyRect* hints, int hint_count,
+                      DirtyRect* rects, int max_rects);
+
+    void commit(const uint16_t* fb);
+    void commitRects(const uint16_t* fb, const DirtyRect* rects, int count);
+
+private:
+    uint32_t _hashes[TILE_ROWS * TILE_COLS];   // Of the frame on the panel
+    uint32_t _pending[TILE_ROWS * TILE_COLS];  // Of the frame last collected
+    bool _pendingKnown[TILE_ROWS * TILE_COLS];
+    bool _valid;
+
+    uint32_t pendingHash(const uint16_t* fb, int tile);
+    int coalesce(const bool* dirty, DirtyRect* rects, int max_rects) const;
+};
+
+// Glyph atlas: every digit and the colon rasterised once for a given
+// (scale, foreground, background) into opaque RGB565 tiles, so drawing a
+// character is a clipped row-by-row memcpy
+struct GlyphAtlas {
+    int scale;
+    uint16_t fg;
+    uint16_t bg;
+    int height;                   // 7 * scale
+    int widths[GLYPH_COUNT];      // 5 * scale for digits and '-', 3 * scale for ':'
+    uint16_t* tiles[GLYPH_COUNT]; // Row-major, widths[i] x height
+    uint16_t* storage;
+};
+
+class GlyphCache {
+public:
+    GlyphCache();
+    ~GlyphCache();
+
+    const GlyphAtlas& get(int scale, uint16_t fg, uint16_t bg);
+
+private:
+    GlyphAtlas _slots[GLYPH_CACHE_SLOTS];
+    int _used;
+    int _nextEvict;
+
+    static void fillCell(uint16_t* tile, int width, int col, int row, int scale, uint16_t color);
+    static void rasterise(GlyphAtlas& atlas, int scale, uint16_t fg, uint16_t bg);
+
+    GlyphCache(const GlyphCache&);
+    GlyphCache& operator=(const GlyphCache&);
+};
+
+extern GlyphCache glyph_cache;
+
+// Draw a filled rectangle
+void draw_rect(int x, int y, int w, int h, uint16_t color);
+
+// Copy a tile into the framebuffer, clipped to the display
+void blit_tile(int x, int y, const uint16_t* tile, int w, int h);
+
+// Copy a two-colour tile into indexed_framebuffer, clipped to the display
+void blit_tile_indexed(int x, int y, const uint16_t* tile, int w, int h,
+                       uint16_t fg, uint8_t fg_index, uint8_t bg_index);
+
+// Draw a digit, ':' or '-' as an opaque cell over bg; other characters are
+// skipped
+void draw_char(int x, int y, char c, uint16_t color, int scale, uint16_t bg = COLOR_BLACK);
+
+// Rasterise the atlas draw_char takes for text at scale in these colours
+// and the current byte order, so later draws only copy tiles
+void prepare_glyphs(int scale, uint16_t color, uint16_t bg = COLOR_BLACK);
+
+void draw_text(int x, int y, const char* text, uint16_t color, int scale,
+               uint16_t bg = COLOR_BLACK);
+
+// Pixels draw_text moves on for text at scale: 6 * scale per character,
+// 4 * scale for ':', the spacing after the last one included
+int text_width(const char* text, int scale);
+
+// Pixels its glyphs span: text_width without that trailing spacing, for
+// centring
+int text_ink_width(const char* text, int scale);
+
+// Anti-aliased text in a baked font; (x, y) is the top left of the line.
+// Each character is an opaque cell over bg, its advance (kerning with next
+// included) wide and a line high. Coverage maps through a 16-entry colour
+// table, so a pixel costs one lookup, as a scaled bitmap glyph does. The
+// tables are cached across calls for the last GLYPH_CACHE_SLOTS (fg, bg,
+// byte order) combinations; text in more colour pairs than that evicts
+// them in turn, and then every draw rebuilds its table. The indexed
+// framebuffer gets fg where coverage is at least half.
+void draw_char(int x, int y, char c, char next, const FontFace& face, uint16_t color,
+               uint16_t bg = COLOR_BLACK);
+
+void draw_text(int x, int y, const char* text, const FontFace& face, uint16_t color,
+               uint16_t bg = COLOR_BLACK);
+
+// Retained-mode text: remembers the string last drawn into each framebuffer
+// and re-rasterises only the characters that differ, so a static date costs
+// nothing per frame. Buffers are told apart by the framebuffer (or
+// indexed_framebuffer) pointer, which lets one widget serve a rotating set
+// of mailbox buffers.
+class TextWidget {
+public:
+    TextWidget(int x, int y, int scale, uint16_t color, uint16_t bg = COLOR_BLACK);
+
+    // Same in a baked font instead of the scaled bitmap digits
+    TextWidget(int x, int y, const FontFace& face, uint16_t color, uint16_t bg = COLOR_BLACK);
+
+    // Draw text into the current framebuffer. The screen areas that differ
+    // from the previous update() are appended to damage[count..max_rects);
+    // returns the new count.
+    int update(const char* text, DirtyRect* damage, int count, int max_rects);
+
+    // Forget every buffer, so the next update redraws and reports in full
+    void invalidate();
+
+    int x() const { return _x; }
+
+    // Pixels text takes at this widget's scale or in its font
+    int width(const char* text) const;
+
+    // Line height in pixels
+    int height() const;
+
+private:
+    struct Retained {
+        const void* buffer;
+        char text[TEXT_WIDGET_MAX_CHARS + 1];
+    };
+
+    int _x, _y, _scale;
+    const FontFace* _face;  // nullptr: scaled bitmap digits
+    uint16_t _color, _bg;
+    int _maxWidth;  // Widest string drawn so far, in pixels
+    Retained _buffers[TEXT_WIDGET_BUFFERS];
+    int _nextEvict;
+    char _last[TEXT_WIDGET_MAX_CHARS + 1];
+    bool _lastValid;
+
+    int advance(const char* text, int i) const;
+    bool changedRun(const char* from, const char* to, int& x0, int& x1) const;
+    void redraw(const char* from, const char* to);
+};
+
+// Full-screen test patterns, generated a row at a time and streamed
+// straight to the panel
+void fill_screen(ST7789_Driver& display, uint16_t color);
+void draw_gradient(ST7789_Driver& display);
+void draw_color_bars(ST7789_Driver& display);
+void draw_checkerboard(ST7789_Driver& display, int square_size);
+
+#endif // GFX_H
@@ -0,0 +1,103 @@
+// Fixed-size latency histogram for frame-timing instrumentation
+
+#include "latency_histogram.h"
+
+#include <cstdio>
+#include <ctime>
+
+LatencyHistogram::LatencyHistogram() : _count(0), _max(0) {
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        _buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+// Values below 4 get their own bucket; above that each power of two
+// [2^e, 2^(e+1)) is split into 4 equal sub-buckets
+int LatencyHistogram::bucketFor(int64_t ns) {
+    if (ns < 4) {
+        return ns < 0 ? 0 : (int)ns;
+    }
+    int e = 63 - __builtin_clzll((unsigned long long)ns);
+    int sub = (int)((ns >> (e - 2)) & 3);
+    int bucket = 4 * (e - 1) + sub;
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+int64_t LatencyHistogram::bucketUpper(int bucket) {
+    if (bucket < 4) {
+        return bucket;
+    }
+    int e = bucket / 4 + 1;
+    int sub = bucket % 4;
+    int64_t lower = (int64_t)(4 + sub) << (e - 2);
+    return lower + ((int64_t)1 << (e - 2)) - 1;
+}
+
+void LatencyHistogram::record(int64_t ns) {
+    _buckets[bucketFor(ns)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+
+    int64_t prev = _max.load(std::memory_order_relaxed);
+    while (ns > prev && !_max.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::reset() {
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        _buckets[i].store(0, std::memory_order_relaxed);
+    }
+    _count.store(0, std::memory_order_relaxed);
+    _max.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::count() const {
+    return _count.load(std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::max() const {
+    return _max.load(std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::percentile(double p) const {
+    uint64_t total = 0;
+    uint64_t counts[LATENCY_BUCKETS];
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        counts[i] = _buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(p / 100.0 * total + 0.5);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            int64_t upper = bucketUpper(i);
+            int64_t observed = max();
+            return upper < observed ? upper : observed;
+        }
+    }
+    return max();
+}
+
+const char* format_duration(int64_t ns, char* buf, int len) {
+    if (ns < 1000) {
+        snprintf(buf, len, "%lldns", (long long)ns);
+    } else if (ns < 1000000) {
+        snprintf(buf, len, "%.1fus", ns / 1e3);
+    } else if (ns < 1000000000) {
+        snprintf(buf, len, "%.1fms", ns / 1e6);
+    } else {
+        snprintf(buf, len, "%.2fs", ns / 1e9);
+    }
+    return buf;
+}
+
+int64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
@@ -0,0 +1,43 @@
+// Fixed-size latency histogram for frame-timing instrumentation
+// Log-linear buckets (4 per power of two, <25% error), no allocation,
+// safe to record from one thread while another reads or dumps
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <cstdint>
+
+#define LATENCY_BUCKETS 160  // Covers 0 ns .. ~18 minutes
+
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(int64_t ns);
+
+    // Clear all samples. Samples recorded concurrently may be lost.
+    void reset();
+
+    uint64_t count() const;
+    int64_t max() const;
+
+    // Upper bound of the bucket holding the p-th percentile (0 < p <= 100)
+    int64_t percentile(double p) const;
+
+private:
+    std::atomic<uint32_t> _buckets[LATENCY_BUCKETS];
+    std::atomic<uint64_t> _count;
+    std::atomic<int64_t> _max;
+
+    static int bucketFor(int64_t ns);
+    static int64_t bucketUpper(int bucket);
+};
+
+// Print a duration with a readable unit ("850ns", "12.3us", "4.1ms")
+const char* format_duration(int64_t ns, char* buf, int len);
+
+// CLOCK_MONOTONIC in nanoseconds, for timing probes
+int64_t monotonic_ns();
+
+#endif // LATENCY_HISTOGRAM_H
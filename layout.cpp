@@ -0,0 +1,635 @@
+// Clock face layout for the ST7789 display library
+
+#include "layout.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "pixel_ops.h"
+
+#define LAYOUT_CENTER -32768  // x= or y= center, resolved once the size is known
+
+// "00" to "99": a two-digit field is one table read
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+struct Layout::Spec {
+    LayoutKind kind;
+    int x, y;
+    int scale;     // Bitmap dot size, or the font size it stands for
+    int fontSize;  // Baked size from font=, 0 for scale=
+    uint16_t color, bg;
+    char format[LAYOUT_LINE_MAX];  // Time and date format, or the text
+    char idleFormat[LAYOUT_LINE_MAX];
+    bool hasIdle;
+    char file[LAYOUT_LINE_MAX];
+};
+
+static const struct {
+    const char* name;
+    uint16_t color;
+} color_names[] = {
+    {"black", COLOR_BLACK}, {"white", COLOR_WHITE}, {"red", COLOR_RED},
+    {"green", COLOR_GREEN}, {"blue", COLOR_BLUE}, {"cyan", COLOR_CYAN},
+    {"magenta", COLOR_MAGENTA}, {"yellow", COLOR_YELLOW},
+};
+
+static uint16_t rgb565(int r, int g, int b) {
+    return (uint16_t)(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+}
+
+// A colour name, #RRGGBB or 0xNNNN (RGB565)
+static bool parse_color(const char* value, uint16_t& color) {
+    for (size_t i = 0; i < sizeof(color_names) / sizeof(color_names[0]); i++) {
+        if (strcmp(value, color_names[i].name) == 0) {
+            color = color_names[i].color;
+            return true;
+        }
+    }
+    char* end;
+    if (value[0] == '#' && strlen(value) == 7) {
+        unsigned long rgb = strtoul(value + 1, &end, 16);
+        if (*end == '\0') {
+            color = rgb565((rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF);
+            return true;
+        }
+    }
+    if (strncmp(value, "0x", 2) == 0 && strlen(value) == 6) {
+        unsigned long raw = strtoul(value + 2, &end, 16);
+        if (*end == '\0') {
+            color = (uint16_t)raw;
+            return true;
+        }
+    }
+    return false;
+}
+
+// A coordinate, or "center"
+static bool parse_position(const char* value, int& pos) {
+    if (strcmp(value, "center") == 0) {
+        pos = LAYOUT_CENTER;
+        return true;
+    }
+    char* end;
+    long n = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || n < -DISPLAY_WIDTH || n > DISPLAY_WIDTH) {
+        return false;
+    }
+    pos = (int)n;
+    return true;
+}
+
+static bool parse_number(const char* value, int min, int max, int& n) {
+    char* end;
+    long parsed = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || parsed < min || parsed > max) {
+        return false;
+    }
+    n = (int)parsed;
+    return true;
+}
+
+// Next whitespace-separated token at *pos, NUL-terminated in place. A
+// double-quoted stretch may hold spaces; the quotes are dropped.
+static char* next_token(char** pos) {
+    char* p = *pos;
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    if (*p == '\0') {
+        *pos = p;
+        return nullptr;
+    }
+    char* token = p;
+    char* out = p;
+    bool quoted = false;
+    for (; *p != '\0' && (quoted || (*p != ' ' && *p != '\t')); p++) {
+        if (*p == '"') {
+            quoted = !quoted;
+        } else {
+            *out++ = *p;
+        }
+    }
+    if (*p != '\0') {
+        p++;
+    }
+    *out = '\0';
+    *pos = p;
+    return token;
+}
+
+// Skip PPM header whitespace and # comments, then read a number
+static bool read_ppm_number(FILE* file, int& n) {
+    int c = fgetc(file);
+    while (c == '#' || isspace(c)) {
+        if (c == '#') {
+            while (c != '\n' && c != EOF) {
+                c = fgetc(file);
+            }
+        }
+        c = fgetc(file);
+    }
+    if (!isdigit(c)) {
+        return false;
+    }
+    n = 0;
+    while (isdigit(c)) {
+        n = n * 10 + (c - '0');
+        if (n > 65535) {
+            return false;
+        }
+        c = fgetc(file);
+    }
+    // The single whitespace character after the last header field
+    return isspace(c);
+}
+
+// Binary PPM with 8-bit channels, as `convert logo.png logo.ppm` writes it
+static bool load_ppm(const char* path, std::vector<uint16_t>& pixels, int& w, int& h) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        std::cerr << "Error: cannot open " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    int maxval = 0;
+    bool ok = fgetc(file) == 'P' && fgetc(file) == '6' && read_ppm_number(file, w) &&
+              read_ppm_number(file, h) && read_ppm_number(file, maxval) && maxval == 255;
+    if (!ok) {
+        std::cerr << "Error: " << path << " is not a binary PPM (P6) with 8-bit channels"
+                  << std::endl;
+        fclose(file);
+        return false;
+    }
+    if (w < 1 || h < 1 || w > DISPLAY_WIDTH || h > DISPLAY_HEIGHT) {
+        std::cerr << "Error: " << path << " is " << w << "x" << h << ", larger than the display"
+                  << std::endl;
+        fclose(file);
+        return false;
+    }
+
+    pixels.resize(w * h);
+    uint8_t row[DISPLAY_WIDTH * 3];
+    for (int y = 0; y < h && ok; y++) {
+        ok = fread(row, 3, w, file) == (size_t)w;
+        for (int x = 0; x < w && ok; x++) {
+            pixels[y * w + x] = rgb565(row[3 * x], row[3 * x + 1], row[3 * x + 2]);
+        }
+    }
+    fclose(file);
+    if (!ok) {
+        std::cerr << "Error: " << path << " is truncated" << std::endl;
+    }
+    return ok;
+}
+
+Layout::Layout() : _count(0) {}
+
+Layout::~Layout() {
+    clear();
+}
+
+void Layout::clear() {
+    for (int i = 0; i < _count; i++) {
+        delete _widgets[i].text;
+        _widgets[i].text = nullptr;
+        _widgets[i].pixels.clear();
+    }
+    _count = 0;
+}
+
+bool Layout::parseLine(char* line, Spec& spec, const char* path, int line_no) const {
+    char* pos = line;
+    char* kind = next_token(&pos);
+    if (strcmp(kind, "time") == 0) {
+        spec.kind = LAYOUT_TIME;
+        strcpy(spec.format, "HH:MM:SS");
+    } else if (strcmp(kind, "date") == 0) {
+        spec.kind = LAYOUT_DATE;
+        strcpy(spec.format, "YYYY-MM-DD");
+    } else if (strcmp(kind, "text") == 0) {
+        spec.kind = LAYOUT_TEXT;
+        spec.format[0] = '\0';
+    } else if (strcmp(kind, "image") == 0) {
+        spec.kind = LAYOUT_IMAGE;
+    } else {
+        std::cerr << "Error: " << path << ":" << line_no << ": unknown widget \"" << kind
+                  << "\" (time, date, text or image)" << std::endl;
+        return false;
+    }
+    spec.x = LAYOUT_CENTER;
+    spec.y = 0;
+    spec.scale = 3;
+    spec.fontSize = 0;
+    spec.color = COLOR_WHITE;
+    spec.bg = COLOR_BLACK;
+    spec.hasIdle = false;
+    spec.file[0] = '\0';
+
+    char* token;
+    while ((token = next_token(&pos)) != nullptr) {
+        char* value = strchr(token, '=');
+        if (!value) {
+            std::cerr << "Error: " << path << ":" << line_no << ": expected key=value, got \""
+                      << token << "\"" << std::endl;
+            return false;
+        }
+        *value++ = '\0';
+        bool text_key = spec.kind != LAYOUT_IMAGE;
+        bool ok = true;
+        if (strcmp(token, "x") == 0) {
+            ok = parse_position(value, spec.x);
+        } else if (strcmp(token, "y") == 0) {
+            ok = parse_position(value, spec.y);
+        } else if (strcmp(token, "scale") == 0 && text_key) {
+            ok = parse_number(value, 1, DISPLAY_HEIGHT / 7, spec.scale);
+            spec.fontSize = 0;
+        } else if (strcmp(token, "font") == 0 && text_key) {
+            ok = parse_number(value, 1, DISPLAY_HEIGHT, spec.fontSize);
+        } else if (strcmp(token, "color") == 0 && text_key) {
+            ok = parse_color(value, spec.color);
+        } else if (strcmp(token, "bg") == 0 && text_key) {
+            ok = parse_color(value, spec.bg);
+        } else if (strcmp(token, "format") == 0 &&
+                   (spec.kind == LAYOUT_TIME || spec.kind == LAYOUT_DATE)) {
+            strcpy(spec.format, value);
+        } else if (strcmp(token, "idle") == 0 && spec.kind == LAYOUT_TIME) {
+            strcpy(spec.idleFormat, value);
+            spec.hasIdle = true;
+        } else if (strcmp(token, "text") == 0 && spec.kind == LAYOUT_TEXT) {
+            strcpy(spec.format, value);
+        } else if (strcmp(token, "file") == 0 && spec.kind == LAYOUT_IMAGE) {
+            // Relative to the layout file, wherever the clock is started
+            const char* slash = strrchr(path, '/');
+            int dir = value[0] != '/' && slash ? (int)(slash - path + 1) : 0;
+            snprintf(spec.file, sizeof(spec.file), "%.*s%s", dir, path, value);
+        } else {
+            std::cerr << "Error: " << path << ":" << line_no << ": " << kind
+                      << " widgets have no " << token << "=" << std::endl;
+            return false;
+        }
+        if (!ok) {
+            std::cerr << "Error: " << path << ":" << line_no << ": bad " << token << "=" << value
+                      << std::endl;
+            return false;
+        }
+    }
+    if (spec.kind == LAYOUT_IMAGE && spec.file[0] == '\0') {
+        std::cerr << "Error: " << path << ":" << line_no << ": image without file=" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Literal characters go into the buffer now; each field becomes a slot
+// that format() fills. In idle mode, without an explicit idle format, SS
+// and the separator before it are left out.
+bool Layout::compileFormat(Widget& widget, const char* format, bool idle) const {
+    static const struct {
+        const char* token;
+        LayoutKind kind;
+        FieldValue first;   // Value of the first (or only) digit pair
+        int pairs;
+    } tokens[] = {
+        {"HH", LAYOUT_TIME, FIELD_HOUR, 1}, {"MM", LAYOUT_TIME, FIELD_MINUTE, 1},
+        {"SS", LAYOUT_TIME, FIELD_SECOND, 1}, {"YYYY", LAYOUT_DATE, FIELD_CENTURY, 2},
+        {"YY", LAYOUT_DATE, FIELD_YEAR, 1}, {"MM", LAYOUT_DATE, FIELD_MONTH, 1},
+        {"DD", LAYOUT_DATE, FIELD_DAY, 1},
+    };
+
+    int length = 0;
+    int literals = 0;  // Literal characters just before the current position
+    widget.fieldCount = 0;
+    for (const char* p = format; *p != '\0';) {
+        int match = -1;
+        if (widget.kind != LAYOUT_TEXT) {
+            for (size_t t = 0; t < sizeof(tokens) / sizeof(tokens[0]) && match < 0; t++) {
+                if (tokens[t].kind == widget.kind &&
+                    strncmp(p, tokens[t].token, strlen(tokens[t].token)) == 0) {
+                    match = (int)t;
+                }
+            }
+        }
+        if (match < 0) {
+            if (length == TEXT_WIDGET_MAX_CHARS) {
+                return false;
+            }
+            widget.buffer[length++] = *p++;
+            literals++;
+            continue;
+        }
+        p += strlen(tokens[match].token);
+        if (idle && tokens[match].first == FIELD_SECOND) {
+            if (literals > 0) {
+                length--;
+            }
+            literals = 0;
+            continue;
+        }
+        for (int pair = 0; pair < tokens[match].pairs; pair++) {
+            if (length + 2 > TEXT_WIDGET_MAX_CHARS || widget.fieldCount == LAYOUT_MAX_FIELDS) {
+                return false;
+            }
+            Field& field = widget.fields[widget.fieldCount++];
+            field.offset = (uint8_t)length;
+            field.value = (uint8_t)(tokens[match].first + pair);
+            widget.buffer[length++] = '0';
+            widget.buffer[length++] = '0';
+        }
+        literals = 0;
+    }
+    widget.buffer[length] = '\0';
+    return true;
+}
+
+bool Layout::addWidget(const Spec& spec, const FontFile& font, bool idle, const char* path,
+                      int line_no) {
+    if (_count == LAYOUT_MAX_WIDGETS) {
+        std::cerr << "Error: " << path << ":" << line_no << ": more than " << LAYOUT_MAX_WIDGETS
+                  << " widgets" << std::endl;
+        return false;
+    }
+    Widget& widget = _widgets[_count];
+    widget.kind = spec.kind;
+    widget.text = nullptr;
+    widget.scale = 0;
+    widget.color = spec.color;
+    widget.bg = spec.bg;
+    widget.fieldCount = 0;
+    widget.wireOrder = false;
+    widget.nextEvict = 0;
+    widget.reported = false;
+    for (int i = 0; i < TEXT_WIDGET_BUFFERS; i++) {
+        widget.drawn[i] = nullptr;
+    }
+
+    int x = spec.x;
+    int y = spec.y;
+    const FontFace* face = nullptr;
+    if (spec.kind == LAYOUT_IMAGE) {
+        int w, h;
+        if (!load_ppm(spec.file, widget.pixels, w, h)) {
+            return false;
+        }
+        widget.box.w = w;
+        widget.box.h = h;
+    } else {
+        const char* format = spec.kind == LAYOUT_TIME && idle && spec.hasIdle ? spec.idleFormat
+                                                                              : spec.format;
+        bool explicit_idle = spec.kind == LAYOUT_TIME && idle && spec.hasIdle;
+        if (!compileFormat(widget, format, idle && !explicit_idle)) {
+            std::cerr << "Error: " << path << ":" << line_no << ": \"" << format
+                      << "\" is longer than " << TEXT_WIDGET_MAX_CHARS << " characters"
+                      << std::endl;
+            return false;
+        }
+
+        // A scaled line takes the baked size closest to the bitmap digits'
+        // height when a font is loaded, centred on the same line
+        face = font.face(spec.fontSize ? spec.fontSize : 7 * spec.scale);
+        if (spec.fontSize && !face) {
+            std::cerr << "Error: " << path << ":" << line_no << ": font= needs --font"
+                      << std::endl;
+            return false;
+        }
+        if (!face) {
+            for (const char* c = widget.buffer; *c != '\0'; c++) {
+                if (!isdigit((unsigned char)*c) && *c != ':' && *c != '-' && *c != ' ') {
+                    std::cerr << "Warning: " << path << ":" << line_no << ": the bitmap digits"
+                              << " have no '" << *c << "'; it is left blank without --font"
+                              << std::endl;
+                    break;
+                }
+            }
+        }
+        if (face && !spec.fontSize && y != LAYOUT_CENTER) {
+            y += (7 * spec.scale - face->lineHeight()) / 2;
+        }
+
+        // Sized with zeros in every field: all digits of the bitmap font,
+        // and the widest case the clock has always centred on for a baked one
+        TextWidget probe = face ? TextWidget(0, 0, *face, spec.color, spec.bg)
+                                : TextWidget(0, 0, spec.scale, spec.color, spec.bg);
+        widget.box.w = probe.width(widget.buffer);
+        widget.box.h = probe.height();
+    }
+
+    // Bitmap text is centred on its glyphs, without the spacing after the
+    // last one; the box still covers it, as the widget paints it
+    int ink_w = widget.box.w;
+    if (spec.kind != LAYOUT_IMAGE && !face) {
+        ink_w = text_ink_width(widget.buffer, spec.scale);
+    }
+    if (ink_w > DISPLAY_WIDTH || widget.box.h > DISPLAY_HEIGHT) {
+        std::cerr << "Error: " << path << ":" << line_no << ": widget is " << ink_w << "x"
+                  << widget.box.h << ", larger than the " << DISPLAY_WIDTH << "x"
+                  << DISPLAY_HEIGHT << " display" << std::endl;
+        return false;
+    }
+    if (x == LAYOUT_CENTER) {
+        x = (DISPLAY_WIDTH - ink_w) / 2;
+    }
+    if (y == LAYOUT_CENTER) {
+        y = (DISPLAY_HEIGHT - widget.box.h) / 2;
+    }
+    widget.box.x = x;
+    widget.box.y = y;
+    if (spec.kind != LAYOUT_IMAGE) {
+        widget.text = face ? new TextWidget(x, y, *face, spec.color, spec.bg)
+                           : new TextWidget(x, y, spec.scale, spec.color, spec.bg);
+        widget.scale = face ? 0 : spec.scale;
+    }
+    _count++;
+    return true;
+}
+
+bool Layout::load(const char* path, const FontFile& font, bool idle) {
+    clear();
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        std::cerr << "Error: cannot open " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    char line[LAYOUT_LINE_MAX];
+    Spec spec;
+    int line_no = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file)) {
+        line_no++;
+        size_t len = strlen(line);
+        if (len == sizeof(line) - 1 && line[len - 1] != '\n') {
+            std::cerr << "Error: " << path << ":" << line_no << ": line too long" << std::endl;
+            ok = false;
+            break;
+        }
+        char* hash = strchr(line, '#');
+        if (hash && (hash == line || isspace((unsigned char)hash[-1]))) {
+            *hash = '\0';  // A comment, not a #RRGGBB colour
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        if (strspn(line, " \t") == strlen(line)) {
+            continue;
+        }
+        ok = parseLine(line, spec, path, line_no) && addWidget(spec, font, idle, path, line_no);
+    }
+    fclose(file);
+    if (!ok) {
+        clear();
+        return false;
+    }
+
+    // Each bitmap style is a glyph atlas; with more styles than the cache
+    // holds, every tick would rasterise (and allocate) atlases again
+    int styles = 0;
+    for (int i = 0; i < _count; i++) {
+        const Widget& widget = _widgets[i];
+        if (widget.scale == 0) {
+            continue;
+        }
+        bool seen = false;
+        for (int j = 0; j < i && !seen; j++) {
+            seen = _widgets[j].scale == widget.scale && _widgets[j].color == widget.color &&
+                   _widgets[j].bg == widget.bg;
+        }
+        styles += seen ? 0 : 1;
+    }
+    if (styles > GLYPH_CACHE_SLOTS) {
+        std::cerr << "Error: " << path << ": " << styles << " bitmap text styles (scale, colour,"
+                  << " background); the glyph cache holds " << GLYPH_CACHE_SLOTS << std::endl;
+        clear();
+        return false;
+    }
+    prepare();
+    return true;
+}
+
+void Layout::loadDefault(const FontFile& font, bool idle) {
+    clear();
+    Spec spec;
+    spec.kind = LAYOUT_TIME;
+    spec.x = LAYOUT_CENTER;
+    spec.y = 60;
+    spec.scale = 7;
+    spec.fontSize = 0;
+    spec.color = COLOR_CYAN;
+    spec.bg = COLOR_BLACK;
+    strcpy(spec.format, "HH:MM:SS");
+    spec.hasIdle = false;
+    spec.file[0] = '\0';
+    addWidget(spec, font, idle, "(default)", 1);
+
+    spec.kind = LAYOUT_DATE;
+    spec.y = 160;
+    spec.scale = 3;
+    spec.color = COLOR_YELLOW;
+    strcpy(spec.format, "YYYY-MM-DD");
+    addWidget(spec, font, idle, "(default)", 2);
+    prepare();
+}
+
+void Layout::prepare() const {
+    for (int i = 0; i < _count; i++) {
+        const Widget& widget = _widgets[i];
+        if (widget.scale != 0) {
+            prepare_glyphs(widget.scale, widget.color, widget.bg);
+        }
+    }
+}
+
+void Layout::format(const struct tm& t) {
+    int values[] = {t.tm_hour, t.tm_min, t.tm_sec, (t.tm_year + 1900) / 100 % 100,
+                    (t.tm_year + 1900) % 100, t.tm_mon + 1, t.tm_mday};
+    for (int i = 0; i < _count; i++) {
+        Widget& widget = _widgets[i];
+        for (int f = 0; f < widget.fieldCount; f++) {
+            const char* pair = digit_pairs + 2 * values[widget.fields[f].value];
+            char* out = widget.buffer + widget.fields[f].offset;
+            out[0] = pair[0];
+            out[1] = pair[1];
+        }
+    }
+}
+
+// Images are copied into each buffer once and reported once
+int Layout::updateImage(Widget& widget, DirtyRect* damage, int count, int max_rects) {
+    if (indexed_framebuffer || !framebuffer) {
+        return count;
+    }
+    if (widget.wireOrder != framebuffer_wire_order) {
+        for (size_t i = 0; i < widget.pixels.size(); i++) {
+            widget.pixels[i] = wire_color(widget.pixels[i]);
+        }
+        widget.wireOrder = framebuffer_wire_order;
+        for (int i = 0; i < TEXT_WIDGET_BUFFERS; i++) {
+            widget.drawn[i] = nullptr;
+        }
+        widget.reported = false;
+    }
+
+    bool drawn = false;
+    for (int i = 0; i < TEXT_WIDGET_BUFFERS && !drawn; i++) {
+        drawn = widget.drawn[i] == framebuffer;
+    }
+    if (!drawn) {
+        blit_tile(widget.box.x, widget.box.y, &widget.pixels[0], widget.box.w, widget.box.h);
+        widget.drawn[widget.nextEvict] = framebuffer;
+        widget.nextEvict = (widget.nextEvict + 1) % TEXT_WIDGET_BUFFERS;
+    }
+    if (!widget.reported) {
+        count = add_dirty_rect(damage, count, max_rects, widget.box.x, widget.box.y,
+                               widget.box.w, widget.box.h);
+        widget.reported = true;
+    }
+    return count;
+}
+
+int Layout::update(DirtyRect* damage, int count, int max_rects) {
+    for (int i = 0; i < _count; i++) {
+        Widget& widget = _widgets[i];
+        if (widget.text) {
+            count = widget.text->update(widget.buffer, damage, count, max_rects);
+        } else {
+            count = updateImage(widget, damage, count, max_rects);
+        }
+    }
+    return count;
+}
+
+void Layout::invalidate() {
+    for (int i = 0; i < _count; i++) {
+        Widget& widget = _widgets[i];
+        if (widget.text) {
+            widget.text->invalidate();
+        }
+        for (int b = 0; b < TEXT_WIDGET_BUFFERS; b++) {
+            widget.drawn[b] = nullptr;
+        }
+        widget.reported = false;
+    }
+}
+
+bool Layout::columns(int& first, int& last) const {
+    first = DISPLAY_WIDTH;
+    last = -1;
+    for (int i = 0; i < _count; i++) {
+        const DirtyRect& box = _widgets[i].box;
+        if (box.x < first) first = box.x;
+        if (box.x + box.w - 1 > last) last = box.x + box.w - 1;
+    }
+    if (first < 0) first = 0;
+    if (last > DISPLAY_WIDTH - 1) last = DISPLAY_WIDTH - 1;
+    return first <= last;
+}
@@ -0,0 +1,124 @@
+// Clock face layout for the ST7789 display library
+// A layout is a list of widgets (time, date, fixed text, images) read once
+// from a small text file at startup. Everything a tick needs is worked out
+// at load: each widget's position (centring uses real glyph advances), its
+// text buffer with the literal characters already in place and the digit
+// slots the time goes into, and the box it can ever cover. A tick then
+// writes digit pairs from a table into those buffers and lets retained
+// TextWidgets redraw what changed from glyph atlases rasterised at load;
+// no allocation, no printf.
+//
+// One widget per line, blank lines and # comments ignored:
+//
+//   time  x=center y=60 scale=7 color=cyan format=HH:MM:SS
+//   date  x=center y=160 scale=3 color=yellow format=YYYY-MM-DD
+//   text  x=4 y=4 font=16 color=#808080 text="Kitchen"
+//   image x=0 y=200 file=logo.ppm
+
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+#include "font.h"
+#include "gfx.h"
+
+#define LAYOUT_MAX_WIDGETS 16  // Widgets in one layout
+#define LAYOUT_MAX_FIELDS 8    // Digit slots in one time or date format
+#define LAYOUT_LINE_MAX 256    // Longest line of a layout file
+
+enum LayoutKind {
+    LAYOUT_TIME,   // HH, MM, SS
+    LAYOUT_DATE,   // YYYY, YY, MM, DD
+    LAYOUT_TEXT,   // Fixed string
+    LAYOUT_IMAGE   // Binary PPM (P6), converted to RGB565 at load
+};
+
+// Draws into framebuffer (either byte order). Text also goes to the indexed
+// framebuffer, images do not. Widgets should not overlap: each one paints
+// its cells opaque.
+class Layout {
+public:
+    Layout();
+    ~Layout();
+
+    // Replace the widgets with those of a layout file. Text is sized by
+    // scale=N (the bitmap digits, N pixels per dot; with a font loaded, the
+    // baked size closest to their height, on the same line) or font=PX (a
+    // baked size, y its top). In idle mode time widgets use their idle=
+    // format, by default the format without seconds. x=center centres the
+    // glyphs. Returns false (with file and line on stderr) if the file
+    // cannot be read or is invalid, or a widget is larger than the display.
+    // Load in the byte order the layout is drawn in (see prepare()).
+    bool load(const char* path, const FontFile& font, bool idle);
+
+    // The built-in face: time centred at y 60 in cyan, date at y 160 in
+    // yellow
+    void loadDefault(const FontFile& font, bool idle);
+
+    // Rasterise the bitmap text's glyph atlases for the current
+    // framebuffer_wire_order; load() and loadDefault() do this, call it
+    // again before drawing in the other byte order
+    void prepare() const;
+
+    // Put a time into the time and date widgets' buffers
+    void format(const struct tm& t);
+
+    // Draw the formatted widgets into the current framebuffer, redrawing
+    // only what the buffer does not already show. The screen areas that
+    // differ from the previous update() are appended to
+    // damage[count..max_rects); returns the new count.
+    int update(DirtyRect* damage, int count, int max_rects);
+
+    // Forget every buffer, so the next update redraws and reports in full
+    void invalidate();
+
+    // Columns any widget can cover, clipped to the display; false if the
+    // layout has no widgets on screen
+    bool columns(int& first, int& last) const;
+
+    int widgetCount() const { return _count; }
+
+private:
+    // Digit slot: two characters of the buffer from a tm field
+    enum FieldValue { FIELD_HOUR, FIELD_MINUTE, FIELD_SECOND, FIELD_CENTURY, FIELD_YEAR,
+                      FIELD_MONTH, FIELD_DAY };
+    struct Field {
+        uint8_t offset;  // Into buffer
+        uint8_t value;   // FieldValue
+    };
+    struct Spec;
+
+    struct Widget {
+        LayoutKind kind;
+        DirtyRect box;         // Everything the widget can cover, fixed at load
+        TextWidget* text;      // Time, date and text widgets
+        int scale;             // Bitmap dot size, 0 for a baked font or an image
+        uint16_t color, bg;
+        char buffer[TEXT_WIDGET_MAX_CHARS + 1];
+        Field fields[LAYOUT_MAX_FIELDS];
+        int fieldCount;
+        std::vector<uint16_t> pixels;  // Image, in framebuffer byte order
+        bool wireOrder;
+        const void* drawn[TEXT_WIDGET_BUFFERS];  // Buffers the image is in
+        int nextEvict;
+        bool reported;
+    };
+
+    Widget _widgets[LAYOUT_MAX_WIDGETS];
+    int _count;
+
+    void clear();
+    bool parseLine(char* line, Spec& spec, const char* path, int line_no) const;
+    bool addWidget(const Spec& spec, const FontFile& font, bool idle, const char* path,
+                   int line_no);
+    bool compileFormat(Widget& widget, const char* format, bool idle) const;
+    int updateImage(Widget& widget, DirtyRect* damage, int count, int max_rects);
+
+    Layout(const Layout&);
+    Layout& operator=(const Layout&);
+};
+
+#endif // LAYOUT_H
@@ -0,0 +1,109 @@
+// RGB565 pixel kernels for the ST7789 display library
+
+#include "pixel_ops.h"
+
+#include <cstring>
+
+#if defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_neon.h>
+#define PIXEL_OPS_NEON 1
+#endif
+
+#ifdef __ARM_FEATURE_CRC32
+#include <arm_acle.h>
+#define PIXEL_OPS_CRC32 1
+#endif
+
+void fill_pixels(uint16_t* dst, uint16_t color, uint32_t count) {
+    uint32_t i = 0;
+#ifdef PIXEL_OPS_NEON
+    uint16x8_t v = vdupq_n_u16(color);
+    for (; i + 16 <= count; i += 16) {
+        vst1q_u16(dst + i, v);
+        vst1q_u16(dst + i + 8, v);
+    }
+    for (; i + 8 <= count; i += 8) {
+        vst1q_u16(dst + i, v);
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = color;
+    }
+}
+
+void fill_pixel_rect(uint16_t* fb, int stride, int x, int y, int w, int h, uint16_t color) {
+    if (w == stride) {
+        // Contiguous rows: one run for the whole rectangle
+        fill_pixels(fb + y * stride, color, (uint32_t)w * h);
+        return;
+    }
+    for (int row = y; row < y + h; row++) {
+        fill_pixels(fb + row * stride + x, color, w);
+    }
+}
+
+void encode_pixels_be(uint8_t* dst, const uint16_t* src, uint32_t count) {
+    uint32_t i = 0;
+#ifdef PIXEL_OPS_NEON
+    // Little-endian lanes: reversing the bytes of each 16-bit lane gives
+    // the big-endian wire order
+    for (; i + 8 <= count; i += 8) {
+        uint8x16_t px = vreinterpretq_u8_u16(vld1q_u16(src + i));
+        vst1q_u8(dst + 2 * i, vrev16q_u8(px));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[2 * i] = src[i] >> 8;
+        dst[2 * i + 1] = src[i] & 0xFF;
+    }
+}
+
+void encode_repeated_be(uint8_t* dst, uint16_t color, uint32_t count) {
+    uint32_t i = 0;
+#ifdef PIXEL_OPS_NEON
+    uint8x16_t v = vreinterpretq_u8_u16(vdupq_n_u16((uint16_t)((color >> 8) | (color << 8))));
+    for (; i + 8 <= count; i += 8) {
+        vst1q_u8(dst + 2 * i, v);
+    }
+#endif
+    for (; i < count; i++) {
+        dst[2 * i] = color >> 8;
+        dst[2 * i + 1] = color & 0xFF;
+    }
+}
+
+uint32_t hash_pixel_rect(const uint16_t* fb, int stride, int x, int y, int w, int h) {
+#ifdef PIXEL_OPS_CRC32
+    uint32_t crc = 0xFFFFFFFFu;
+    for (int row = y; row < y + h; row++) {
+        const uint16_t* src = fb + row * stride + x;
+        int i = 0;
+        for (; i + 4 <= w; i += 4) {
+            uint64_t word;
+            memcpy(&word, src + i, sizeof(word));
+            crc = __crc32cd(crc, word);
+        }
+        for (; i < w; i++) {
+            crc = __crc32ch(crc, src[i]);
+        }
+    }
+    return ~crc;
+#else
+    uint64_t hash = 0x9E3779B97F4A7C15ull;
+    for (int row = y; row < y + h; row++) {
+        const uint16_t* src = fb + row * stride + x;
+        int i = 0;
+        for (; i + 4 <= w; i += 4) {
+            uint64_t word;
+            memcpy(&word, src + i, sizeof(word));
+            hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+            hash ^= hash >> 32;
+        }
+        for (; i < w; i++) {
+            hash = (hash ^ src[i]) * 0xFF51AFD7ED558CCDull;
+            hash ^= hash >> 32;
+        }
+    }
+    return (uint32_t)(hash ^ (hash >> 29));
+#endif
+}
@@ -0,0 +1,39 @@
+// RGB565 pixel kernels for the ST7789 display library
+// ARM NEON when the compiler targets it (__ARM_NEON: aarch64, or 32-bit
+// with -mfpu=neon), portable scalar loops otherwise
+
+#ifndef PIXEL_OPS_H
+#define PIXEL_OPS_H
+
+#include <cstdint>
+
+// RGB565 colour as stored in a wire-order framebuffer: the in-memory bytes
+// are already big-endian, so rows can be handed to the SPI transfer as is.
+// Converting twice gives the host-order colour back.
+inline uint16_t wire_color(uint16_t color) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return color;
+#else
+    return (uint16_t)((color >> 8) | (color << 8));
+#endif
+}
+
+// Set count pixels to color
+void fill_pixels(uint16_t* dst, uint16_t color, uint32_t count);
+
+// Fill a w x h rectangle of a framebuffer with the given row stride (pixels)
+void fill_pixel_rect(uint16_t* fb, int stride, int x, int y, int w, int h, uint16_t color);
+
+// Encode count RGB565 pixels big-endian (panel wire order) into dst, which
+// holds 2 * count bytes
+void encode_pixels_be(uint8_t* dst, const uint16_t* src, uint32_t count);
+
+// Fill 2 * count bytes of dst with color in panel wire order
+void encode_repeated_be(uint8_t* dst, uint16_t color, uint32_t count);
+
+// 32-bit hash of a w x h rectangle of a framebuffer, for telling whether it
+// changed: CRC32C with the ARMv8 CRC instructions (__ARM_FEATURE_CRC32, e.g.
+// -march=armv8-a+crc), a multiply-xorshift mix otherwise
+uint32_t hash_pixel_rect(const uint16_t* fb, int stride, int x, int y, int w, int h);
+
+#endif // PIXEL_OPS_H
@@ -0,0 +1,231 @@
+// Real-time scheduling for the display process
+
+#include "realtime.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <malloc.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define REALTIME_PAGE_FALLBACK 4096  // If sysconf cannot tell the page size
+
+int parseRealtimeOption(int argc, char* argv[], int& i, RealtimeConfig& config) {
+    if (strcmp(argv[i], "--rt-priority") == 0 && i + 1 < argc) {
+        int priority = atoi(argv[++i]);
+        if (priority < sched_get_priority_min(SCHED_FIFO) ||
+            priority > sched_get_priority_max(SCHED_FIFO)) {
+            std::cerr << "Error: --rt-priority must be " << sched_get_priority_min(SCHED_FIFO)
+                      << ".." << sched_get_priority_max(SCHED_FIFO) << std::endl;
+            return -1;
+        }
+        config.priority = priority;
+        return 1;
+    }
+    if (strcmp(argv[i], "--rt-cpu") == 0 && i + 1 < argc) {
+        int cpu = atoi(argv[++i]);
+        long cpus = sysconf(_SC_NPROCESSORS_CONF);
+        if (cpu < 0 || cpu >= cpus || cpu >= CPU_SETSIZE) {
+            std::cerr << "Error: --rt-cpu must be a core number below " << cpus << std::endl;
+            return -1;
+        }
+        config.cpu = cpu;
+        return 1;
+    }
+    if (strcmp(argv[i], "--mlock") == 0) {
+        config.lockMemory = true;
+        return 1;
+    }
+    return 0;
+}
+
+void printRealtimeUsage() {
+    std::cerr << "  --rt-priority N  Run under SCHED_FIFO at priority N (1-99)" << std::endl;
+    std::cerr << "  --rt-cpu N       Pin the flush thread to core N (best kept free with" << std::endl;
+    std::cerr << "                   isolcpus=N on the kernel command line)" << std::endl;
+    std::cerr << "  --mlock          Lock all memory and pre-fault the frame buffers" << std::endl;
+}
+
+bool applyRealtimePolicy(const RealtimeConfig& config) {
+    if (config.priority == 0) {
+        return true;
+    }
+    sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = config.priority;
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err != 0) {
+        std::cerr << "Warning: cannot switch to SCHED_FIFO priority " << config.priority << ": "
+                  << strerror(err) << " (needs root or CAP_SYS_NICE)" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool pinThreadToCpu(pthread_t thread, int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(thread, sizeof(set), &set);
+    if (err != 0) {
+        std::cerr << "Warning: cannot pin thread to cpu " << cpu << ": " << strerror(err)
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool lockProcessMemory() {
+    // One heap, never trimmed: a thread's own malloc arena would be mapped
+    // (and locked) in full, and memory handed back to the kernel would
+    // fault again when reused
+    mallopt(M_ARENA_MAX, 1);
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        std::cerr << "Warning: cannot lock memory: " << strerror(errno)
+                  << " (needs root, CAP_IPC_LOCK or a higher RLIMIT_MEMLOCK)" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static size_t page_size() {
+    long page = sysconf(_SC_PAGESIZE);
+    return page > 0 ? (size_t)page : REALTIME_PAGE_FALLBACK;
+}
+
+void prefaultMemory(void* buf, size_t len) {
+    size_t page = page_size();
+    // Writing back what is there breaks copy-on-write and zero-page
+    // sharing, so each page gets its own frame now
+    volatile char* bytes = static_cast<volatile char*>(buf);
+    for (size_t offset = 0; offset < len; offset += page) {
+        bytes[offset] = bytes[offset];
+    }
+    if (len > 0) {
+        bytes[len - 1] = bytes[len - 1];
+    }
+}
+
+void prefaultStack() {
+    volatile char stack[REALTIME_STACK_PREFAULT];
+    size_t page = page_size();
+    for (size_t offset = 0; offset < sizeof(stack); offset += page) {
+        stack[offset] = 0;
+    }
+}
+
+bool cpuIsolated(int cpu) {
+    FILE* file = fopen("/sys/devices/system/cpu/isolated", "r");
+    if (!file) {
+        return false;
+    }
+    char list[256];
+    bool found = false;
+    if (fgets(list, sizeof(list), file)) {
+        // Comma-separated cores and ranges, e.g. "2-3,5"
+        char* pos = list;
+        while (*pos && !found) {
+            char* end;
+            long first = strtol(pos, &end, 10);
+            if (end == pos) {
+                break;
+            }
+            long last = first;
+            if (*end == '-') {
+                pos = end + 1;
+                last = strtol(pos, &end, 10);
+            }
+            found = cpu >= first && cpu <= last;
+            pos = *end == ',' ? end + 1 : end;
+        }
+    }
+    fclose(file);
+    return found;
+}
+
+static const char* policy_name(int policy) {
+    switch (policy) {
+    case SCHED_FIFO: return "SCHED_FIFO";
+    case SCHED_RR: return "SCHED_RR";
+    case SCHED_OTHER: return "SCHED_OTHER";
+#ifdef SCHED_BATCH
+    case SCHED_BATCH: return "SCHED_BATCH";
+#endif
+#ifdef SCHED_IDLE
+    case SCHED_IDLE: return "SCHED_IDLE";
+#endif
+    default: return "unknown";
+    }
+}
+
+const char* describeThreadScheduling(pthread_t thread, char* buf, size_t len) {
+    int policy;
+    sched_param param;
+    size_t used;
+    if (pthread_getschedparam(thread, &policy, &param) != 0) {
+        used = snprintf(buf, len, "unknown");
+    } else if (policy == SCHED_FIFO || policy == SCHED_RR) {
+        used = snprintf(buf, len, "%s/%d", policy_name(policy), param.sched_priority);
+    } else {
+        used = snprintf(buf, len, "%s", policy_name(policy));
+    }
+
+    cpu_set_t set;
+    if (used >= len || pthread_getaffinity_np(thread, sizeof(set), &set) != 0) {
+        return buf;
+    }
+    int count = CPU_COUNT(&set);
+    if (count == 1) {
+        int cpu = 0;
+        while (!CPU_ISSET(cpu, &set)) {
+            cpu++;
+        }
+        snprintf(buf + used, len - used, " cpu %d (%s)", cpu,
+                 cpuIsolated(cpu) ? "isolated" : "not isolated");
+        return buf;
+    }
+
+    // Affinity as ranges, e.g. "cpus 0-3"
+    used += snprintf(buf + used, len - used, " cpus ");
+    bool first = true;
+    for (int cpu = 0; cpu < CPU_SETSIZE && used < len; cpu++) {
+        if (!CPU_ISSET(cpu, &set)) {
+            continue;
+        }
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &set)) {
+            last++;
+        }
+        if (last > cpu) {
+            used += snprintf(buf + used, len - used, "%s%d-%d", first ? "" : ",", cpu, last);
+        } else {
+            used += snprintf(buf + used, len - used, "%s%d", first ? "" : ",", cpu);
+        }
+        first = false;
+        cpu = last;
+    }
+    return buf;
+}
+
+long lockedMemoryKb() {
+    FILE* file = fopen("/proc/self/status", "r");
+    if (!file) {
+        return -1;
+    }
+    char line[128];
+    long kb = -1;
+    while (fgets(line, sizeof(line), file)) {
+        if (strncmp(line, "VmLck:", 6) == 0) {
+            kb = strtol(line + 6, nullptr, 10);
+            break;
+        }
+    }
+    fclose(file);
+    return kb;
+}
@@ -0,0 +1,61 @@
+// Real-time scheduling for the display process
+// The bit-banged SPI link is timed by the CPU: if the flush thread is
+// preempted mid-frame the transfer stretches and the panel tears. These
+// helpers put the process under SCHED_FIFO, pin a thread to a core (ideally
+// one kept free with isolcpus=), lock memory and pre-fault buffers so a
+// frame never waits on a page fault, and report what was actually achieved.
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <cstddef>
+#include <pthread.h>
+
+#define REALTIME_STACK_PREFAULT (256 * 1024)  // Bytes of stack touched by prefaultStack()
+
+struct RealtimeConfig {
+    int priority;     // SCHED_FIFO priority 1..99; 0 keeps normal scheduling
+    int cpu;          // Core the flush thread is pinned to; -1 for any
+    bool lockMemory;  // mlockall, and pre-fault the frame buffers
+
+    RealtimeConfig() : priority(0), cpu(-1), lockMemory(false) {}
+};
+
+// Parse a real-time option at argv[i], advancing i past its value.
+// Returns 1 if consumed, 0 if argv[i] is not a real-time option, -1 if the
+// value is invalid (an error has been printed).
+int parseRealtimeOption(int argc, char* argv[], int& i, RealtimeConfig& config);
+
+// Usage lines for the options parseRealtimeOption understands
+void printRealtimeUsage();
+
+// Put the calling thread under SCHED_FIFO at config.priority; threads it
+// creates later inherit the policy, and so does a program it execs.
+// Returns true if nothing was asked for. Failures print a warning and
+// leave the thread as it was.
+bool applyRealtimePolicy(const RealtimeConfig& config);
+
+// Restrict a thread to one core. Failures print a warning.
+bool pinThreadToCpu(pthread_t thread, int cpu);
+
+// mlockall(MCL_CURRENT | MCL_FUTURE): every page now mapped and every page
+// mapped later stays resident. Failures print a warning.
+bool lockProcessMemory();
+
+// Touch every page of buf so it is backed before the first frame needs it
+void prefaultMemory(void* buf, size_t len);
+
+// Likewise for the calling thread's stack, REALTIME_STACK_PREFAULT deep
+void prefaultStack();
+
+// The core is listed in /sys/devices/system/cpu/isolated
+bool cpuIsolated(int cpu);
+
+// Policy and cores a thread actually runs with, e.g.
+// "SCHED_FIFO/50 cpu 3 (isolated)" or "SCHED_OTHER cpus 0-3"
+const char* describeThreadScheduling(pthread_t thread, char* buf, size_t len);
+
+// Locked memory of this process (VmLck), in kB; -1 if unknown
+long lockedMemoryKb();
+
+#endif // REALTIME_H
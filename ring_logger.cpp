@@ -0,0 +1,257 @@
+// Buffered background logger for failsafe and clock
+
+#include "ring_logger.h"
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// write() the whole range, retrying on EINTR and short writes
+static void write_all(int fd, const char* data, uint32_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        data += n;
+        len -= (uint32_t)n;
+    }
+}
+
+RingLogger::RingLogger()
+    : _active(0), _used(0), _queued(0), _flushed(0), _dropped(0),
+      _running(false), _flushRequested(false), _direct(false),
+      _path(nullptr), _fd(-1), _echo(true), _fileBytes(0),
+      _rotateBytes(LOG_ROTATE_BYTES), _owner(0) {}
+
+RingLogger::~RingLogger() {
+    close();
+}
+
+bool RingLogger::open(const char* path, bool echo, uint64_t rotateBytes) {
+    if (_running) {
+        return true;
+    }
+
+    bool ok = true;
+    _path = path;
+    _echo = echo;
+    _rotateBytes = rotateBytes;
+    if (path) {
+        // Kept open for the life of the logger, and not inherited by exec'd children
+        _fd = ::open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (_fd < 0) {
+            std::cerr << "Warning: cannot open log file " << path << ": " << strerror(errno)
+                      << std::endl;
+            ok = false;
+        } else {
+            struct stat st;
+            _fileBytes = fstat(_fd, &st) == 0 ? (uint64_t)st.st_size : 0;
+        }
+    }
+
+    _owner = getpid();
+    _running = true;
+    _direct = false;
+    _writer = std::thread(&RingLogger::writerLoop, this);
+    return ok;
+}
+
+void RingLogger::close() {
+    if (!_writer.joinable() || getpid() != _owner) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _running = false;
+    }
+    _wake.notify_one();
+    _writer.join();
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+void RingLogger::log(const char* format, ...) {
+    char line[LOG_LINE_MAX];
+    time_t now = time(nullptr);
+    struct tm local;
+    localtime_r(&now, &local);
+    int len = (int)strftime(line, sizeof(line), "[%Y-%m-%d %H:%M:%S] ", &local);
+
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(line + len, sizeof(line) - len - 1, format, args);
+    va_end(args);
+    if (n < 0) n = 0;
+    len += n;
+    if (len > LOG_LINE_MAX - 2) len = LOG_LINE_MAX - 2;
+    line[len++] = '\n';
+
+    // Not the writer's process (a forked child) or not started: the
+    // writer thread is not there to pick the line up
+    if (getpid() != _owner) {
+        writeOut(line, len);
+        return;
+    }
+
+    bool wake = false;
+    bool direct;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        direct = _direct;
+        if (direct) {
+            // Written below, outside the lock
+        } else if (_used + len > LOG_BUFFER_BYTES) {
+            _dropped++;
+            return;
+        } else {
+            memcpy(_buffers[_active] + _used, line, len);
+            _used += len;
+            _queued++;
+            // While stopping, the writer drains before it exits
+            wake = _used > LOG_BUFFER_BYTES / 2 || !_running;
+        }
+    }
+    if (direct) {
+        // The writer has exited, and the file with it: stdout only, which
+        // needs no state shared with close()
+        write_all(STDOUT_FILENO, line, len);
+    } else if (wake) {
+        _wake.notify_one();
+    }
+}
+
+void RingLogger::flush() {
+    if (getpid() != _owner) {
+        return;
+    }
+    std::unique_lock<std::mutex> guard(_lock);
+    if (!_running) {
+        return;
+    }
+    uint64_t target = _queued;
+    _flushRequested = true;
+    _wake.notify_one();
+    _written.wait(guard, [this, target] { return _flushed >= target || !_running; });
+}
+
+uint64_t RingLogger::dropped() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _dropped;
+}
+
+// Swap buffers under the lock, write the full one without it, so callers
+// only ever wait for a memcpy
+void RingLogger::writerLoop() {
+    // File writes and rotation are background work: a writer that inherited
+    // SCHED_FIFO could hold a real-time core while the disk is slow
+    sched_param param;
+    memset(&param, 0, sizeof(param));
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+
+    std::unique_lock<std::mutex> guard(_lock);
+    while (true) {
+        _wake.wait_for(guard, std::chrono::milliseconds(LOG_FLUSH_MS), [this] {
+            return !_running || _flushRequested || _used > LOG_BUFFER_BYTES / 2;
+        });
+
+        int full = _active;
+        uint32_t len = _used;
+        uint64_t lines = _queued;
+        _active ^= 1;
+        _used = 0;
+        _flushRequested = false;
+
+        guard.unlock();
+        if (len > 0) {
+            writeOut(_buffers[full], len);
+            if (_fd >= 0 && _fileBytes >= _rotateBytes) {
+                rotate();
+            }
+        }
+        guard.lock();
+
+        _flushed = lines;
+        _written.notify_all();
+        if (!_running && _used == 0) {
+            // Decided under the lock, so no line is queued after the last
+            // drain: later ones go straight to stdout
+            _direct = true;
+            break;
+        }
+    }
+}
+
+void RingLogger::writeOut(const char* data, uint32_t len) {
+    if (_echo || _fd < 0) {
+        write_all(STDOUT_FILENO, data, len);
+    }
+    if (_fd >= 0) {
+        write_all(_fd, data, len);
+        _fileBytes += len;
+    }
+}
+
+// Keep one previous file: <path> becomes <path>.1
+void RingLogger::rotate() {
+    char old_path[256];
+    snprintf(old_path, sizeof(old_path), "%s.1", _path);
+    ::close(_fd);
+    rename(_path, old_path);
+    _fd = ::open(_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    _fileBytes = 0;
+}
+
+void RingLogger::crashFlush() {
+    // No lock: the crashing thread may hold it. A line the writer is
+    // writing at the same moment can come out twice.
+    uint32_t len = _used;
+    if (len > LOG_BUFFER_BYTES) {
+        return;
+    }
+    const char* data = _buffers[_active];
+    if (_echo || _fd < 0) {
+        write_all(STDOUT_FILENO, data, len);
+    }
+    if (_fd >= 0) {
+        write_all(_fd, data, len);
+        fsync(_fd);
+    }
+}
+
+static RingLogger* crash_logger = nullptr;
+
+static void crash_handler(int signo) {
+    if (crash_logger) {
+        crash_logger->crashFlush();
+    }
+    // SA_RESETHAND restored the default action
+    raise(signo);
+}
+
+void RingLogger::installCrashHandler() {
+    crash_logger = this;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = crash_handler;
+    action.sa_flags = SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+    const int fatal[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+    for (size_t i = 0; i < sizeof(fatal) / sizeof(fatal[0]); i++) {
+        sigaction(fatal[i], &action, nullptr);
+    }
+}
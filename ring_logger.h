@@ -0,0 +1,84 @@
+// Buffered background logger for failsafe and clock
+// Callers format a line into an in-memory buffer and return; a writer
+// thread batches the lines to stdout and a log file it keeps open, and
+// rotates the file by size. The writer always runs under normal
+// scheduling, even when opened from a SCHED_FIFO thread.
+
+#ifndef RING_LOGGER_H
+#define RING_LOGGER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <sys/types.h>
+#include <thread>
+
+#define LOG_BUFFER_BYTES 32768          // Per buffer; two are swapped by the writer
+#define LOG_LINE_MAX 512                // Longer lines are truncated
+#define LOG_FLUSH_MS 200                // Writer wakes at least this often
+#define LOG_ROTATE_BYTES (1024 * 1024)  // File is renamed to <path>.1 past this size
+
+class RingLogger {
+public:
+    RingLogger();
+    ~RingLogger();
+
+    // Start the writer. path may be nullptr for stdout only; echo copies
+    // every line to stdout as well. Returns false if the file cannot be
+    // opened (the logger still writes to stdout).
+    bool open(const char* path, bool echo = true, uint64_t rotateBytes = LOG_ROTATE_BYTES);
+
+    // Write out everything queued and stop the writer
+    void close();
+
+    // Queue one timestamped line. Never waits for I/O: if the buffer is full
+    // the line is dropped and counted. In a forked child (no writer thread)
+    // the line is written directly, and after close() it goes to stdout.
+    void log(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+    // Wake the writer and wait until everything queued so far is written
+    void flush();
+
+    // Lines lost to a full buffer
+    uint64_t dropped() const;
+
+    // Write queued lines from a fatal signal handler (SIGSEGV, SIGABRT, ...)
+    // installed by installCrashHandler(). Only async-signal-safe calls.
+    void crashFlush();
+
+    // Flush this logger on SIGSEGV, SIGBUS, SIGFPE, SIGILL and SIGABRT, then
+    // re-raise the signal with its default action
+    void installCrashHandler();
+
+private:
+    mutable std::mutex _lock;
+    std::condition_variable _wake;
+    std::condition_variable _written;
+    std::thread _writer;
+
+    char _buffers[2][LOG_BUFFER_BYTES];
+    int _active;           // Buffer callers append to; the writer owns the other
+    uint32_t _used;        // Bytes in the active buffer
+    uint64_t _queued;      // Lines queued since open()
+    uint64_t _flushed;     // Lines written out
+    uint64_t _dropped;
+    bool _running;
+    bool _flushRequested;
+    bool _direct;  // Writer finished: log() writes to stdout itself
+
+    const char* _path;
+    int _fd;
+    bool _echo;
+    uint64_t _fileBytes;
+    uint64_t _rotateBytes;
+    pid_t _owner;  // Process the writer thread runs in
+
+    void writerLoop();
+    void writeOut(const char* data, uint32_t len);
+    void rotate();
+
+    RingLogger(const RingLogger&);
+    RingLogger& operator=(const RingLogger&);
+};
+
+#endif // RING_LOGGER_H
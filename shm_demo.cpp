@@ -0,0 +1,137 @@
+// Example client of the shared framebuffer (320x240, 90° rotation)
+// Draws the system uptime and a load-average bar graph into the frames of
+// "clock --shm /st7789"; needs neither root nor the bcm2835 library
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <signal.h>
+#include <sys/sysinfo.h>
+#include <unistd.h>
+
+#include "gfx.h"
+#include "shm_framebuffer.h"
+
+#define UPTIME_Y 30
+#define UPTIME_SCALE 6
+#define BARS_Y 110
+#define BARS_HEIGHT 110
+#define BAR_WIDTH 60
+#define BAR_GAP 30
+
+volatile bool running = true;
+
+void signal_handler(int signo) {
+    running = false;
+}
+
+// Load averages (1, 5 and 15 minutes) as a fraction of the CPUs, 0..1
+static void read_load(double* load) {
+    if (getloadavg(load, 3) != 3) {
+        load[0] = load[1] = load[2] = 0;
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 0; i < 3; i++) {
+        load[i] /= cpus > 0 ? cpus : 1;
+        if (load[i] > 1) load[i] = 1;
+    }
+}
+
+void print_usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [--shm NAME]" << std::endl;
+    std::cerr << "  --shm NAME  Shared framebuffer of the display owner (default "
+              << SHM_FB_DEFAULT_NAME << ")" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    const char* name = SHM_FB_DEFAULT_NAME;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+            name = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    ShmFramebuffer shm;
+    if (!shm.attach(name)) {
+        std::cerr << "Is the owner running? Try: sudo ./clock --shm " << name << std::endl;
+        return 1;
+    }
+    std::cout << "Drawing into " << name << std::endl;
+
+    // The owner sends frames in wire order
+    framebuffer_wire_order = true;
+
+    char last_uptime[32] = "";
+    int last_bars[3] = {-1, -1, -1};
+    bool cleared = false;
+    const int bars_x = (DISPLAY_WIDTH - 3 * BAR_WIDTH - 2 * BAR_GAP) / 2;
+    const uint16_t bar_colors[3] = {COLOR_GREEN, COLOR_YELLOW, COLOR_RED};
+
+    while (running) {
+        framebuffer = shm.beginFrame();
+        if (framebuffer == nullptr) {
+            // The owner stopped flushing (restarted or gone): attach afresh
+            std::cerr << "Owner not responding, attaching again" << std::endl;
+            shm.close();
+            while (running && !shm.attach(name)) {
+                sleep(1);
+            }
+            cleared = false;
+            continue;
+        }
+
+        // The back frame holds whatever was shown before we attached
+        if (!cleared) {
+            draw_rect(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, COLOR_BLACK);
+            shm.addDamage(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+            last_uptime[0] = '\0';
+            last_bars[0] = last_bars[1] = last_bars[2] = -1;
+            cleared = true;
+        }
+
+        // Uptime, redrawn only when it changes
+        struct sysinfo info;
+        long uptime = sysinfo(&info) == 0 ? info.uptime : 0;
+        char uptime_str[32];
+        snprintf(uptime_str, sizeof(uptime_str), "%02ld:%02ld:%02ld",
+                 uptime / 3600 % 100, uptime / 60 % 60, uptime % 60);
+        if (strcmp(uptime_str, last_uptime) != 0) {
+            int w = text_ink_width(uptime_str, UPTIME_SCALE);
+            int x = (DISPLAY_WIDTH - w) / 2;
+            draw_rect(0, UPTIME_Y, DISPLAY_WIDTH, 7 * UPTIME_SCALE, COLOR_BLACK);
+            draw_text(x, UPTIME_Y, uptime_str, COLOR_CYAN, UPTIME_SCALE);
+            shm.addDamage(0, UPTIME_Y, DISPLAY_WIDTH, 7 * UPTIME_SCALE);
+            strcpy(last_uptime, uptime_str);
+        }
+
+        // One bar per load average; only bars whose height changed
+        double load[3];
+        read_load(load);
+        for (int i = 0; i < 3; i++) {
+            int h = (int)(load[i] * BARS_HEIGHT + 0.5);
+            if (h < 1) h = 1;
+            if (h == last_bars[i]) {
+                continue;
+            }
+            int x = bars_x + i * (BAR_WIDTH + BAR_GAP);
+            draw_rect(x, BARS_Y, BAR_WIDTH, BARS_HEIGHT - h, COLOR_BLACK);
+            draw_rect(x, BARS_Y + BARS_HEIGHT - h, BAR_WIDTH, h, bar_colors[i]);
+            shm.addDamage(x, BARS_Y, BAR_WIDTH, BARS_HEIGHT);
+            last_bars[i] = h;
+        }
+
+        shm.submit();
+        sleep(1);
+    }
+
+    shm.close();
+    return 0;
+}
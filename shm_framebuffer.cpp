@@ -0,0 +1,295 @@
+// Shared-memory framebuffer between the display owner and one client
+
+#include "shm_framebuffer.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "latency_histogram.h"
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "futex words must be plain 32-bit integers");
+
+// Process-shared futex on a word of the segment: sleep while it still
+// holds expected, at most timeout_ms
+static void futex_wait(std::atomic<uint32_t>& word, uint32_t expected, int timeout_ms) {
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &timeout,
+            nullptr, 0);
+}
+
+static void futex_wake(std::atomic<uint32_t>& word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+// a is later than b, allowing for wrap-around
+static bool sequence_after(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) > 0;
+}
+
+ShmFramebuffer::ShmFramebuffer()
+    : _name(nullptr), _owner(false), _base(nullptr), _header(nullptr),
+      _lastFlushed(0), _tail(0), _resync(true),
+      _submitted(0), _copyAll(true), _damageCount(0), _lastDamageCount(0) {}
+
+ShmFramebuffer::~ShmFramebuffer() {
+    close();
+}
+
+bool ShmFramebuffer::map(const char* name, bool create) {
+    int fd = shm_open(name, create ? O_RDWR | O_CREAT : O_RDWR, 0666);
+    if (fd < 0) {
+        std::cerr << "Error: cannot open shared framebuffer " << name << ": "
+                  << strerror(errno) << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    bool fresh = fstat(fd, &st) != 0 || (size_t)st.st_size != SHM_FB_SIZE;
+    if (fresh && !create) {
+        std::cerr << "Error: " << name << " is not a shared framebuffer of this version" << std::endl;
+        ::close(fd);
+        return false;
+    }
+    if (create) {
+        // Clients run as any user; the umask would take their write access
+        fchmod(fd, 0666);
+        if (fresh && ftruncate(fd, SHM_FB_SIZE) != 0) {
+            std::cerr << "Error: cannot size shared framebuffer " << name << ": "
+                      << strerror(errno) << std::endl;
+            ::close(fd);
+            return false;
+        }
+    }
+
+    void* base = mmap(nullptr, SHM_FB_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "Error: cannot map shared framebuffer " << name << ": "
+                  << strerror(errno) << std::endl;
+        return false;
+    }
+    _base = static_cast<uint8_t*>(base);
+    _header = reinterpret_cast<ShmFramebufferHeader*>(_base);
+    _name = name;
+
+    bool valid = _header->magic == SHM_FB_MAGIC && _header->version == SHM_FB_VERSION &&
+                 _header->width == DISPLAY_WIDTH && _header->height == DISPLAY_HEIGHT;
+    if (create && (fresh || !valid)) {
+        // Zeroed frames are black in either byte order
+        memset(_base, 0, SHM_FB_SIZE);
+        _header->version = SHM_FB_VERSION;
+        _header->width = DISPLAY_WIDTH;
+        _header->height = DISPLAY_HEIGHT;
+        std::atomic_thread_fence(std::memory_order_release);
+        _header->magic = SHM_FB_MAGIC;
+    } else if (!valid) {
+        std::cerr << "Error: " << name << " is not a shared framebuffer of this version" << std::endl;
+        munmap(_base, SHM_FB_SIZE);
+        _base = nullptr;
+        _header = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool ShmFramebuffer::create(const char* name) {
+    if (!map(name, true)) {
+        return false;
+    }
+    _owner = true;
+
+    // Carry on from whatever a previous owner left; the first flush
+    // compares the whole frame
+    _lastFlushed = _header->flushed.load(std::memory_order_acquire);
+    _tail = _header->damageHead.load(std::memory_order_acquire);
+    _resync = true;
+    return true;
+}
+
+bool ShmFramebuffer::attach(const char* name) {
+    if (!map(name, false)) {
+        return false;
+    }
+
+    // One client at a time; a claim left by a dead client is taken over.
+    // EPERM means the claimant exists but runs as another user.
+    pid_t self = getpid();
+    pid_t claimant = _header->client.load(std::memory_order_acquire);
+    bool alive = claimant != 0 && claimant != self && (kill(claimant, 0) == 0 || errno == EPERM);
+    if (alive || !_header->client.compare_exchange_strong(claimant, self)) {
+        std::cerr << "Error: " << name << " is in use by client " << claimant << std::endl;
+        munmap(_base, SHM_FB_SIZE);
+        _base = nullptr;
+        _header = nullptr;
+        return false;
+    }
+
+    _submitted = _header->submitted.load(std::memory_order_acquire);
+    _copyAll = true;
+    _damageCount = 0;
+    _lastDamageCount = 0;
+    return true;
+}
+
+void ShmFramebuffer::close() {
+    if (!_base) {
+        return;
+    }
+    if (_owner) {
+        shm_unlink(_name);
+    } else {
+        pid_t self = getpid();
+        _header->client.compare_exchange_strong(self, 0);
+    }
+    munmap(_base, SHM_FB_SIZE);
+    _base = nullptr;
+    _header = nullptr;
+    _owner = false;
+}
+
+uint16_t* ShmFramebuffer::buffer(uint32_t sequence) const {
+    return reinterpret_cast<uint16_t*>(_base + SHM_FB_FRAMES_OFFSET) +
+           (size_t)(sequence % SHM_FB_BUFFERS) * SHM_FB_FRAME_PIXELS;
+}
+
+// ---------------------------------------------------------------------------
+// Owner side
+// ---------------------------------------------------------------------------
+
+uint32_t ShmFramebuffer::waitForFrame(int timeoutMs) {
+    uint32_t sequence = _header->submitted.load(std::memory_order_acquire);
+    if (sequence == _lastFlushed) {
+        futex_wait(_header->submitted, sequence, timeoutMs);
+        sequence = _header->submitted.load(std::memory_order_acquire);
+    }
+    return sequence != _lastFlushed ? sequence : 0;
+}
+
+uint32_t ShmFramebuffer::latest() const {
+    return _header->submitted.load(std::memory_order_acquire);
+}
+
+const uint16_t* ShmFramebuffer::frame(uint32_t sequence) const {
+    return buffer(sequence);
+}
+
+int ShmFramebuffer::collectDamage(uint32_t sequence, DirtyRect* rects, int max_rects) {
+    bool unknown = _resync;
+    _resync = false;
+
+    uint32_t head = _header->damageHead.load(std::memory_order_acquire);
+    if (head - _tail > SHM_FB_RING) {
+        // The client got a whole ring ahead of us
+        _tail = head;
+        _resync = true;
+        return -1;
+    }
+
+    // Entries of frames after sequence stay for the next flush
+    uint32_t start = _tail;
+    int count = 0;
+    while (_tail != head) {
+        const ShmDamage& entry = _header->ring[_tail % SHM_FB_RING];
+        if (sequence_after(entry.sequence, sequence)) {
+            break;
+        }
+        count = add_dirty_rect(rects, count, max_rects, entry.x, entry.y, entry.w, entry.h);
+        _tail++;
+    }
+
+    // The client may already be writing the next frame's entries; if it
+    // wrapped onto the ones just read they cannot be trusted
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (_header->damageHead.load(std::memory_order_relaxed) - start > SHM_FB_RING) {
+        _tail = _header->damageHead.load(std::memory_order_relaxed);
+        _resync = true;
+        return -1;
+    }
+    return unknown ? -1 : count;
+}
+
+void ShmFramebuffer::markFlushed(uint32_t sequence) {
+    _lastFlushed = sequence;
+    _header->flushed.store(sequence, std::memory_order_release);
+    futex_wake(_header->flushed);
+}
+
+// ---------------------------------------------------------------------------
+// Client side
+// ---------------------------------------------------------------------------
+
+uint16_t* ShmFramebuffer::beginFrame() {
+    uint32_t next = _submitted + 1;
+
+    // The back buffer last held frame next - 2; wait until the owner has
+    // moved past it
+    int64_t deadline = monotonic_ns() + (int64_t)SHM_FB_TIMEOUT_MS * 1000000LL;
+    while (true) {
+        uint32_t flushed = _header->flushed.load(std::memory_order_acquire);
+        if (!sequence_after(next - 2, flushed)) {
+            break;
+        }
+        int64_t left_ms = (deadline - monotonic_ns()) / 1000000LL;
+        if (left_ms <= 0) {
+            return nullptr;
+        }
+        futex_wait(_header->flushed, flushed, (int)left_ms);
+    }
+
+    // Bring it up to the last submitted frame: only what that frame changed
+    // differs, unless the contents are unknown
+    uint16_t* back = buffer(next);
+    const uint16_t* last = buffer(next - 1);
+    if (_copyAll) {
+        memcpy(back, last, SHM_FB_FRAME_PIXELS * sizeof(uint16_t));
+    } else {
+        for (int i = 0; i < _lastDamageCount; i++) {
+            const DirtyRect& r = _lastDamage[i];
+            for (int y = r.y; y < r.y + r.h; y++) {
+                memcpy(back + y * DISPLAY_WIDTH + r.x, last + y * DISPLAY_WIDTH + r.x,
+                       r.w * sizeof(uint16_t));
+            }
+        }
+    }
+    _damageCount = 0;
+    return back;
+}
+
+void ShmFramebuffer::addDamage(int x, int y, int w, int h) {
+    _damageCount = add_dirty_rect(_damage, _damageCount, DAMAGE_MAX_RECTS, x, y, w, h);
+}
+
+void ShmFramebuffer::submit() {
+    uint32_t sequence = _submitted + 1;
+
+    // Ring entries first, then the frame that refers to them
+    uint32_t head = _header->damageHead.load(std::memory_order_relaxed);
+    for (int i = 0; i < _damageCount; i++) {
+        ShmDamage& entry = _header->ring[head++ % SHM_FB_RING];
+        entry.sequence = sequence;
+        entry.x = _damage[i].x;
+        entry.y = _damage[i].y;
+        entry.w = _damage[i].w;
+        entry.h = _damage[i].h;
+    }
+    _header->damageHead.store(head, std::memory_order_release);
+    _header->submitted.store(sequence, std::memory_order_release);
+    futex_wake(_header->submitted);
+
+    _submitted = sequence;
+    memcpy(_lastDamage, _damage, _damageCount * sizeof(DirtyRect));
+    _lastDamageCount = _damageCount;
+    _copyAll = false;
+}
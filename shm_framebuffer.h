@@ -0,0 +1,114 @@
+// Shared-memory framebuffer between the display owner and one client
+// The owner (clock --shm NAME) maps two frames, a ring of damage rectangles
+// and two futex doorbells into /dev/shm. A client needs no GPIO access: it
+// draws into the back frame, lists what it changed and submits; the owner
+// partial-refreshes the panel straight from the shared frame.
+
+#ifndef SHM_FRAMEBUFFER_H
+#define SHM_FRAMEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+#include <sys/types.h>
+
+#include "gfx.h"
+
+#define SHM_FB_DEFAULT_NAME "/st7789"
+#define SHM_FB_MAGIC 0x53543738u  // "ST78"
+#define SHM_FB_VERSION 1
+#define SHM_FB_BUFFERS 2          // Frame n is stored in buffer n % 2
+#define SHM_FB_RING 256           // Damage rectangles in flight
+#define SHM_FB_TIMEOUT_MS 2000    // Client gives up on an owner that stopped flushing
+
+// One rectangle of the damage ring, tagged with the frame it belongs to
+struct ShmDamage {
+    uint32_t sequence;
+    int16_t x, y, w, h;
+};
+
+// Start of the segment; the frames follow at SHM_FB_FRAMES_OFFSET. Frames
+// hold RGB565 in panel wire order (see wire_color() in pixel_ops.h).
+struct ShmFramebufferHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    std::atomic<uint32_t> submitted;   // Last frame submitted; the owner's doorbell
+    std::atomic<uint32_t> flushed;     // Last frame on the panel; the client's doorbell
+    std::atomic<uint32_t> damageHead;  // Rectangles written to ring so far
+    std::atomic<pid_t> client;         // Attached client, 0 if none
+    ShmDamage ring[SHM_FB_RING];
+};
+
+#define SHM_FB_FRAMES_OFFSET ((sizeof(ShmFramebufferHeader) + 4095) & ~(size_t)4095)
+#define SHM_FB_FRAME_PIXELS (DISPLAY_WIDTH * DISPLAY_HEIGHT)
+#define SHM_FB_SIZE (SHM_FB_FRAMES_OFFSET + SHM_FB_BUFFERS * SHM_FB_FRAME_PIXELS * sizeof(uint16_t))
+
+class ShmFramebuffer {
+public:
+    ShmFramebuffer();
+    ~ShmFramebuffer();
+
+    // Owner: create the segment (name like "/st7789"), readable and writable
+    // by every user. A segment left by a previous owner is reused with its
+    // frames and counters, so a restarted owner shows the client's last
+    // frame and the client carries on.
+    bool create(const char* name);
+
+    // Client: map an existing segment and claim it. Fails if no owner has
+    // created it or another live client is attached.
+    bool attach(const char* name);
+
+    // Unmap; the owner also unlinks the name, a client releases its claim
+    void close();
+
+    // Owner: wait up to timeoutMs for a frame newer than the last flushed
+    // one. Returns its sequence number, 0 on timeout or signal.
+    uint32_t waitForFrame(int timeoutMs);
+
+    // Owner: last frame submitted (0: none yet, both frames are black)
+    uint32_t latest() const;
+
+    const uint16_t* frame(uint32_t sequence) const;
+
+    // Owner: damage of every frame submitted after the last flushed one up
+    // to sequence, or -1 if it is unknown (first frame, ring overrun) and
+    // the whole frame must be compared
+    int collectDamage(uint32_t sequence, DirtyRect* rects, int max_rects);
+
+    // Owner: sequence is on the panel; wakes a client waiting for a buffer
+    void markFlushed(uint32_t sequence);
+
+    // Client: wait until the back buffer is free and return it, holding the
+    // last submitted frame. nullptr if the owner stopped flushing.
+    uint16_t* beginFrame();
+
+    // Client: record a changed area of the frame being drawn
+    void addDamage(int x, int y, int w, int h);
+
+    // Client: hand the frame to the owner
+    void submit();
+
+private:
+    const char* _name;
+    bool _owner;
+    uint8_t* _base;
+    ShmFramebufferHeader* _header;
+    uint32_t _lastFlushed;  // Owner: last frame sent
+    uint32_t _tail;         // Owner: next ring entry to read
+    bool _resync;           // Owner: next collectDamage() returns -1
+    uint32_t _submitted;    // Client: last frame submitted
+    bool _copyAll;          // Client: back buffer contents unknown
+    DirtyRect _damage[DAMAGE_MAX_RECTS];  // Client: this frame's damage
+    int _damageCount;
+    DirtyRect _lastDamage[DAMAGE_MAX_RECTS];  // Client: the previous frame's
+    int _lastDamageCount;
+
+    bool map(const char* name, bool create);
+    uint16_t* buffer(uint32_t sequence) const;
+
+    ShmFramebuffer(const ShmFramebuffer&);
+    ShmFramebuffer& operator=(const ShmFramebuffer&);
+};
+
+#endif // SHM_FRAMEBUFFER_H
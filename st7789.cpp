@@ -0,0 +1,208 @@
+// ST7789 display library (320x240, 90° rotation)
+// Driver core and mock transport; no bcm2835 dependency
+
+#include "st7789.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+#include "pixel_ops.h"
+
+// ---------------------------------------------------------------------------
+// ST7789_Transport
+// ---------------------------------------------------------------------------
+
+void ST7789_Transport::writePixels(const uint16_t* pixels, uint32_t count) {
+    uint8_t chunk[ST7789_PIXEL_CHUNK * 2];
+    while (count > 0) {
+        uint32_t n = count < ST7789_PIXEL_CHUNK ? count : ST7789_PIXEL_CHUNK;
+        encode_pixels_be(chunk, pixels, n);
+        write(chunk, n * 2);
+        pixels += n;
+        count -= n;
+    }
+}
+
+void ST7789_Transport::writeRepeated(uint16_t color, uint32_t count) {
+    uint8_t chunk[ST7789_PIXEL_CHUNK * 2];
+    uint32_t n = count < ST7789_PIXEL_CHUNK ? count : ST7789_PIXEL_CHUNK;
+    encode_repeated_be(chunk, color, n);
+    while (count > 0) {
+        n = count < ST7789_PIXEL_CHUNK ? count : ST7789_PIXEL_CHUNK;
+        write(chunk, n * 2);
+        count -= n;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// NullTransport
+// ---------------------------------------------------------------------------
+
+// MOSI level changes while shifting out a byte MSB first, indexed by the
+// starting level and the byte
+static uint8_t mosi_edges[2][256];
+
+static void init_mosi_edges() {
+    for (int start = 0; start < 2; start++) {
+        for (int byte = 0; byte < 256; byte++) {
+            int level = start;
+            int edges = 0;
+            for (int bit = 7; bit >= 0; bit--) {
+                int next = (byte >> bit) & 1;
+                if (next != level) edges++;
+                level = next;
+            }
+            mosi_edges[start][byte] = edges;
+        }
+    }
+}
+
+NullTransport::NullTransport()
+    : bytes(0), transfers(0), pinToggles(0), busToggles(0),
+      _reset(true), _dataMode(false), _selected(false), _mosi(0) {
+    if (mosi_edges[1][0] == 0) {
+        init_mosi_edges();
+    }
+}
+
+void NullTransport::resetCounters() {
+    bytes = 0;
+    transfers = 0;
+    pinToggles = 0;
+    busToggles = 0;
+}
+
+bool NullTransport::begin() {
+    return true;
+}
+
+void NullTransport::end() {}
+
+void NullTransport::setReset(bool high) {
+    if (high != _reset) pinToggles++;
+    _reset = high;
+}
+
+void NullTransport::setDataMode(bool data) {
+    if (data != _dataMode) pinToggles++;
+    _dataMode = data;
+}
+
+void NullTransport::select() {
+    if (!_selected) pinToggles++;
+    _selected = true;
+}
+
+void NullTransport::deselect() {
+    if (_selected) pinToggles++;
+    _selected = false;
+}
+
+void NullTransport::write(const uint8_t* buf, uint32_t len) {
+    uint64_t edges = 0;
+    uint8_t level = _mosi;
+    for (uint32_t i = 0; i < len; i++) {
+        edges += mosi_edges[level][buf[i]];
+        level = buf[i] & 1;
+    }
+    _mosi = level;
+
+    bytes += len;
+    transfers++;
+    busToggles += edges + (uint64_t)len * 16;  // SCLK falls and rises per bit
+}
+
+void NullTransport::delayMs(unsigned int ms) {
+    (void)ms;
+}
+
+// ---------------------------------------------------------------------------
+// State file
+// ---------------------------------------------------------------------------
+
+static const char state_magic[] = "st7789 on\n";
+
+bool st7789_state_valid(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    char line[32];
+    bool valid = fgets(line, sizeof(line), file) && strcmp(line, state_magic) == 0;
+    fclose(file);
+    return valid;
+}
+
+void st7789_state_write(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        std::cerr << "Warning: cannot write " << path << ", next start will be cold" << std::endl;
+        return;
+    }
+    fputs(state_magic, file);
+    fclose(file);
+}
+
+void st7789_state_remove(const char* path) {
+    unlink(path);
+}
+
+// ---------------------------------------------------------------------------
+// ST7789_Driver
+// ---------------------------------------------------------------------------
+
+// Compiled once here; every other user sees the extern declaration
+template class ST7789_DriverT<ST7789_DefaultConfig>;
+
+// ---------------------------------------------------------------------------
+// ScrollRegion
+// ---------------------------------------------------------------------------
+
+ScrollRegion::ScrollRegion(ST7789_Driver& display, int x, int width)
+    : _display(display), _x(x), _width(width), _offset(0) {}
+
+void ScrollRegion::begin() {
+    _offset = 0;
+    _display.beginTransaction();
+    _display.setScrollArea(_x, _width, ST7789_SCROLL_LINES - _x - _width);
+    _display.setScrollStart(_x);
+    _display.endTransaction();
+}
+
+uint16_t ScrollRegion::exposedLine() const {
+    return _x + _offset;
+}
+
+void ScrollRegion::advance() {
+    _offset = (_offset + 1) % _width;
+    _display.setScrollStart(_x + _offset);
+}
+
+// The new column is written before VSCSAD moves it to the trailing edge, so
+// the panel never shows that edge with the old memory line's contents
+void ScrollRegion::scroll(const uint16_t* column) {
+    _display.beginTransaction();
+    uint16_t line = exposedLine();
+    _display.setAddrWindow(line, 0, line, DISPLAY_HEIGHT - 1);
+    _display.pushPixels(column, DISPLAY_HEIGHT);
+    advance();
+    _display.endTransaction();
+}
+
+void ScrollRegion::scroll(uint16_t color) {
+    _display.beginTransaction();
+    uint16_t line = exposedLine();
+    _display.setAddrWindow(line, 0, line, DISPLAY_HEIGHT - 1);
+    _display.fillSpan(color, DISPLAY_HEIGHT);
+    advance();
+    _display.endTransaction();
+}
+
+void ScrollRegion::end() {
+    _display.beginTransaction();
+    _display.setScrollArea(0, ST7789_SCROLL_LINES, 0);
+    _display.setScrollStart(0);
+    _display.endTransaction();
+}
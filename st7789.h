@@ -0,0 +1,348 @@
+// ST7789 display library (320x240, 90° rotation)
+// Shared by clock, failsafe and test_display
+// Using ST7789_TFT_RPI driver architecture; the bcm2835 transports live in
+// st7789_bcm2835.h so this part also builds on machines without the library
+
+#ifndef ST7789_H
+#define ST7789_H
+
+#include <cstdint>
+
+// Display specifications (320x240 with 90° rotation = landscape)
+#define DISPLAY_WIDTH 320
+#define DISPLAY_HEIGHT 240
+
+// ST7789 Commands
+#define ST7789_NOP 0x00
+#define ST7789_SWRESET 0x01
+#define ST7789_RDDID 0x04
+#define ST7789_RDDST 0x09
+#define ST7789_SLPOUT 0x11
+#define ST7789_PTLON 0x12
+#define ST7789_NORON 0x13
+#define ST7789_INVON 0x21
+#define ST7789_DISPON 0x29
+#define ST7789_CASET 0x2A
+#define ST7789_RASET 0x2B
+#define ST7789_RAMWR 0x2C
+#define ST7789_PTLAR 0x30
+#define ST7789_VSCRDEF 0x33
+#define ST7789_TEOFF 0x34
+#define ST7789_TEON 0x35
+#define ST7789_MADCTL 0x36
+#define ST7789_VSCSAD 0x37
+#define ST7789_IDMOFF 0x38
+#define ST7789_IDMON 0x39
+#define ST7789_COLMOD 0x3A
+
+// Colors (RGB565 format)
+#define COLOR_BLACK 0x0000
+#define COLOR_WHITE 0xFFFF
+#define COLOR_RED 0xF800
+#define COLOR_GREEN 0x07E0
+#define COLOR_BLUE 0x001F
+#define COLOR_CYAN 0x07FF
+#define COLOR_MAGENTA 0xF81F
+#define COLOR_YELLOW 0xFFE0
+
+// TEON mode: pulse the TE pin for vertical blanking only
+#define ST7789_TEON_VBLANK 0x00
+
+// COLMOD interface pixel formats
+#define ST7789_COLMOD_RGB565 0x55  // 16 bits/pixel
+#define ST7789_COLMOD_RGB444 0x53  // 12 bits/pixel, two pixels per three bytes
+
+// Pixels encoded per chunk by the default ST7789_Transport::writePixels
+#define ST7789_PIXEL_CHUNK 256
+
+// Warm start: written once the panel is awake and on, removed whenever it
+// is reset. /run is cleared on reboot, so a stale file cannot outlive the
+// boot that wrote it.
+#define ST7789_STATE_FILE "/run/st7789.state"
+
+// Frame memory lines the vertical scroll commands operate on. The panel
+// scrolls along its native 320-line axis, which MADCTL 0x60 (the default
+// configuration) maps to the display's x axis: memory line n is landscape
+// column n.
+#define ST7789_SCROLL_LINES DISPLAY_WIDTH
+
+// State file helpers used by ST7789_DriverT (see ST7789_STATE_FILE)
+bool st7789_state_valid(const char* path);
+void st7789_state_write(const char* path);
+void st7789_state_remove(const char* path);
+
+// Physical link to the panel. Implementations own the pins and the SPI
+// engine; the driver only sequences DC, CS and bytes.
+class ST7789_Transport {
+public:
+    virtual ~ST7789_Transport() {}
+
+    // Claim GPIO/SPI resources. Returns false if the hardware is unavailable.
+    virtual bool begin() = 0;
+    virtual void end() = 0;
+
+    virtual void setReset(bool high) = 0;
+    virtual void setDataMode(bool data) = 0;  // DC line: false = command
+    virtual void select() = 0;                // CS low
+    virtual void deselect() = 0;              // CS high
+    virtual void write(const uint8_t* buf, uint32_t len) = 0;
+    virtual void delayMs(unsigned int ms) = 0;
+
+    // Send RGB565 pixels big-endian. The default encodes into a small
+    // stack chunk and calls write(); transports override it when they can
+    // stream pixels without the intermediate copy.
+    virtual void writePixels(const uint16_t* pixels, uint32_t count);
+
+    // Send count copies of one RGB565 colour. The default pre-encodes a
+    // chunk of the colour once and writes it repeatedly.
+    virtual void writeRepeated(uint16_t color, uint32_t count);
+};
+
+// Wire format of pixel data. Framebuffers stay RGB565 either way; in
+// RGB444 mode the driver drops the low bits while packing during the flush.
+enum ST7789_PixelFormat {
+    ST7789_RGB565,
+    ST7789_RGB444
+};
+
+// Mock transport for benchmarks: discards data, counts bus activity.
+// Pixels go through the default ST7789_Transport encoders, so the encode
+// cost is part of what a benchmark measures.
+class NullTransport : public ST7789_Transport {
+public:
+    uint64_t bytes;       // Bytes that would have been clocked out
+    uint64_t transfers;   // write() calls
+    uint64_t pinToggles;  // DC, CS and RESET level changes
+    uint64_t busToggles;  // SCLK and MOSI edges a bit-banged link would make
+
+    NullTransport();
+
+    void resetCounters();
+
+    bool begin();
+    void end();
+    void setReset(bool high);
+    void setDataMode(bool data);
+    void select();
+    void deselect();
+    void write(const uint8_t* buf, uint32_t len);
+    void delayMs(unsigned int ms);
+
+private:
+    bool _reset;
+    bool _dataMode;
+    bool _selected;
+    uint8_t _mosi;  // Level MOSI was left at by the last bit, 0 or 1
+};
+
+// Compile-time panel configuration. ST7789_DriverT and the bcm2835
+// transports take one as a template parameter, so geometry, pins and the
+// bit delay are constants in the generated code; define another struct
+// with the same members to drive a differently wired panel from the same
+// build. Pins are BCM GPIO numbers.
+struct ST7789_DefaultConfig {
+    static const int width = DISPLAY_WIDTH;
+    static const int height = DISPLAY_HEIGHT;
+    static const uint8_t madctl = 0x60;  // 90° rotation, RGB order
+
+    // Software SPI (matches ST7789_TFT_RPI SW SPI setup)
+    static const uint8_t csPin = 12;          // Pin 32
+    static const uint8_t dcPin = 24;          // Pin 18
+    static const uint8_t rstPin = 25;         // Pin 22
+    static const uint8_t dataPin = 19;        // Pin 35 - MOSI/SDA
+    static const uint8_t sclkPin = 26;        // Pin 37
+    static const uint16_t highFreqDelay = 0;  // Microseconds between bit edges
+
+    // Hardware SPI0: CE0 as chip select, DC and RESET as above
+    static const uint8_t hwCsPin = 8;         // Pin 24
+    // Note: LED/Backlight connected to VCC (always on, no GPIO control needed)
+};
+
+// ST7789 Display Driver Class (following ST7789_TFT_RPI architecture)
+//
+// Every public operation runs inside a transaction: CS is asserted once
+// when the outermost transaction starts and released when it ends, and DC
+// only toggles when switching between command and data bytes. Wrap several
+// calls in beginTransaction()/endTransaction() to keep CS low across them.
+//
+// In RGB444 mode pixels are packed in pairs; an odd pixel is held back
+// until the next pixel or until the window ends with a new command or the
+// outermost endTransaction(), so stream a window within one transaction.
+//
+// Transport is ST7789_Transport for a link chosen at run time. A concrete
+// (final) transport class makes every bus call a direct, inlinable call.
+template <class Config, class Transport = ST7789_Transport>
+class ST7789_DriverT {
+public:
+    explicit ST7789_DriverT(Transport& transport);
+
+    // Pixel format initDisplay() programs; call before initDisplay()
+    void setPixelFormat(ST7789_PixelFormat format) { _pixelFormat = format; }
+    ST7789_PixelFormat pixelFormat() const { return _pixelFormat; }
+
+    // Setup GPIO pins / SPI peripheral through the transport
+    bool setupGPIO();
+
+    // Initialize display (matching ST7789_TFT_RPI initialization sequence).
+    // With displayOn = false the panel is left blanked so the caller can
+    // upload a first frame before calling displayOn().
+    void initDisplay(bool displayOn = true);
+    void displayOn();
+
+    // File recording that the panel is configured and on (nullptr, the
+    // default, disables it). initDisplay() and hardwareReset() remove it,
+    // displayOn() writes it.
+    void setStateFile(const char* path) { _statePath = path; }
+
+    // Warm start: if the state file says the panel is still awake and on,
+    // re-send the configuration without the reset and sleep-out delays and
+    // return true. The panel keeps showing its old contents until the
+    // first frame overwrites them. Returns false (nothing sent) otherwise;
+    // call initDisplay() then.
+    bool resumeDisplay();
+
+    // Toggle the RESET line; settleMs is the wait after releasing it
+    void hardwareReset(unsigned int settleMs = 150);
+
+    void beginTransaction();
+    void endTransaction();
+
+    void writeCommand(uint8_t cmd);
+    void writeData(uint8_t data);
+    void writeData(const uint8_t* data, uint32_t len);
+
+    // Set address window and start RAMWR
+    void setAddrWindow(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1);
+
+    // Push pixel data
+    void pushPixel(uint16_t color);
+
+    // Stream count pixels into the current RAMWR window
+    void pushPixels(const uint16_t* pixels, uint32_t count);
+
+    // Push framebuffer to display
+    void pushFramebuffer(const uint16_t* framebuffer, int width, int height);
+
+    // Push a sub-rectangle of a framebuffer with the given row stride
+    void pushRect(const uint16_t* framebuffer, int stride, int x, int y, int w, int h);
+
+    // Push a sub-rectangle of a framebuffer whose pixels are stored in panel
+    // wire order (see wire_color() in pixel_ops.h). In RGB565 mode rows go
+    // to the transport's write() untouched: no encode pass, no copy.
+    void pushWireRect(const uint16_t* framebuffer, int stride, int x, int y, int w, int h);
+
+    // Push a sub-rectangle of a 4 bpp palette-indexed framebuffer (two
+    // pixels per byte, even x in the high nibble, stride in pixels),
+    // expanded to RGB565 through a pixel-pair table a chunk at a time
+    void pushIndexedRect(const uint8_t* framebuffer, const uint16_t* palette, int stride,
+                         int x, int y, int w, int h);
+
+    // Stream count pixels of one colour into the current RAMWR window
+    void fillSpan(uint16_t color, uint32_t count);
+
+    // Fill a rectangle on the panel with a solid colour
+    void fillRect(int x, int y, int w, int h, uint16_t color);
+
+    // Vertical scroll definition (VSCRDEF): fixed top lines, scrolled
+    // lines and fixed bottom lines, summing to ST7789_SCROLL_LINES
+    void setScrollArea(uint16_t top, uint16_t scroll, uint16_t bottom);
+
+    // Vertical scroll start address (VSCSAD): memory line shown first in
+    // the scroll area
+    void setScrollStart(uint16_t line);
+
+    // Partial display (PTLAR + PTLON): only memory lines first..last are
+    // driven, the rest of the panel shows the non-display colour. Lines are
+    // on the same native axis as scrolling, i.e. display columns with the
+    // default MADCTL. normalMode() (NORON) drives the whole panel again.
+    void partialMode(uint16_t first, uint16_t last);
+    void normalMode();
+
+    // Idle mode (IDMON / IDMOFF): 8 colours, only the top bit of each
+    // channel is shown
+    void idleMode(bool on);
+
+    // Tearing effect output (TEON / TEOFF): the TE pin goes high at the
+    // start of every vertical blank (see st7789_te.h)
+    void tearingEffect(bool on);
+
+    // Cleanup
+    void powerDown();
+
+    Transport& transport() { return _transport; }
+
+    // Command, parameter and pixel bytes sent since construction
+    uint64_t bytesSent() const { return _bytesSent; }
+
+private:
+    Transport& _transport;
+    int _txDepth;
+    int _dataMode;  // -1 unknown, 0 command, 1 data
+    uint64_t _bytesSent;
+    ST7789_PixelFormat _pixelFormat;
+    int32_t _pendingPixel;  // RGB444 pixel waiting for its pair, -1 if none
+    const char* _statePath;
+
+    void setDataMode(bool data);
+
+    // Orientation, pixel format, normal full-colour mode, inversion and
+    // scroll reset; settleMs is waited after NORON and INVON
+    void configure(unsigned int settleMs);
+
+    // Send pixels in the current pixel format; data mode must be set
+    void writePixelData(const uint16_t* pixels, uint32_t count);
+    void writeRepeatedData(uint16_t color, uint32_t count);
+    void flushPendingPixel();
+};
+
+#include "st7789_driver_impl.h"
+
+// The driver used by clock, failsafe and test_display; instantiated in
+// st7789.cpp
+typedef ST7789_DriverT<ST7789_DefaultConfig> ST7789_Driver;
+extern template class ST7789_DriverT<ST7789_DefaultConfig>;
+
+// Hardware-scrolled band of the panel built on VSCRDEF/VSCSAD.
+//
+// In the landscape orientation the band is the columns [x, x + width) over
+// the full display height, and content moves towards x as it scrolls. Each
+// step costs one VSCSAD plus the single newly exposed column; the rest of
+// the band is already in frame memory and is only re-addressed. Pixels
+// outside the band never move.
+class ScrollRegion {
+public:
+    ScrollRegion(ST7789_Driver& display, int x, int width);
+
+    // Define the scroll area and show the band unscrolled. The band's
+    // panel contents are taken as the initial content.
+    void begin();
+
+    // Scroll one column and draw column (DISPLAY_HEIGHT pixels, top to
+    // bottom) at the trailing edge of the band
+    void scroll(const uint16_t* column);
+
+    // Scroll one column, filling the trailing edge with a solid colour
+    void scroll(uint16_t color);
+
+    // Restore the unscrolled full-screen mapping. Band contents are left
+    // rotated in frame memory by offset() columns.
+    void end();
+
+    // Columns scrolled since begin(), modulo the band width
+    int offset() const { return _offset; }
+
+private:
+    ST7789_Driver& _display;
+    int _x;
+    int _width;
+    int _offset;
+
+    // Memory line that leaves the leading edge on the next step and is
+    // re-exposed at the trailing edge
+    uint16_t exposedLine() const;
+
+    // Move the scroll start one column on (VSCSAD)
+    void advance();
+};
+
+#endif // ST7789_H
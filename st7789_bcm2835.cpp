@@ -0,0 +1,161 @@
+// bcm2835 transports for the ST7789 display library
+
+#include "st7789_bcm2835.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+static bool bcm2835_mapped = false;
+
+bool st7789_init_bcm2835() {
+    if (bcm2835_mapped) {
+        return true;
+    }
+    std::cout << "Initializing bcm2835 library..." << std::endl;
+    if (!bcm2835_init()) {
+        std::cerr << "Error: bcm2835_init failed. Are you running as root?" << std::endl;
+        return false;
+    }
+    bcm2835_mapped = true;
+    return true;
+}
+
+void st7789_close_bcm2835() {
+    if (bcm2835_mapped) {
+        bcm2835_close();
+        bcm2835_mapped = false;
+    }
+}
+
+// J8 header pin for BCM GPIO 0..27
+static const uint8_t header_pins[28] = {
+    27, 28, 3, 5, 7, 29, 31, 26, 24, 21, 19, 23, 32, 33,
+    8, 10, 36, 11, 12, 35, 38, 40, 15, 16, 18, 22, 37, 13
+};
+
+int st7789_header_pin(int gpio) {
+    return gpio >= 0 && gpio < 28 ? header_pins[gpio] : 0;
+}
+
+void st7789_print_pin(const char* name, int gpio, const char* note) {
+    char label[16];
+    char line[64];
+    snprintf(label, sizeof(label), "%s:", name);
+    snprintf(line, sizeof(line), "  %-7sGPIO%-2d (Pin %d%s%s)", label,
+             gpio, st7789_header_pin(gpio), note ? ", " : "", note ? note : "");
+    std::cout << line << std::endl;
+}
+
+// ---------------------------------------------------------------------------
+// Default transports
+// ---------------------------------------------------------------------------
+
+template class SoftSPITransportT<ST7789_DefaultConfig>;
+template class HardSPITransportT<ST7789_DefaultConfig>;
+template class MultiSoftSPITransportT<ST7789_DefaultConfig>;
+
+// ---------------------------------------------------------------------------
+// Transport selection
+// ---------------------------------------------------------------------------
+
+// GPIO number 0..27, or -1
+static int parse_gpio(const char* text, char** end) {
+    long gpio = strtol(text, end, 10);
+    if (*end == text || gpio < 0 || gpio > 27) {
+        return -1;
+    }
+    return (int)gpio;
+}
+
+// "--panel CS[,MOSI]": one more panel on the bit-banged bus
+static int parse_panel_option(const char* value, TransportConfig& config) {
+    if (config.panelCount == ST7789_MAX_PANELS) {
+        std::cerr << "Error: at most " << ST7789_MAX_PANELS << " panels" << std::endl;
+        return -1;
+    }
+
+    char* end;
+    int cs = parse_gpio(value, &end);
+    int data = ST7789_DefaultConfig::dataPin;
+    if (cs >= 0 && *end == ',') {
+        data = parse_gpio(end + 1, &end);
+    }
+    if (cs < 0 || data < 0 || *end != '\0') {
+        std::cerr << "Error: --panel expects CS[,MOSI] as BCM GPIO numbers 0-27" << std::endl;
+        return -1;
+    }
+
+    const int shared[3] = {ST7789_DefaultConfig::sclkPin, ST7789_DefaultConfig::dcPin,
+                           ST7789_DefaultConfig::rstPin};
+    for (int i = 0; i < 3; i++) {
+        if (cs == shared[i] || data == shared[i]) {
+            std::cerr << "Error: --panel GPIO" << shared[i]
+                      << " is the shared SCLK, DC or RESET line" << std::endl;
+            return -1;
+        }
+    }
+    for (int i = 0; i < config.panelCount; i++) {
+        const PanelPins& other = config.panels[i];
+        int clash = cs == other.csPin || cs == other.dataPin ? cs
+                  : data == other.csPin ? data : -1;
+        if (clash >= 0) {
+            std::cerr << "Error: --panel GPIO" << clash << " is already used by panel " << i << std::endl;
+            return -1;
+        }
+    }
+    if (cs == data) {
+        std::cerr << "Error: --panel CS and MOSI must be different pins" << std::endl;
+        return -1;
+    }
+
+    config.panels[config.panelCount].csPin = (uint8_t)cs;
+    config.panels[config.panelCount].dataPin = (uint8_t)data;
+    config.panelCount++;
+    return 1;
+}
+
+int parseTransportOption(int argc, char* argv[], int& i, TransportConfig& config) {
+    if (strcmp(argv[i], "--hw-spi") == 0) {
+        config.hardwareSPI = true;
+        return 1;
+    }
+    if (strcmp(argv[i], "--spi-divider") == 0 && i + 1 < argc) {
+        int divider = atoi(argv[++i]);
+        if (divider < 2 || divider > 65536 || (divider & 1)) {
+            std::cerr << "Error: SPI clock divider must be an even number >= 2" << std::endl;
+            return -1;
+        }
+        config.clockDivider = (uint16_t)divider;  // 65536 wraps to 0, which SPI0 treats as 65536
+        return 1;
+    }
+    if (strcmp(argv[i], "--panel") == 0 && i + 1 < argc) {
+        return parse_panel_option(argv[++i], config);
+    }
+    return 0;
+}
+
+void printTransportUsage() {
+    std::cerr << "  --hw-spi         Use the SPI0 peripheral (GPIO8/10/11) instead of" << std::endl;
+    std::cerr << "                   bit-banging on GPIO12/19/26" << std::endl;
+    std::cerr << "  --spi-divider N  SPI0 clock divider (default " << TFT_HWSPI_CLOCK_DIVIDER << ")" << std::endl;
+    std::cerr << "  --panel CS[,MOSI]" << std::endl;
+    std::cerr << "                   Add a panel on the bit-banged bus (repeat for up to "
+              << ST7789_MAX_PANELS << ")," << std::endl;
+    std::cerr << "                   sharing SCLK/DC/RESET; MOSI defaults to GPIO"
+              << (int)ST7789_DefaultConfig::dataPin << std::endl;
+}
+
+ST7789_Transport* createTransport(const TransportConfig& config) {
+    if (config.panelCount > 0) {
+        if (config.hardwareSPI) {
+            std::cerr << "Warning: --panel needs the bit-banged bus, ignoring --hw-spi" << std::endl;
+        }
+        return new MultiSoftSPITransport(config.panels, config.panelCount);
+    }
+    if (config.hardwareSPI) {
+        return new HardSPITransport(config.clockDivider);
+    }
+    return new SoftSPITransport();
+}
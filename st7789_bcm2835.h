@@ -0,0 +1,537 @@
+// bcm2835 transports for the ST7789 display library
+// Software SPI (bit-banged) and hardware SPI0 links to the panel
+
+#ifndef ST7789_BCM2835_H
+#define ST7789_BCM2835_H
+
+#include <bcm2835.h>
+#include <cstdio>
+#include <iostream>
+
+#include "pixel_ops.h"
+#include "st7789.h"
+#include "st7789_softspi.h"
+
+// Hardware SPI settings
+#define TFT_HWSPI_CLOCK_DIVIDER 8  // Core clock / 8 (31.25 MHz at 250 MHz core)
+#define TFT_HWSPI_CHUNK_BYTES 32768 // Bytes handed to the SPI peripheral per call
+
+// Multi-panel bus
+#define ST7789_MAX_PANELS 4  // Panels sharing SCLK, DC and RESET
+
+// Hardware SPI0 data pins (fixed by the peripheral)
+#define TFT_HWSPI_MOSI_GPIO RPI_BPLUS_GPIO_J8_19  // GPIO10 - SPI0 MOSI
+#define TFT_HWSPI_SCLK_GPIO RPI_BPLUS_GPIO_J8_23  // GPIO11 - SPI0 SCLK
+
+// bcm2835_init() with the usual error message. Only maps the peripheral
+// registers, without touching a pin; once done, later calls return true
+// straight away, so a standby clock can map ahead of its transport's begin().
+bool st7789_init_bcm2835();
+
+// bcm2835_close(), if mapped
+void st7789_close_bcm2835();
+
+// J8 header pin of a BCM GPIO, 0 if it is not on the header
+int st7789_header_pin(int gpio);
+
+// Print one line of a transport's pin table: "  CS:    GPIO12 (Pin 32)"
+void st7789_print_pin(const char* name, int gpio, const char* note = 0);
+
+// Bit-banged SPI through SoftSPIEngine on the Config pins
+template <class Config>
+class SoftSPITransportT final : public ST7789_Transport {
+public:
+    // Setup GPIO pins for Software SPI (matching TFTSetupGPIO for SW SPI)
+    bool begin() {
+        if (!st7789_init_bcm2835()) {
+            return false;
+        }
+
+        // Set GPIO pin modes to output
+        bcm2835_gpio_fsel(Config::csPin, BCM2835_GPIO_FSEL_OUTP);
+        bcm2835_gpio_fsel(Config::dcPin, BCM2835_GPIO_FSEL_OUTP);
+        bcm2835_gpio_fsel(Config::rstPin, BCM2835_GPIO_FSEL_OUTP);
+        bcm2835_gpio_fsel(Config::dataPin, BCM2835_GPIO_FSEL_OUTP);
+        bcm2835_gpio_fsel(Config::sclkPin, BCM2835_GPIO_FSEL_OUTP);
+
+        // Initialize pin states
+        bcm2835_gpio_write(Config::csPin, HIGH);    // CS high (deselected)
+        bcm2835_gpio_write(Config::sclkPin, LOW);   // Clock low
+        bcm2835_gpio_write(Config::dataPin, LOW);   // Data low
+        _spi.begin();
+
+        std::cout << "GPIO Setup Complete - Software SPI Mode" << std::endl;
+        st7789_print_pin("CS", Config::csPin);
+        st7789_print_pin("DC", Config::dcPin);
+        st7789_print_pin("RESET", Config::rstPin);
+        st7789_print_pin("MOSI", Config::dataPin);
+        st7789_print_pin("SCLK", Config::sclkPin);
+
+        return true;
+    }
+
+    void end() {
+        st7789_close_bcm2835();
+    }
+
+    void setReset(bool high) {
+        bcm2835_gpio_write(Config::rstPin, high ? HIGH : LOW);
+    }
+
+    void setDataMode(bool data) {
+        bcm2835_gpio_write(Config::dcPin, data ? HIGH : LOW);
+    }
+
+    void select() {
+        bcm2835_gpio_write(Config::csPin, LOW);
+    }
+
+    void deselect() {
+        bcm2835_gpio_write(Config::csPin, HIGH);
+    }
+
+    void write(const uint8_t* buf, uint32_t len) {
+        _spi.write(buf, len);
+    }
+
+    // Bit-bang pixels straight from the framebuffer, no encode pass
+    void writePixels(const uint16_t* pixels, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            _spi.writeByte(pixels[i] >> 8);
+            _spi.writeByte(pixels[i] & 0xFF);
+        }
+    }
+
+    // Colour bytes are encoded once; the loop only clocks them out
+    void writeRepeated(uint16_t color, uint32_t count) {
+        const uint8_t hi = color >> 8;
+        const uint8_t lo = color & 0xFF;
+        for (uint32_t i = 0; i < count; i++) {
+            _spi.writeByte(hi);
+            _spi.writeByte(lo);
+        }
+    }
+
+    void delayMs(unsigned int ms) {
+        bcm2835_delay(ms);
+    }
+
+private:
+    SoftSPIEngine<Config::sclkPin, Config::dataPin, Config::highFreqDelay> _spi;
+};
+
+// SPI0 peripheral on GPIO10/11 with Config::hwCsPin as chip select. CS is
+// driven as a plain GPIO so it can stay asserted for a whole driver
+// transaction rather than per transfer.
+template <class Config>
+class HardSPITransportT final : public ST7789_Transport {
+public:
+    explicit HardSPITransportT(uint16_t clockDivider = TFT_HWSPI_CLOCK_DIVIDER)
+        : _clockDivider(clockDivider),
+          _txBuf(new uint8_t[TFT_HWSPI_CHUNK_BYTES]),
+          _txBufColor(-1) {}
+
+    ~HardSPITransportT() {
+        delete[] _txBuf;
+    }
+
+    // Setup SPI0 for Hardware SPI
+    bool begin() {
+        if (!st7789_init_bcm2835()) {
+            return false;
+        }
+
+        if (!bcm2835_spi_begin()) {
+            std::cerr << "Error: bcm2835_spi_begin failed. Is SPI0 free?" << std::endl;
+            st7789_close_bcm2835();
+            return false;
+        }
+
+        bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);
+        bcm2835_spi_setDataMode(BCM2835_SPI_MODE0);
+        bcm2835_spi_setClockDivider(_clockDivider);
+        bcm2835_spi_chipSelect(BCM2835_SPI_CS_NONE);
+
+        // Take the CS pin back from the SPI peripheral and drive it ourselves
+        bcm2835_gpio_fsel(Config::hwCsPin, BCM2835_GPIO_FSEL_OUTP);
+        bcm2835_gpio_write(Config::hwCsPin, HIGH);
+        bcm2835_gpio_fsel(Config::dcPin, BCM2835_GPIO_FSEL_OUTP);
+        bcm2835_gpio_fsel(Config::rstPin, BCM2835_GPIO_FSEL_OUTP);
+
+        std::cout << "GPIO Setup Complete - Hardware SPI Mode (divider "
+                  << _clockDivider << ")" << std::endl;
+        st7789_print_pin("CS", Config::hwCsPin, Config::hwCsPin == 8 ? "SPI0 CE0" : 0);
+        st7789_print_pin("DC", Config::dcPin);
+        st7789_print_pin("RESET", Config::rstPin);
+        st7789_print_pin("MOSI", TFT_HWSPI_MOSI_GPIO, "SPI0 MOSI");
+        st7789_print_pin("SCLK", TFT_HWSPI_SCLK_GPIO, "SPI0 SCLK");
+
+        return true;
+    }
+
+    void end() {
+        bcm2835_spi_end();
+        st7789_close_bcm2835();
+    }
+
+    void setReset(bool high) {
+        bcm2835_gpio_write(Config::rstPin, high ? HIGH : LOW);
+    }
+
+    void setDataMode(bool data) {
+        bcm2835_gpio_write(Config::dcPin, data ? HIGH : LOW);
+    }
+
+    void select() {
+        bcm2835_gpio_write(Config::hwCsPin, LOW);
+    }
+
+    void deselect() {
+        bcm2835_gpio_write(Config::hwCsPin, HIGH);
+    }
+
+    void write(const uint8_t* buf, uint32_t len) {
+        bcm2835_spi_writenb((const char*)buf, len);
+    }
+
+    // Encode big-endian pixels into chunk-sized bursts so each
+    // bcm2835_spi_writenb call moves up to TFT_HWSPI_CHUNK_BYTES
+    void writePixels(const uint16_t* pixels, uint32_t count) {
+        const uint32_t chunk_pixels = TFT_HWSPI_CHUNK_BYTES / 2;
+        _txBufColor = -1;
+        while (count > 0) {
+            uint32_t n = count < chunk_pixels ? count : chunk_pixels;
+            encode_pixels_be(_txBuf, pixels, n);
+            bcm2835_spi_writenb((const char*)_txBuf, n * 2);
+            pixels += n;
+            count -= n;
+        }
+    }
+
+    // Fill the chunk buffer with the colour once (kept across calls while the
+    // same colour is reused) and send it as many times as needed
+    void writeRepeated(uint16_t color, uint32_t count) {
+        const uint32_t chunk_pixels = TFT_HWSPI_CHUNK_BYTES / 2;
+        if (_txBufColor != color) {
+            encode_repeated_be(_txBuf, color, chunk_pixels);
+            _txBufColor = color;
+        }
+        while (count > 0) {
+            uint32_t n = count < chunk_pixels ? count : chunk_pixels;
+            bcm2835_spi_writenb((const char*)_txBuf, n * 2);
+            count -= n;
+        }
+    }
+
+    void delayMs(unsigned int ms) {
+        bcm2835_delay(ms);
+    }
+
+private:
+    uint16_t _clockDivider;
+    uint8_t* _txBuf;
+    int32_t _txBufColor;  // Colour _txBuf is filled with, -1 if pixel data
+
+    HardSPITransportT(const HardSPITransportT&);
+    HardSPITransportT& operator=(const HardSPITransportT&);
+};
+
+// Chip select and MOSI of one panel on a MultiSoftSPITransportT (BCM GPIO)
+struct PanelPins {
+    uint8_t csPin;
+    uint8_t dataPin;
+};
+
+// Several panels on one bit-banged bus: SCLK, DC and RESET come from Config
+// and are shared, each panel has its own CS and optionally its own MOSI.
+// Commands and fills go to every panel at once. Pixel data read from the
+// lane frames (setLaneFrames) is demultiplexed: a pointer into frame 0 is
+// sent from the same offset of frame i to panel i. With a MOSI per panel all
+// lanes are clocked together, every SCLK edge a single GPSET/GPCLR store for
+// all of them; panels sharing MOSI get their pixel data one after another,
+// with the other panels deselected.
+template <class Config>
+class MultiSoftSPITransportT final : public ST7789_Transport {
+public:
+    MultiSoftSPITransportT(const PanelPins* panels, int count)
+        : _count(count < ST7789_MAX_PANELS ? count : ST7789_MAX_PANELS),
+          _csAll(0), _dataAll(0), _sharedData(false),
+          _frameBytes(0), _gpset(0), _gpclr(0) {
+        for (int i = 0; i < _count; i++) {
+            _panels[i] = panels[i];
+            _csMasks[i] = 1u << panels[i].csPin;
+            _dataMasks[i] = 1u << panels[i].dataPin;
+            if (_dataAll & _dataMasks[i]) {
+                _sharedData = true;
+            }
+            _csAll |= _csMasks[i];
+            _dataAll |= _dataMasks[i];
+            _frames[i] = 0;
+        }
+    }
+
+    bool begin() {
+        if (!st7789_init_bcm2835()) {
+            return false;
+        }
+
+        bcm2835_gpio_fsel(Config::dcPin, BCM2835_GPIO_FSEL_OUTP);
+        bcm2835_gpio_fsel(Config::rstPin, BCM2835_GPIO_FSEL_OUTP);
+        bcm2835_gpio_fsel(Config::sclkPin, BCM2835_GPIO_FSEL_OUTP);
+        for (int i = 0; i < _count; i++) {
+            bcm2835_gpio_fsel(_panels[i].csPin, BCM2835_GPIO_FSEL_OUTP);
+            bcm2835_gpio_fsel(_panels[i].dataPin, BCM2835_GPIO_FSEL_OUTP);
+        }
+
+        bcm2835_gpio_set_multi(_csAll);              // All deselected
+        bcm2835_gpio_clr_multi(_dataAll);            // Data low
+        bcm2835_gpio_write(Config::sclkPin, LOW);    // Clock low
+
+        volatile uint32_t* gpio = bcm2835_regbase(BCM2835_REGBASE_GPIO);
+        _gpset = gpio + BCM2835_GPSET0 / 4;
+        _gpclr = gpio + BCM2835_GPCLR0 / 4;
+
+        std::cout << "GPIO Setup Complete - Software SPI, " << _count << " panels ("
+                  << (_sharedData ? "shared MOSI, pixel data sent in turn"
+                                  : "one MOSI per panel, clocked together")
+                  << ")" << std::endl;
+        st7789_print_pin("DC", Config::dcPin);
+        st7789_print_pin("RESET", Config::rstPin);
+        st7789_print_pin("SCLK", Config::sclkPin);
+        for (int i = 0; i < _count; i++) {
+            char name[8];
+            snprintf(name, sizeof(name), "CS%d", i);
+            st7789_print_pin(name, _panels[i].csPin);
+            snprintf(name, sizeof(name), "MOSI%d", i);
+            st7789_print_pin(name, _panels[i].dataPin);
+        }
+
+        return true;
+    }
+
+    void end() {
+        st7789_close_bcm2835();
+    }
+
+    // Frames the next pixel writes are taken from, one per panel, each
+    // `pixels` long. Pass nullptr to send everything to all panels again.
+    void setLaneFrames(const uint16_t* const* frames, uint32_t pixels) {
+        for (int i = 0; i < _count; i++) {
+            _frames[i] = frames ? frames[i] : 0;
+        }
+        _frameBytes = frames ? pixels * 2 : 0;
+    }
+
+    int panelCount() const {
+        return _count;
+    }
+
+    void setReset(bool high) {
+        bcm2835_gpio_write(Config::rstPin, high ? HIGH : LOW);
+    }
+
+    void setDataMode(bool data) {
+        bcm2835_gpio_write(Config::dcPin, data ? HIGH : LOW);
+    }
+
+    void select() {
+        *_gpclr = _csAll;
+    }
+
+    void deselect() {
+        *_gpset = _csAll;
+    }
+
+    void write(const uint8_t* buf, uint32_t len) {
+        uint32_t offset;
+        if (laneOffset(buf, len, offset)) {
+            writeLanes(offset, len);
+            return;
+        }
+        for (uint32_t i = 0; i < len; i++) {
+            clockByte(buf[i]);
+        }
+    }
+
+    // Host-order pixels, MSB first
+    void writePixels(const uint16_t* pixels, uint32_t count) {
+        uint32_t offset;
+        if (laneOffset((const uint8_t*)pixels, count * 2, offset)) {
+            writeLanePixels(offset / 2, count);
+            return;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            clockByte(pixels[i] >> 8);
+            clockByte(pixels[i] & 0xFF);
+        }
+    }
+
+    void writeRepeated(uint16_t color, uint32_t count) {
+        const uint8_t hi = color >> 8;
+        const uint8_t lo = color & 0xFF;
+        for (uint32_t i = 0; i < count; i++) {
+            clockByte(hi);
+            clockByte(lo);
+        }
+    }
+
+    void delayMs(unsigned int ms) {
+        bcm2835_delay(ms);
+    }
+
+private:
+    static const uint32_t sclkMask = 1u << Config::sclkPin;
+
+    int _count;
+    PanelPins _panels[ST7789_MAX_PANELS];
+    uint32_t _csMasks[ST7789_MAX_PANELS];
+    uint32_t _dataMasks[ST7789_MAX_PANELS];
+    uint32_t _csAll;
+    uint32_t _dataAll;
+    bool _sharedData;  // Two panels on one MOSI: lanes cannot be clocked together
+    const uint16_t* _frames[ST7789_MAX_PANELS];
+    uint32_t _frameBytes;
+    volatile uint32_t* _gpset;
+    volatile uint32_t* _gpclr;
+
+    // Byte offset of buf within lane frame 0, if it lies entirely inside it
+    bool laneOffset(const uint8_t* buf, uint32_t len, uint32_t& offset) const {
+        const uint8_t* base = (const uint8_t*)_frames[0];
+        if (_frameBytes == 0 || buf < base || buf + len > base + _frameBytes) {
+            return false;
+        }
+        offset = (uint32_t)(buf - base);
+        return true;
+    }
+
+    // One SPI mode 0 bit on every data line in ones|zeros. Rising MOSI lines
+    // move while SCLK is still high from the previous bit; falling lines go
+    // down with SCLK, then SCLK rises alone.
+    inline void clockBit(uint32_t ones, uint32_t zeros) {
+        if (ones) {
+            *_gpset = ones;
+        }
+        *_gpclr = sclkMask | zeros;
+        if (Config::highFreqDelay != 0) {
+            bcm2835_delayMicroseconds(Config::highFreqDelay);
+        }
+        *_gpset = sclkMask;
+        if (Config::highFreqDelay != 0) {
+            bcm2835_delayMicroseconds(Config::highFreqDelay);
+        }
+    }
+
+    // Same byte on every panel
+    inline void clockByte(uint8_t byte) {
+        for (int bit = 7; bit >= 0; bit--) {
+            uint32_t ones = (byte >> bit) & 1 ? _dataAll : 0;
+            clockBit(ones, _dataAll & ~ones);
+        }
+    }
+
+    // A different byte per panel, all clocked out together
+    inline void clockLanes(const uint8_t* bytes) {
+        for (int bit = 7; bit >= 0; bit--) {
+            uint32_t ones = 0;
+            for (int i = 0; i < _count; i++) {
+                ones |= (uint32_t)-(int32_t)((bytes[i] >> bit) & 1) & _dataMasks[i];
+            }
+            clockBit(ones, _dataAll & ~ones);
+        }
+    }
+
+    // One panel's byte on its own data line
+    inline void clockLaneByte(int lane, uint8_t byte) {
+        const uint32_t mask = _dataMasks[lane];
+        for (int bit = 7; bit >= 0; bit--) {
+            uint32_t ones = (byte >> bit) & 1 ? mask : 0;
+            clockBit(ones, mask & ~ones);
+        }
+    }
+
+    // Leave only `lane` selected; the others keep their write position and
+    // continue the same RAMWR when selected again
+    void selectOnly(int lane) {
+        *_gpset = _csAll & ~_csMasks[lane];
+        *_gpclr = _csMasks[lane];
+    }
+
+    void writeLanes(uint32_t offset, uint32_t len) {
+        if (_sharedData) {
+            for (int lane = 0; lane < _count; lane++) {
+                const uint8_t* src = (const uint8_t*)_frames[lane] + offset;
+                selectOnly(lane);
+                for (uint32_t i = 0; i < len; i++) {
+                    clockLaneByte(lane, src[i]);
+                }
+            }
+            *_gpclr = _csAll;
+            return;
+        }
+        uint8_t bytes[ST7789_MAX_PANELS];
+        for (uint32_t i = 0; i < len; i++) {
+            for (int lane = 0; lane < _count; lane++) {
+                bytes[lane] = ((const uint8_t*)_frames[lane])[offset + i];
+            }
+            clockLanes(bytes);
+        }
+    }
+
+    void writeLanePixels(uint32_t offset, uint32_t count) {
+        if (_sharedData) {
+            for (int lane = 0; lane < _count; lane++) {
+                const uint16_t* src = _frames[lane] + offset;
+                selectOnly(lane);
+                for (uint32_t i = 0; i < count; i++) {
+                    clockLaneByte(lane, src[i] >> 8);
+                    clockLaneByte(lane, src[i] & 0xFF);
+                }
+            }
+            *_gpclr = _csAll;
+            return;
+        }
+        uint8_t hi[ST7789_MAX_PANELS];
+        uint8_t lo[ST7789_MAX_PANELS];
+        for (uint32_t i = 0; i < count; i++) {
+            for (int lane = 0; lane < _count; lane++) {
+                uint16_t pixel = _frames[lane][offset + i];
+                hi[lane] = pixel >> 8;
+                lo[lane] = pixel & 0xFF;
+            }
+            clockLanes(hi);
+            clockLanes(lo);
+        }
+    }
+};
+
+// Transports for the default wiring, compiled once in st7789_bcm2835.cpp
+typedef SoftSPITransportT<ST7789_DefaultConfig> SoftSPITransport;
+typedef HardSPITransportT<ST7789_DefaultConfig> HardSPITransport;
+typedef MultiSoftSPITransportT<ST7789_DefaultConfig> MultiSoftSPITransport;
+extern template class SoftSPITransportT<ST7789_DefaultConfig>;
+extern template class HardSPITransportT<ST7789_DefaultConfig>;
+extern template class MultiSoftSPITransportT<ST7789_DefaultConfig>;
+
+// Transport selection shared by the command line of every binary
+struct TransportConfig {
+    bool hardwareSPI;
+    uint16_t clockDivider;
+    PanelPins panels[ST7789_MAX_PANELS];  // --panel options, in order
+    int panelCount;                       // 0: one panel on the default pins
+
+    TransportConfig()
+        : hardwareSPI(false), clockDivider(TFT_HWSPI_CLOCK_DIVIDER), panelCount(0) {}
+};
+
+// Parse a transport option at argv[i], advancing i past its value.
+// Returns 1 if consumed, 0 if argv[i] is not a transport option, -1 if the
+// value is invalid (an error has been printed).
+int parseTransportOption(int argc, char* argv[], int& i, TransportConfig& config);
+
+// Usage lines for the options parseTransportOption understands
+void printTransportUsage();
+
+// Allocate the transport selected by config; caller owns the result
+ST7789_Transport* createTransport(const TransportConfig& config);
+
+#endif // ST7789_BCM2835_H
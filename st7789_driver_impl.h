@@ -0,0 +1,482 @@
+// ST7789 display library: ST7789_DriverT member definitions
+// Included from st7789.h; the default configuration is instantiated once
+// in st7789.cpp
+
+#ifndef ST7789_DRIVER_IMPL_H
+#define ST7789_DRIVER_IMPL_H
+
+#include <cstring>
+#include <iostream>
+
+#include "pixel_ops.h"
+
+// ---------------------------------------------------------------------------
+// ST7789_DriverT
+// ---------------------------------------------------------------------------
+
+template <class Config, class Transport>
+ST7789_DriverT<Config, Transport>::ST7789_DriverT(Transport& transport)
+    : _transport(transport), _txDepth(0), _dataMode(-1), _bytesSent(0),
+      _pixelFormat(ST7789_RGB565), _pendingPixel(-1), _statePath(nullptr) {}
+
+template <class Config, class Transport>
+bool ST7789_DriverT<Config, Transport>::setupGPIO() {
+    return _transport.begin();
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::hardwareReset(unsigned int settleMs) {
+    if (_statePath) {
+        st7789_state_remove(_statePath);
+    }
+    _transport.setReset(true);
+    _transport.delayMs(10);
+    _transport.setReset(false);
+    _transport.delayMs(50);
+    _transport.setReset(true);
+    _transport.delayMs(settleMs);
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::initDisplay(bool displayOn) {
+    std::cout << "Initializing ST7789 display..." << std::endl;
+
+    // Hardware reset sequence
+    std::cout << "  - Performing hardware reset..." << std::endl;
+    hardwareReset();
+
+    // Software reset
+    std::cout << "  - Sending software reset..." << std::endl;
+    writeCommand(ST7789_SWRESET);
+    _transport.delayMs(200);
+
+    // Sleep out
+    std::cout << "  - Waking up display..." << std::endl;
+    writeCommand(ST7789_SLPOUT);
+    _transport.delayMs(120);
+
+    // Configure display orientation and format
+    std::cout << "  - Configuring display (90° rotation)..." << std::endl;
+    configure(10);
+
+    if (displayOn) {
+        this->displayOn();
+    }
+
+    std::cout << "Display initialization complete!" << std::endl;
+}
+
+template <class Config, class Transport>
+bool ST7789_DriverT<Config, Transport>::resumeDisplay() {
+    if (!_statePath || !st7789_state_valid(_statePath)) {
+        return false;
+    }
+
+    std::cout << "Resuming ST7789 display (warm start, reset skipped)..." << std::endl;
+    configure(0);
+    return true;
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::configure(unsigned int settleMs) {
+    // Memory Access Control (90° rotation) and pixel format, sent as one
+    // transaction
+    beginTransaction();
+    writeCommand(ST7789_MADCTL);
+    writeData(Config::madctl);
+    writeCommand(ST7789_COLMOD);
+    if (_pixelFormat == ST7789_RGB444) {
+        writeData(ST7789_COLMOD_RGB444);  // 12-bit color
+    } else {
+        writeData(ST7789_COLMOD_RGB565);  // 16-bit color
+    }
+    endTransaction();
+
+    // Normal display mode, full colour
+    writeCommand(ST7789_NORON);
+    _transport.delayMs(settleMs);
+    writeCommand(ST7789_IDMOFF);
+
+    // Inversion on
+    writeCommand(ST7789_INVON);
+    _transport.delayMs(settleMs);
+
+    // A warm panel may have been left scrolled
+    beginTransaction();
+    setScrollArea(0, ST7789_SCROLL_LINES, 0);
+    setScrollStart(0);
+    endTransaction();
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::displayOn() {
+    std::cout << "  - Turning on display..." << std::endl;
+    writeCommand(ST7789_DISPON);
+    _transport.delayMs(120);
+    if (_statePath) {
+        st7789_state_write(_statePath);
+    }
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::beginTransaction() {
+    if (_txDepth++ == 0) {
+        _transport.select();
+    }
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::endTransaction() {
+    if (_txDepth == 1) {
+        flushPendingPixel();
+    }
+    if (--_txDepth == 0) {
+        _transport.deselect();
+    }
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::setDataMode(bool data) {
+    if (_dataMode != (int)data) {
+        _transport.setDataMode(data);
+        _dataMode = data;
+    }
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::writeCommand(uint8_t cmd) {
+    beginTransaction();
+    flushPendingPixel();
+    setDataMode(false);
+    _transport.write(&cmd, 1);
+    _bytesSent++;
+    endTransaction();
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::writeData(uint8_t data) {
+    writeData(&data, 1);
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::writeData(const uint8_t* data, uint32_t len) {
+    beginTransaction();
+    setDataMode(true);
+    _transport.write(data, len);
+    _bytesSent += len;
+    endTransaction();
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::setAddrWindow(uint16_t x0, uint16_t y0,
+                                                      uint16_t x1, uint16_t y1) {
+    const uint8_t columns[4] = {(uint8_t)(x0 >> 8), (uint8_t)(x0 & 0xFF),
+                                (uint8_t)(x1 >> 8), (uint8_t)(x1 & 0xFF)};
+    const uint8_t rows[4] = {(uint8_t)(y0 >> 8), (uint8_t)(y0 & 0xFF),
+                             (uint8_t)(y1 >> 8), (uint8_t)(y1 & 0xFF)};
+
+    beginTransaction();
+    writeCommand(ST7789_CASET);
+    writeData(columns, sizeof(columns));
+    writeCommand(ST7789_RASET);
+    writeData(rows, sizeof(rows));
+    writeCommand(ST7789_RAMWR);
+    endTransaction();
+}
+
+// Pack two RGB565 pixels into three RGB444 bytes: R1G1 B1R2 G2B2
+inline void st7789_pack_rgb444(uint8_t* out, uint16_t a, uint16_t b) {
+    out[0] = ((a >> 8) & 0xF0) | ((a >> 7) & 0x0F);
+    out[1] = ((a << 3) & 0xF0) | (b >> 12);
+    out[2] = ((b >> 3) & 0xF0) | ((b >> 1) & 0x0F);
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::writePixelData(const uint16_t* pixels, uint32_t count) {
+    if (_pixelFormat == ST7789_RGB565) {
+        _transport.writePixels(pixels, count);
+        _bytesSent += (uint64_t)count * 2;
+        return;
+    }
+
+    uint8_t chunk[ST7789_PIXEL_CHUNK / 2 * 3];
+    uint32_t len = 0;
+    if (_pendingPixel >= 0 && count > 0) {
+        st7789_pack_rgb444(chunk, (uint16_t)_pendingPixel, pixels[0]);
+        len = 3;
+        _pendingPixel = -1;
+        pixels++;
+        count--;
+    }
+    while (count >= 2) {
+        if (len == sizeof(chunk)) {
+            _transport.write(chunk, len);
+            _bytesSent += len;
+            len = 0;
+        }
+        st7789_pack_rgb444(chunk + len, pixels[0], pixels[1]);
+        len += 3;
+        pixels += 2;
+        count -= 2;
+    }
+    if (count > 0) {
+        _pendingPixel = pixels[0];
+    }
+    if (len > 0) {
+        _transport.write(chunk, len);
+        _bytesSent += len;
+    }
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::writeRepeatedData(uint16_t color, uint32_t count) {
+    if (_pixelFormat == ST7789_RGB565) {
+        _transport.writeRepeated(color, count);
+        _bytesSent += (uint64_t)count * 2;
+        return;
+    }
+
+    if (_pendingPixel >= 0 && count > 0) {
+        uint8_t pair[3];
+        st7789_pack_rgb444(pair, (uint16_t)_pendingPixel, color);
+        _transport.write(pair, 3);
+        _bytesSent += 3;
+        _pendingPixel = -1;
+        count--;
+    }
+
+    // Every pixel pair encodes to the same three bytes
+    uint8_t chunk[ST7789_PIXEL_CHUNK / 2 * 3];
+    uint32_t pairs = count / 2;
+    uint32_t n = pairs < ST7789_PIXEL_CHUNK / 2 ? pairs : ST7789_PIXEL_CHUNK / 2;
+    for (uint32_t i = 0; i < n; i++) {
+        st7789_pack_rgb444(chunk + 3 * i, color, color);
+    }
+    while (pairs > 0) {
+        n = pairs < ST7789_PIXEL_CHUNK / 2 ? pairs : ST7789_PIXEL_CHUNK / 2;
+        _transport.write(chunk, n * 3);
+        _bytesSent += n * 3;
+        pairs -= n;
+    }
+    if (count & 1) {
+        _pendingPixel = color;
+    }
+}
+
+// Send a held-back RGB444 pixel with its missing partner's nibbles zero;
+// the panel discards the incomplete second pixel
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::flushPendingPixel() {
+    if (_pendingPixel < 0) {
+        return;
+    }
+    uint8_t pair[3];
+    st7789_pack_rgb444(pair, (uint16_t)_pendingPixel, 0);
+    _pendingPixel = -1;
+    setDataMode(true);
+    _transport.write(pair, 2);
+    _bytesSent += 2;
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::pushPixel(uint16_t color) {
+    beginTransaction();
+    setDataMode(true);
+    writePixelData(&color, 1);
+    endTransaction();
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::pushPixels(const uint16_t* pixels, uint32_t count) {
+    beginTransaction();
+    setDataMode(true);
+    writePixelData(pixels, count);
+    endTransaction();
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::pushFramebuffer(const uint16_t* framebuffer,
+                                                        int width, int height) {
+    pushRect(framebuffer, width, 0, 0, width, height);
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::pushRect(const uint16_t* framebuffer, int stride,
+                                                 int x, int y, int w, int h) {
+    beginTransaction();
+    setAddrWindow(x, y, x + w - 1, y + h - 1);
+    setDataMode(true);
+    if (w == stride) {
+        // Contiguous rows: one call for the whole rectangle
+        writePixelData(framebuffer + y * stride, (uint32_t)w * h);
+    } else {
+        for (int row = y; row < y + h; row++) {
+            writePixelData(framebuffer + row * stride + x, w);
+        }
+    }
+    endTransaction();
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::pushWireRect(const uint16_t* framebuffer, int stride,
+                                                     int x, int y, int w, int h) {
+    beginTransaction();
+    setAddrWindow(x, y, x + w - 1, y + h - 1);
+    setDataMode(true);
+
+    if (_pixelFormat != ST7789_RGB565) {
+        // Packing works on host-order pixels: convert back a chunk at a time
+        uint16_t chunk[ST7789_PIXEL_CHUNK];
+        for (int row = y; row < y + h; row++) {
+            const uint16_t* line = framebuffer + row * stride + x;
+            for (int col = 0; col < w; col += ST7789_PIXEL_CHUNK) {
+                int n = w - col < ST7789_PIXEL_CHUNK ? w - col : ST7789_PIXEL_CHUNK;
+                for (int i = 0; i < n; i++) {
+                    chunk[i] = wire_color(line[col + i]);
+                }
+                writePixelData(chunk, n);
+            }
+        }
+        endTransaction();
+        return;
+    }
+
+    if (w == stride) {
+        // Contiguous rows: one transfer for the whole rectangle
+        _transport.write((const uint8_t*)(framebuffer + y * stride), (uint32_t)w * h * 2);
+    } else {
+        for (int row = y; row < y + h; row++) {
+            _transport.write((const uint8_t*)(framebuffer + row * stride + x), (uint32_t)w * 2);
+        }
+    }
+    _bytesSent += (uint64_t)w * h * 2;
+    endTransaction();
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::pushIndexedRect(const uint8_t* framebuffer,
+                                                        const uint16_t* palette, int stride,
+                                                        int x, int y, int w, int h) {
+    // Both pixels of every possible byte, so a pair expands with one load
+    uint32_t pairs[256];
+    for (int i = 0; i < 256; i++) {
+        uint16_t p[2] = {palette[i >> 4], palette[i & 0x0F]};
+        memcpy(&pairs[i], p, sizeof(p));
+    }
+
+    uint16_t chunk[ST7789_PIXEL_CHUNK];
+    beginTransaction();
+    setAddrWindow(x, y, x + w - 1, y + h - 1);
+    setDataMode(true);
+    for (int row = y; row < y + h; row++) {
+        const uint8_t* line = framebuffer + row * (stride / 2);
+        int col = x;
+        int end = x + w;
+        while (col < end) {
+            int n = 0;
+            if (col & 1) {
+                chunk[n++] = palette[line[col >> 1] & 0x0F];
+                col++;
+            }
+            int limit = end - col < ST7789_PIXEL_CHUNK - n ? end : col + ST7789_PIXEL_CHUNK - n;
+            for (; col + 1 < limit; col += 2, n += 2) {
+                memcpy(&chunk[n], &pairs[line[col >> 1]], sizeof(uint32_t));
+            }
+            if (col < limit) {
+                chunk[n++] = palette[line[col >> 1] >> 4];
+                col++;
+            }
+            writePixelData(chunk, n);
+        }
+    }
+    endTransaction();
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::fillSpan(uint16_t color, uint32_t count) {
+    beginTransaction();
+    setDataMode(true);
+    writeRepeatedData(color, count);
+    endTransaction();
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::fillRect(int x, int y, int w, int h, uint16_t color) {
+    // Clip to the panel; the bounds are compile-time constants
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > Config::width) w = Config::width - x;
+    if (y + h > Config::height) h = Config::height - y;
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+
+    beginTransaction();
+    setAddrWindow(x, y, x + w - 1, y + h - 1);
+    fillSpan(color, (uint32_t)w * h);
+    endTransaction();
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::setScrollArea(uint16_t top, uint16_t scroll,
+                                                      uint16_t bottom) {
+    const uint8_t params[6] = {(uint8_t)(top >> 8), (uint8_t)(top & 0xFF),
+                               (uint8_t)(scroll >> 8), (uint8_t)(scroll & 0xFF),
+                               (uint8_t)(bottom >> 8), (uint8_t)(bottom & 0xFF)};
+
+    beginTransaction();
+    writeCommand(ST7789_VSCRDEF);
+    writeData(params, sizeof(params));
+    endTransaction();
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::setScrollStart(uint16_t line) {
+    const uint8_t params[2] = {(uint8_t)(line >> 8), (uint8_t)(line & 0xFF)};
+
+    beginTransaction();
+    writeCommand(ST7789_VSCSAD);
+    writeData(params, sizeof(params));
+    endTransaction();
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::partialMode(uint16_t first, uint16_t last) {
+    const uint8_t params[4] = {(uint8_t)(first >> 8), (uint8_t)(first & 0xFF),
+                               (uint8_t)(last >> 8), (uint8_t)(last & 0xFF)};
+
+    beginTransaction();
+    writeCommand(ST7789_PTLAR);
+    writeData(params, sizeof(params));
+    writeCommand(ST7789_PTLON);
+    endTransaction();
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::normalMode() {
+    writeCommand(ST7789_NORON);
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::idleMode(bool on) {
+    writeCommand(on ? ST7789_IDMON : ST7789_IDMOFF);
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::tearingEffect(bool on) {
+    beginTransaction();
+    if (on) {
+        writeCommand(ST7789_TEON);
+        writeData(ST7789_TEON_VBLANK);
+    } else {
+        writeCommand(ST7789_TEOFF);
+    }
+    endTransaction();
+}
+
+template <class Config, class Transport>
+void ST7789_DriverT<Config, Transport>::powerDown() {
+    _transport.end();
+}
+
+#endif // ST7789_DRIVER_IMPL_H
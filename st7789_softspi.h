@@ -0,0 +1,98 @@
+// Fast software SPI engine for ST7789 displays
+// Bit-bangs MOSI/SCLK by writing the GPSET0/GPCLR0 registers directly
+// Using ST7789_TFT_RPI driver architecture with bcm2835 library
+
+#ifndef ST7789_SOFTSPI_H
+#define ST7789_SOFTSPI_H
+
+#include <bcm2835.h>
+#include <cstdint>
+
+// Shift out one bit, MSB first, SPI mode 0 (panel samples on the rising edge).
+// Bit is a template parameter so the 8-bit loop is unrolled at compile time
+// and the "was the previous bit already 1" test folds to a register test.
+//
+// Register stores per bit:
+//   0 bit:              GPCLR = SCLK|MOSI, GPSET = SCLK
+//   1 bit, MOSI high:   GPCLR = SCLK,      GPSET = SCLK
+//   1 bit, MOSI low:    GPSET = MOSI, GPCLR = SCLK, GPSET = SCLK
+// MOSI is only raised while SCLK is still high from the previous bit,
+// after the panel has already sampled it.
+template <int Bit>
+struct SoftSPIBits {
+    static inline void write(volatile uint32_t* gpset, volatile uint32_t* gpclr,
+                             uint32_t sclkMask, uint32_t dataMask, uint8_t byte) {
+        if (byte & (1 << Bit)) {
+            if (Bit == 7 || !(byte & (1 << (Bit + 1)))) {
+                *gpset = dataMask;
+            }
+            *gpclr = sclkMask;
+        } else {
+            *gpclr = sclkMask | dataMask;
+        }
+        *gpset = sclkMask;
+        SoftSPIBits<Bit - 1>::write(gpset, gpclr, sclkMask, dataMask, byte);
+    }
+};
+
+template <>
+struct SoftSPIBits<-1> {
+    static inline void write(volatile uint32_t*, volatile uint32_t*,
+                             uint32_t, uint32_t, uint8_t) {}
+};
+
+// Pins and the inter-edge delay are template parameters, so the masks are
+// immediates and the delay test disappears from the default (0) build
+template <uint8_t SclkPin, uint8_t DataPin, uint16_t HighFreqDelay>
+class SoftSPIEngine {
+private:
+    static const uint32_t sclkMask = 1u << SclkPin;
+    static const uint32_t dataMask = 1u << DataPin;
+
+    volatile uint32_t* _gpset;
+    volatile uint32_t* _gpclr;
+
+    // Slow path for long wires: same waveform as the original
+    // bcm2835_gpio_write loop, with a delay after each edge
+    static void writeByteDelayed(uint8_t byte) {
+        for (int i = 7; i >= 0; i--) {
+            bcm2835_gpio_write(SclkPin, LOW);
+            bcm2835_gpio_write(DataPin, (byte & (1 << i)) ? HIGH : LOW);
+            bcm2835_delayMicroseconds(HighFreqDelay);
+            bcm2835_gpio_write(SclkPin, HIGH);
+            bcm2835_delayMicroseconds(HighFreqDelay);
+        }
+    }
+
+public:
+    SoftSPIEngine() : _gpset(0), _gpclr(0) {}
+
+    // Map the GPIO set/clear registers; call after bcm2835_init()
+    void begin() {
+        volatile uint32_t* gpio = bcm2835_regbase(BCM2835_REGBASE_GPIO);
+        _gpset = gpio + BCM2835_GPSET0 / 4;
+        _gpclr = gpio + BCM2835_GPCLR0 / 4;
+    }
+
+    inline void writeByte(uint8_t byte) {
+        if (HighFreqDelay != 0) {
+            writeByteDelayed(byte);
+            return;
+        }
+        SoftSPIBits<7>::write(_gpset, _gpclr, sclkMask, dataMask, byte);
+    }
+
+    void write(const uint8_t* buf, uint32_t len) {
+        if (HighFreqDelay != 0) {
+            for (uint32_t i = 0; i < len; i++) {
+                writeByteDelayed(buf[i]);
+            }
+            return;
+        }
+        for (uint32_t i = 0; i < len; i++) {
+            SoftSPIBits<7>::write(_gpset, _gpclr, sclkMask, dataMask, buf[i]);
+        }
+    }
+};
+
+#endif // ST7789_SOFTSPI_H
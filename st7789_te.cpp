@@ -0,0 +1,178 @@
+// Tearing-effect (TE) synchronisation for the ST7789 display library
+
+#include "st7789_te.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/gpio.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "latency_histogram.h"
+
+#define TE_FRAME_LINES (ST7789_SCROLL_LINES + TE_BLANK_LINES)
+
+TearingSync::TearingSync()
+    : _fd(-1), _edgeNs(0), _nsPerByte(0), _periodNs(0), _blanks(0), _timeouts(0), _windows(0),
+      _held(0), _raced(0) {}
+
+TearingSync::~TearingSync() {
+    close();
+}
+
+bool TearingSync::open(int gpio, const char* chip) {
+    close();
+    int chip_fd = ::open(chip, O_RDONLY | O_CLOEXEC);
+    if (chip_fd < 0) {
+        std::cerr << "Error: cannot open " << chip << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    gpioevent_request request;
+    memset(&request, 0, sizeof(request));
+    request.lineoffset = gpio;
+    request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+    request.eventflags = GPIOEVENT_REQUEST_RISING_EDGE;
+    strncpy(request.consumer_label, "st7789-te", sizeof(request.consumer_label) - 1);
+    int result = ioctl(chip_fd, GPIO_GET_LINEEVENT_IOCTL, &request);
+    int err = errno;
+    ::close(chip_fd);
+    if (result < 0) {
+        std::cerr << "Error: cannot watch GPIO" << gpio << " on " << chip << ": " << strerror(err)
+                  << std::endl;
+        return false;
+    }
+
+    // Non-blocking, so queued edges can be drained without waiting
+    _fd = request.fd;
+    fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK);
+    fcntl(_fd, F_SETFD, FD_CLOEXEC);
+    return true;
+}
+
+void TearingSync::close() {
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+    _fd = -1;
+    _edgeNs = 0;
+}
+
+bool TearingSync::waitForBlank() {
+    _edgeNs = 0;
+    if (_fd < 0) {
+        return false;
+    }
+
+    // The queue holds consecutive edges since the last wait (the kernel
+    // drops the newest when it is full), so their spacing is the period
+    gpioevent_data events[TE_QUEUED_EDGES];
+    uint64_t first = 0, last = 0;
+    int queued = 0;
+    ssize_t got;
+    while ((got = read(_fd, events, sizeof(events))) >= (ssize_t)sizeof(events[0])) {
+        for (int i = 0; i < got / (ssize_t)sizeof(events[0]); i++) {
+            if (queued++ == 0) {
+                first = events[i].timestamp;
+            }
+            last = events[i].timestamp;
+        }
+    }
+    if (queued >= 2) {
+        int64_t period = (int64_t)(last - first) / (queued - 1);
+        if (period >= TE_PERIOD_MIN_NS && period <= TE_PERIOD_MAX_NS) {
+            _periodNs.store(period, std::memory_order_relaxed);
+        }
+    }
+
+    pollfd pfd;
+    pfd.fd = _fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, TE_TIMEOUT_MS) <= 0 || read(_fd, events, sizeof(events[0])) <= 0) {
+        _timeouts.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    // Kernels before 5.7 stamp edges with CLOCK_REALTIME; then the wakeup
+    // time stands in for the edge
+    int64_t now = monotonic_ns();
+    int64_t stamp = (int64_t)events[0].timestamp;
+    _edgeNs = stamp <= now && now - stamp < TE_PERIOD_MAX_NS ? stamp : now;
+    _blanks.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+double TearingSync::lineNs() const {
+    return (double)_periodNs.load(std::memory_order_relaxed) / TE_FRAME_LINES;
+}
+
+double TearingSync::scanPosition(int64_t ns) const {
+    return (ns - _edgeNs) / lineNs() - TE_BLANK_LINES;
+}
+
+// Does the scan, moving from position `from` to `to`, cross lines
+// first..last in any frame?
+bool TearingSync::crosses(double from, double to, int first, int last) {
+    for (long frame = (long)floor(from / TE_FRAME_LINES) - 1;
+         frame <= (long)floor(to / TE_FRAME_LINES); frame++) {
+        double top = (double)frame * TE_FRAME_LINES;
+        if (top + first <= to && top + last + 1 > from) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TearingSync::beforeWindow(int first, int last, uint64_t bytes) {
+    if (_edgeNs == 0 || _periodNs.load(std::memory_order_relaxed) == 0 || _nsPerByte == 0) {
+        return;
+    }
+    double line_ns = lineNs();
+    double length = bytes * _nsPerByte / line_ns;  // Lines the scan covers meanwhile
+    double now = scanPosition(monotonic_ns());
+    if (!crosses(now, now + length, first, last)) {
+        return;
+    }
+
+    // Start just behind the scan instead, if the window is then written
+    // before the scan comes round to it again
+    double start = ceil((now - last - 1) / TE_FRAME_LINES) * TE_FRAME_LINES + last + 1;
+    if (crosses(start, start + length, first, last)) {
+        return;
+    }
+    int64_t wake = _edgeNs + (int64_t)((start + TE_BLANK_LINES) * line_ns);
+    timespec ts;
+    ts.tv_sec = wake / 1000000000LL;
+    ts.tv_nsec = wake % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+    _held.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TearingSync::afterWindow(int first, int last, uint64_t bytes, int64_t start_ns,
+                              int64_t end_ns) {
+    if (_edgeNs == 0) {
+        return;
+    }
+    _windows.fetch_add(1, std::memory_order_relaxed);
+
+    // Small windows are mostly command overhead and say little about speed
+    if (bytes >= 256) {
+        double sample = (double)(end_ns - start_ns) / bytes;
+        _nsPerByte = _nsPerByte == 0 ? sample : 0.75 * _nsPerByte + 0.25 * sample;
+    }
+    if (_periodNs.load(std::memory_order_relaxed) != 0 &&
+        crosses(scanPosition(start_ns), scanPosition(end_ns), first, last)) {
+        _raced.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+double TearingSync::refreshHz() const {
+    int64_t period = _periodNs.load(std::memory_order_relaxed);
+    return period > 0 ? 1e9 / period : 0;
+}
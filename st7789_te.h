@@ -0,0 +1,84 @@
+// Tearing-effect (TE) synchronisation for the ST7789 display library
+// With TEON the panel raises its TE pin at the start of every vertical
+// blank. TearingSync watches that pin through the gpiochip character
+// device (a kernel edge interrupt, no polling), so a flush can start right
+// after the blank and pace its windows against the scan: the panel reads
+// its memory line by line (display columns with the default MADCTL, in
+// ascending order) while the windows are written.
+
+#ifndef ST7789_TE_H
+#define ST7789_TE_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "st7789.h"
+
+#define TE_DEFAULT_CHIP "/dev/gpiochip0"  // BCM GPIOs on Pi 1-4 (gpiochip4 on a Pi 5)
+#define TE_BLANK_LINES 24      // Default PORCTRL porches: lines from the TE edge to line 0
+#define TE_TIMEOUT_MS 100      // Flush unpaced if no edge arrives within this
+#define TE_QUEUED_EDGES 16     // Edges the kernel queues between waits
+#define TE_PERIOD_MIN_NS 5000000LL    // Plausible refresh periods (200 Hz)
+#define TE_PERIOD_MAX_NS 100000000LL  // ... to 10 Hz
+
+// Not thread-safe, except that the counters may be read from another
+// thread for stats
+class TearingSync {
+public:
+    TearingSync();
+    ~TearingSync();
+
+    // Watch rising edges on a GPIO line of a gpiochip (on a Pi, line n of
+    // gpiochip0 is BCM GPIO n). Returns false (with a message on stderr)
+    // if the line cannot be requested.
+    bool open(int gpio, const char* chip = TE_DEFAULT_CHIP);
+    void close();
+    bool isOpen() const { return _fd >= 0; }
+
+    // Measure the refresh period from the edges queued since the last
+    // call, then block until the next edge. Returns false after
+    // TE_TIMEOUT_MS without one (TE not wired, panel asleep); the windows
+    // are then sent unpaced.
+    bool waitForBlank();
+
+    // Before writing a window over memory lines first..last (display
+    // columns) costing bytes on the bus: if at the measured bus speed the
+    // scan would run into it, wait until the scan has passed it
+    void beforeWindow(int first, int last, uint64_t bytes);
+
+    // After writing it: counts it as raced if the scan crossed it, and
+    // refines the bus speed estimate
+    void afterWindow(int first, int last, uint64_t bytes, int64_t start_ns, int64_t end_ns);
+
+    // Refresh rate measured from TE, 0 until known
+    double refreshHz() const;
+
+    uint64_t blanks() const { return _blanks.load(std::memory_order_relaxed); }
+    uint64_t timeouts() const { return _timeouts.load(std::memory_order_relaxed); }
+    uint64_t windows() const { return _windows.load(std::memory_order_relaxed); }
+    uint64_t held() const { return _held.load(std::memory_order_relaxed); }    // Waited for the scan
+    uint64_t raced() const { return _raced.load(std::memory_order_relaxed); }  // May have torn
+
+private:
+    int _fd;
+    int64_t _edgeNs;   // Last blank waited for (monotonic_ns), 0 if unknown
+    double _nsPerByte; // Smoothed bus speed, 0 until measured
+    std::atomic<int64_t> _periodNs;
+    std::atomic<uint64_t> _blanks;
+    std::atomic<uint64_t> _timeouts;
+    std::atomic<uint64_t> _windows;
+    std::atomic<uint64_t> _held;
+    std::atomic<uint64_t> _raced;
+
+    // Scan position at ns, in lines since the first line after _edgeNs;
+    // line m of frame k is scanned at k * (ST7789_SCROLL_LINES +
+    // TE_BLANK_LINES) + m
+    double scanPosition(int64_t ns) const;
+    double lineNs() const;
+    static bool crosses(double from, double to, int first, int last);
+
+    TearingSync(const TearingSync&);
+    TearingSync& operator=(const TearingSync&);
+};
+
+#endif // ST7789_TE_H
@@ -0,0 +1,83 @@
+// Bus trace recording for the ST7789 display library
+// RecordingTransport sits between the driver and a real (or null)
+// transport and writes every pin change and byte burst to a compact
+// binary trace. trace_replay plays a trace back into a virtual panel on
+// any machine, to look at the frames and count what they cost on the bus.
+
+#ifndef ST7789_TRACE_H
+#define ST7789_TRACE_H
+
+#include <cstdint>
+#include <cstdio>
+
+#include "st7789.h"
+
+#define TRACE_MAGIC 0x52543753u  // "S7TR"
+#define TRACE_VERSION 1
+#define TRACE_MAX_LABEL 255
+
+// File layout: TraceHeader, then records of one op byte followed by its
+// operands, little-endian
+struct TraceHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint16_t width;   // Panel the trace was recorded for
+    uint16_t height;
+    uint32_t reserved;
+};
+
+enum TraceOp {
+    TRACE_RESET_LOW = 1,
+    TRACE_RESET_HIGH,
+    TRACE_COMMAND_MODE,  // DC low
+    TRACE_DATA_MODE,     // DC high
+    TRACE_SELECT,        // CS low
+    TRACE_DESELECT,      // CS high
+    TRACE_BYTE,          // u8: a one-byte write (commands, most parameters)
+    TRACE_WRITE,         // u32 length, then the bytes
+    TRACE_REPEAT,        // u16 RGB565 colour, u32 count: count pixels big-endian
+    TRACE_DELAY,         // u32 milliseconds
+    TRACE_MARK           // u8 length, then a label: end of a frame or test step
+};
+
+// Transport that records everything the driver sends, and forwards it to
+// inner if one is given (so a real panel keeps working while recording).
+// Repeated fills are stored as one record rather than their bytes.
+class RecordingTransport : public ST7789_Transport {
+public:
+    explicit RecordingTransport(ST7789_Transport* inner = nullptr);
+    ~RecordingTransport();
+
+    // Start a trace file. Returns false (with a message on stderr) if it
+    // cannot be created.
+    bool open(const char* path);
+    void close();
+
+    // End of a frame or test step; replay statistics are grouped by label
+    void mark(const char* label);
+
+    bool begin();
+    void end();
+    void setReset(bool high);
+    void setDataMode(bool data);
+    void select();
+    void deselect();
+    void write(const uint8_t* buf, uint32_t len);
+    void delayMs(unsigned int ms);
+    void writePixels(const uint16_t* pixels, uint32_t count);
+    void writeRepeated(uint16_t color, uint32_t count);
+
+private:
+    ST7789_Transport* _inner;
+    FILE* _file;
+
+    void op(uint8_t code);
+    void u16(uint16_t value);
+    void u32(uint32_t value);
+    void record(const uint8_t* buf, uint32_t len);
+
+    RecordingTransport(const RecordingTransport&);
+    RecordingTransport& operator=(const RecordingTransport&);
+};
+
+#endif // ST7789_TRACE_H
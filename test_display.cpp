@@ -2,206 +2,37 @@
 // Tests various display functions and patterns
 // Using ST7789_TFT_RPI driver architecture with bcm2835 library
 
-#include <bcm2835.h>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <iostream>
 #include <signal.h>
 #include <unistd.h>
 
-#define DISPLAY_WIDTH 320
-#define DISPLAY_HEIGHT 240
-
-// GPIO Pin Configuration (Software SPI - matches ST7789_TFT_RPI SW SPI setup)
-#define TFT_CS_GPIO    RPI_BPLUS_GPIO_J8_32  // GPIO12 - CS/SS pin
-#define TFT_DC_GPIO    RPI_BPLUS_GPIO_J8_18  // GPIO24 - DC pin
-#define TFT_RST_GPIO   RPI_BPLUS_GPIO_J8_22  // GPIO25 - RESET pin
-#define TFT_SDATA_GPIO RPI_BPLUS_GPIO_J8_35  // GPIO19 - MOSI/SDA pin
-#define TFT_SCLK_GPIO  RPI_BPLUS_GPIO_J8_37  // GPIO26 - SCLK pin
-// Note: LED/Backlight connected to VCC (always on, no GPIO control needed)
-
-#define TFT_HIGHFREQ_DELAY 0  // Microseconds delay between bit operations
-
-#define ST7789_SWRESET 0x01
-#define ST7789_RDDID 0x04
-#define ST7789_RDDST 0x09
-#define ST7789_SLPOUT 0x11
-#define ST7789_NORON 0x13
-#define ST7789_INVON 0x21
-#define ST7789_DISPON 0x29
-#define ST7789_CASET 0x2A
-#define ST7789_RASET 0x2B
-#define ST7789_RAMWR 0x2C
-#define ST7789_MADCTL 0x36
-#define ST7789_COLMOD 0x3A
-
-// Colors
-#define COLOR_BLACK 0x0000
-#define COLOR_WHITE 0xFFFF
-#define COLOR_RED 0xF800
-#define COLOR_GREEN 0x07E0
-#define COLOR_BLUE 0x001F
-#define COLOR_CYAN 0x07FF
-#define COLOR_MAGENTA 0xF81F
-#define COLOR_YELLOW 0xFFE0
+#include "gfx.h"
+#include "st7789.h"
+#include "st7789_bcm2835.h"
+#include "st7789_trace.h"
 
 volatile bool running = true;
-uint16_t _highFreqDelay = TFT_HIGHFREQ_DELAY;
+ST7789_Driver* display = nullptr;
+RecordingTransport* recorder = nullptr;  // With --record
 
 void signal_handler(int signo) {
     running = false;
 }
 
-// Software SPI bit-banging (matching ST7789_TFT_RPI implementation)
-void spiWriteByte(uint8_t byte) {
-    for (int i = 7; i >= 0; i--) {
-        bcm2835_gpio_write(TFT_SCLK_GPIO, LOW);
-        if (byte & (1 << i)) {
-            bcm2835_gpio_write(TFT_SDATA_GPIO, HIGH);
-        } else {
-            bcm2835_gpio_write(TFT_SDATA_GPIO, LOW);
-        }
-        if (_highFreqDelay != 0) {
-            bcm2835_delayMicroseconds(_highFreqDelay);
-        }
-        bcm2835_gpio_write(TFT_SCLK_GPIO, HIGH);
-        if (_highFreqDelay != 0) {
-            bcm2835_delayMicroseconds(_highFreqDelay);
-        }
-    }
-}
-
-void spi_write_command(uint8_t cmd) {
-    bcm2835_gpio_write(TFT_DC_GPIO, LOW);  // Command mode
-    bcm2835_gpio_write(TFT_CS_GPIO, LOW);  // CS low (select)
-    spiWriteByte(cmd);
-    bcm2835_gpio_write(TFT_CS_GPIO, HIGH); // CS high (deselect)
-}
-
-void spi_write_data(const uint8_t* data, int len) {
-    bcm2835_gpio_write(TFT_DC_GPIO, HIGH); // Data mode
-    bcm2835_gpio_write(TFT_CS_GPIO, LOW);  // CS low (select)
-    for (int i = 0; i < len; i++) {
-        spiWriteByte(data[i]);
-    }
-    bcm2835_gpio_write(TFT_CS_GPIO, HIGH); // CS high (deselect)
-}
-
-void spi_write_data_u16(uint16_t data) {
-    uint8_t bytes[2] = {(uint8_t)(data >> 8), (uint8_t)(data & 0xFF)};
-    spi_write_data(bytes, 2);
-}
-
-// Forward declarations
-void set_window(int x0, int y0, int x1, int y1);
-void spi_write_data_u16(uint16_t data);
-
 void init_display() {
     // Note: Backlight is connected to VCC (always on)
 
-    std::cout << "  Performing hardware reset..." << std::endl;
-    bcm2835_gpio_write(TFT_RST_GPIO, HIGH);
-    bcm2835_delay(10);
-    bcm2835_gpio_write(TFT_RST_GPIO, LOW);
-    bcm2835_delay(50);
-    bcm2835_gpio_write(TFT_RST_GPIO, HIGH);
-    bcm2835_delay(150);
-
-    std::cout << "  Software reset..." << std::endl;
-    spi_write_command(ST7789_SWRESET);
-    bcm2835_delay(200);
-
-    std::cout << "  Waking up display..." << std::endl;
-    spi_write_command(ST7789_SLPOUT);
-    bcm2835_delay(120);
-
-    std::cout << "  Configuring display (90° rotation)..." << std::endl;
-    spi_write_command(ST7789_MADCTL);
-    uint8_t madctl = 0x60; // 90° rotation
-    spi_write_data(&madctl, 1);
-
-    spi_write_command(ST7789_COLMOD);
-    uint8_t colmod = 0x55;
-    spi_write_data(&colmod, 1);
-
-    spi_write_command(ST7789_NORON);
-    bcm2835_delay(10);
-
-    spi_write_command(ST7789_INVON);
-    bcm2835_delay(10);
+    // Reset and configure, but keep the panel blank until it is cleared
+    display->initDisplay(false);
 
     std::cout << "  Clearing screen to black..." << std::endl;
-    set_window(0, 0, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1);
-    for (int i = 0; i < DISPLAY_WIDTH * DISPLAY_HEIGHT; i++) {
-        spi_write_data_u16(COLOR_BLACK);
-    }
+    fill_screen(*display, COLOR_BLACK);
     bcm2835_delay(50);
 
-    std::cout << "  Turning on display..." << std::endl;
-    spi_write_command(ST7789_DISPON);
-    bcm2835_delay(120);
-}
-
-void set_window(int x0, int y0, int x1, int y1) {
-    spi_write_command(ST7789_CASET);
-    spi_write_data_u16(x0);
-    spi_write_data_u16(x1);
-
-    spi_write_command(ST7789_RASET);
-    spi_write_data_u16(y0);
-    spi_write_data_u16(y1);
-
-    spi_write_command(ST7789_RAMWR);
-}
-
-void fill_screen(uint16_t color) {
-    set_window(0, 0, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1);
-
-    for (int i = 0; i < DISPLAY_WIDTH * DISPLAY_HEIGHT; i++) {
-        spi_write_data_u16(color);
-    }
-}
-
-void draw_gradient() {
-    set_window(0, 0, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1);
-
-    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
-        for (int x = 0; x < DISPLAY_WIDTH; x++) {
-            uint8_t r = (x * 31) / DISPLAY_WIDTH;
-            uint8_t g = (y * 63) / DISPLAY_HEIGHT;
-            uint8_t b = ((x + y) * 31) / (DISPLAY_WIDTH + DISPLAY_HEIGHT);
-            uint16_t color = (r << 11) | (g << 5) | b;
-            spi_write_data_u16(color);
-        }
-    }
-}
-
-void draw_color_bars() {
-    set_window(0, 0, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1);
-
-    uint16_t colors[] = {COLOR_WHITE, COLOR_YELLOW, COLOR_CYAN,
-                        COLOR_GREEN, COLOR_MAGENTA, COLOR_RED,
-                        COLOR_BLUE, COLOR_BLACK};
-    int bar_width = DISPLAY_WIDTH / 8;
-
-    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
-        for (int x = 0; x < DISPLAY_WIDTH; x++) {
-            int bar_index = x / bar_width;
-            if (bar_index >= 8) bar_index = 7;
-            spi_write_data_u16(colors[bar_index]);
-        }
-    }
-}
-
-void draw_checkerboard(int square_size) {
-    set_window(0, 0, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1);
-
-    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
-        for (int x = 0; x < DISPLAY_WIDTH; x++) {
-            bool is_white = ((x / square_size) + (y / square_size)) % 2 == 0;
-            spi_write_data_u16(is_white ? COLOR_WHITE : COLOR_BLACK);
-        }
-    }
+    display->displayOn();
 }
 
 void test_backlight() {
@@ -210,6 +41,13 @@ void test_backlight() {
     sleep(1);
 }
 
+// End of a test step in the bus trace, if one is being recorded
+void mark_step(const char* label) {
+    if (recorder) {
+        recorder->mark(label);
+    }
+}
+
 bool test_spi_communication() {
     std::cout << "Testing SPI communication..." << std::endl;
     std::cout << "  Note: Software SPI read operations not implemented" << std::endl;
@@ -217,7 +55,28 @@ bool test_spi_communication() {
     return true;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    TransportConfig transport_config;
+    const char* record_path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+            continue;
+        }
+        int parsed = parseTransportOption(argc, argv, i, transport_config);
+        if (parsed < 0) {
+            return 1;
+        }
+        if (parsed == 0) {
+            std::cerr << "Usage: " << argv[0] << " [--hw-spi] [--spi-divider N] [--record FILE]"
+                      << std::endl;
+            printTransportUsage();
+            std::cerr << "  --record FILE    Write a bus trace of every test step for trace_replay"
+                      << std::endl;
+            return 1;
+        }
+    }
+
     std::cout << "=====================================" << std::endl;
     std::cout << "ST7789 Display Test Suite (90° rotation)" << std::endl;
     std::cout << "Using ST7789_TFT_RPI Architecture" << std::endl;
@@ -226,38 +85,42 @@ int main() {
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
 
-    // Test 1: Initialize bcm2835 library
-    std::cout << "\n[Test 1] Initializing bcm2835 library..." << std::endl;
-    if (!bcm2835_init()) {
-        std::cerr << "  FAILED: bcm2835_init failed" << std::endl;
+    ST7789_Transport* transport = createTransport(transport_config);
+    if (record_path) {
+        recorder = new RecordingTransport(transport);
+        if (!recorder->open(record_path)) {
+            delete recorder;
+            delete transport;
+            return 1;
+        }
+    }
+    display = new ST7789_Driver(recorder ? *recorder : *transport);
+
+    // Test 1: Initialize bcm2835 library and GPIO pins
+    std::cout << "\n[Test 1] Initializing bcm2835 library and GPIO pins..." << std::endl;
+    if (!display->setupGPIO()) {
+        std::cerr << "  FAILED: transport setup failed" << std::endl;
         std::cerr << "  Are you running as root? Try: sudo ./test_display" << std::endl;
+        delete display;
+        delete recorder;
+        delete transport;
         return 1;
     }
-    std::cout << "  PASSED: bcm2835 library initialized" << std::endl;
-
-    // Test 2: Setup GPIO pins for Software SPI
-    std::cout << "\n[Test 2] Setting up GPIO pins (Software SPI)..." << std::endl;
-    bcm2835_gpio_fsel(TFT_CS_GPIO, BCM2835_GPIO_FSEL_OUTP);
-    bcm2835_gpio_fsel(TFT_DC_GPIO, BCM2835_GPIO_FSEL_OUTP);
-    bcm2835_gpio_fsel(TFT_RST_GPIO, BCM2835_GPIO_FSEL_OUTP);
-    bcm2835_gpio_fsel(TFT_SDATA_GPIO, BCM2835_GPIO_FSEL_OUTP);
-    bcm2835_gpio_fsel(TFT_SCLK_GPIO, BCM2835_GPIO_FSEL_OUTP);
-
-    bcm2835_gpio_write(TFT_CS_GPIO, HIGH);
-    bcm2835_gpio_write(TFT_SCLK_GPIO, LOW);
-    bcm2835_gpio_write(TFT_SDATA_GPIO, LOW);
-
-    std::cout << "  GPIO Pin Configuration:" << std::endl;
-    std::cout << "    CS:    GPIO12 (Pin 32)" << std::endl;
-    std::cout << "    DC:    GPIO24 (Pin 18)" << std::endl;
-    std::cout << "    RESET: GPIO25 (Pin 22)" << std::endl;
-    std::cout << "    MOSI:  GPIO19 (Pin 35)" << std::endl;
-    std::cout << "    SCLK:  GPIO26 (Pin 37)" << std::endl;
-    std::cout << "  PASSED: GPIO pins configured" << std::endl;
+    std::cout << "  PASSED: bcm2835 library initialized, GPIO pins configured" << std::endl;
+
+    // Test 2: Report the SPI transport in use
+    std::cout << "\n[Test 2] Checking SPI transport..." << std::endl;
+    if (transport_config.hardwareSPI) {
+        std::cout << "  Hardware SPI0, clock divider " << transport_config.clockDivider << std::endl;
+    } else {
+        std::cout << "  Software SPI (bit-banged on GPIO12/19/26)" << std::endl;
+    }
+    std::cout << "  PASSED: SPI transport ready" << std::endl;
 
     // Test 3: Initialize display
     std::cout << "\n[Test 3] Initializing display..." << std::endl;
     init_display();
+    mark_step("init");
     std::cout << "  PASSED: Display initialized" << std::endl;
 
     // Test 4: SPI Communication
@@ -288,7 +151,8 @@ int main() {
 
     for (int i = 0; i < 5 && running; i++) {
         std::cout << "  Filling screen with " << colors[i].name << "..." << std::endl;
-        fill_screen(colors[i].color);
+        fill_screen(*display, colors[i].color);
+        mark_step(colors[i].name);
         sleep(1);
     }
     std::cout << "  PASSED: Color fills working" << std::endl;
@@ -297,7 +161,8 @@ int main() {
 
     // Test 7: Color bars
     std::cout << "\n[Test 7] Testing color bars..." << std::endl;
-    draw_color_bars();
+    draw_color_bars(*display);
+    mark_step("color bars");
     std::cout << "  Displaying color bars for 3 seconds..." << std::endl;
     sleep(3);
     std::cout << "  PASSED: Color bars working" << std::endl;
@@ -306,7 +171,8 @@ int main() {
 
     // Test 8: Gradient
     std::cout << "\n[Test 8] Testing gradient..." << std::endl;
-    draw_gradient();
+    draw_gradient(*display);
+    mark_step("gradient");
     std::cout << "  Displaying gradient for 3 seconds..." << std::endl;
     sleep(3);
     std::cout << "  PASSED: Gradient working" << std::endl;
@@ -319,7 +185,10 @@ int main() {
         int square_sizes[] = {40, 20, 10, 5};
         for (int i = 0; i < 4 && running; i++) {
             std::cout << "  Checkerboard " << square_sizes[i] << "x" << square_sizes[i] << "..." << std::endl;
-            draw_checkerboard(square_sizes[i]);
+            draw_checkerboard(*display, square_sizes[i]);
+            char label[32];
+            snprintf(label, sizeof(label), "checkerboard %d", square_sizes[i]);
+            mark_step(label);
             sleep(1);
         }
         std::cout << "  PASSED: Checkerboard patterns working" << std::endl;
@@ -332,7 +201,8 @@ int main() {
         time_t start_time = time(nullptr);
         int frame_count = 0;
         while (running && (time(nullptr) - start_time) < 5) {
-            fill_screen(colors[frame_count % 5].color);
+            fill_screen(*display, colors[frame_count % 5].color);
+            mark_step("stress");
             frame_count++;
         }
         std::cout << "  PASSED: " << frame_count << " frames rendered (~"
@@ -349,8 +219,12 @@ cleanup:
     std::cout << "=====================================" << std::endl;
 
     // Cleanup
-    fill_screen(COLOR_BLACK);
-    bcm2835_close();
+    fill_screen(*display, COLOR_BLACK);
+    display->powerDown();
+    mark_step("power down");
+    delete display;
+    delete recorder;
+    delete transport;
 
     return 0;
 }
@@ -0,0 +1,606 @@
+// Host tool: replay an ST7789 bus trace (st7789_trace.h) into a virtual
+// 320x240 panel. Reports bytes, windows and commands per frame, grouped by
+// mark label, writes frames as PNG files, and compares two traces frame by
+// frame, pixels and bus cost, e.g. the same `bench --record` run from two
+// builds. Needs neither a Pi nor bcm2835.
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "st7789.h"
+#include "st7789_trace.h"
+
+#define REPLAY_MAX_REPORTED 10  // Mismatching frames listed in full when comparing
+
+// Bus activity since the last mark
+struct BusCounters {
+    uint64_t bytes;
+    uint64_t commands;
+    uint64_t windows;   // RAMWR commands
+    uint64_t selects;   // CS assertions, one per transaction
+    uint64_t delayMs;
+
+    BusCounters() : bytes(0), commands(0), windows(0), selects(0), delayMs(0) {}
+};
+
+// What the controller does with the bytes: frame memory, address window,
+// pixel format and vertical scroll. MADCTL is taken to be the driver's
+// landscape 0x60, so column and row addresses are display x and y.
+class VirtualPanel {
+public:
+    BusCounters counters;
+
+    VirtualPanel() { reset(); memset(_memory, 0, sizeof(_memory)); }
+
+    void setReset(bool high) {
+        if (!high) reset();
+    }
+    void setDataMode(bool data) { _data = data; }
+    void select() {
+        _selected = true;
+        counters.selects++;
+    }
+    void deselect() { _selected = false; }
+
+    void byte(uint8_t b) {
+        counters.bytes++;
+        if (!_selected) {
+            return;
+        }
+        if (_data) {
+            data(b);
+        } else {
+            command(b);
+        }
+    }
+
+    // The frame as it appears on the glass: memory lines (display columns)
+    // pass through the vertical scroll
+    void render(uint16_t* out) const {
+        for (int x = 0; x < DISPLAY_WIDTH; x++) {
+            int line = x;
+            if (x >= _scrollTop && x < _scrollTop + _scrollLines && _scrollLines > 0) {
+                line = _scrollTop + (x - _scrollTop + _scrollStart - _scrollTop + 2 * _scrollLines) %
+                       _scrollLines;
+            }
+            if (line < 0 || line >= DISPLAY_WIDTH) {
+                line = x;
+            }
+            for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+                out[y * DISPLAY_WIDTH + x] = _memory[y * DISPLAY_WIDTH + line];
+            }
+        }
+    }
+
+private:
+    uint16_t _memory[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+    bool _data, _selected;
+    uint8_t _command;
+    int _param;
+    uint8_t _params[6];
+    int _x0, _x1, _y0, _y1, _cx, _cy;
+    uint8_t _colmod;
+    uint8_t _pixel[3];
+    int _pixelBytes;
+    int _scrollTop, _scrollLines, _scrollStart;
+
+    void reset() {
+        _data = false;
+        _selected = false;
+        _command = ST7789_NOP;
+        _param = 0;
+        _x0 = _y0 = 0;
+        _x1 = DISPLAY_WIDTH - 1;
+        _y1 = DISPLAY_HEIGHT - 1;
+        _cx = _cy = 0;
+        _colmod = ST7789_COLMOD_RGB565;
+        _pixelBytes = 0;
+        _scrollTop = 0;
+        _scrollLines = ST7789_SCROLL_LINES;
+        _scrollStart = 0;
+    }
+
+    void command(uint8_t b) {
+        counters.commands++;
+        _command = b;
+        _param = 0;
+        _pixelBytes = 0;
+        if (b == ST7789_RAMWR) {
+            counters.windows++;
+            _cx = _x0;
+            _cy = _y0;
+        } else if (b == ST7789_SWRESET) {
+            reset();
+            _selected = true;
+        }
+    }
+
+    void pixel(uint16_t color) {
+        if (_cx < DISPLAY_WIDTH && _cy < DISPLAY_HEIGHT) {
+            _memory[_cy * DISPLAY_WIDTH + _cx] = color;
+        }
+        if (++_cx > _x1) {
+            _cx = _x0;
+            if (++_cy > _y1) {
+                _cy = _y0;
+            }
+        }
+    }
+
+    void data(uint8_t b) {
+        if (_command == ST7789_RAMWR) {
+            _pixel[_pixelBytes++] = b;
+            if (_colmod == ST7789_COLMOD_RGB444) {
+                // Two pixels in three bytes: RG BR GB, 4 bits each
+                if (_pixelBytes == 3) {
+                    pixel(rgb444(_pixel[0] >> 4, _pixel[0] & 0xF, _pixel[1] >> 4));
+                    pixel(rgb444(_pixel[1] & 0xF, _pixel[2] >> 4, _pixel[2] & 0xF));
+                    _pixelBytes = 0;
+                }
+            } else if (_pixelBytes == 2) {
+                pixel((uint16_t)((_pixel[0] << 8) | _pixel[1]));
+                _pixelBytes = 0;
+            }
+            return;
+        }
+
+        if (_param < (int)sizeof(_params)) {
+            _params[_param] = b;
+        }
+        _param++;
+        switch (_command) {
+        case ST7789_CASET:
+            if (_param == 4) {
+                _x0 = (_params[0] << 8) | _params[1];
+                _x1 = (_params[2] << 8) | _params[3];
+            }
+            break;
+        case ST7789_RASET:
+            if (_param == 4) {
+                _y0 = (_params[0] << 8) | _params[1];
+                _y1 = (_params[2] << 8) | _params[3];
+            }
+            break;
+        case ST7789_COLMOD:
+            _colmod = b;
+            break;
+        case ST7789_VSCRDEF:
+            if (_param == 6) {
+                _scrollTop = (_params[0] << 8) | _params[1];
+                _scrollLines = (_params[2] << 8) | _params[3];
+            }
+            break;
+        case ST7789_VSCSAD:
+            if (_param == 2) {
+                _scrollStart = (_params[0] << 8) | _params[1];
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    static uint16_t rgb444(int r, int g, int b) {
+        return (uint16_t)(((r << 1 | r >> 3) << 11) | ((g << 2 | g >> 2) << 5) | (b << 1 | b >> 3));
+    }
+};
+
+// Reads records and applies them to a panel, a frame (mark) at a time
+class TraceReader {
+public:
+    TraceReader() : _file(nullptr), _path(nullptr) {}
+    ~TraceReader() {
+        if (_file) fclose(_file);
+    }
+
+    bool open(const char* path) {
+        _path = path;
+        _file = fopen(path, "rb");
+        if (!_file) {
+            std::cerr << "Error: cannot open trace " << path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        TraceHeader header;
+        if (fread(&header, sizeof(header), 1, _file) != 1 || header.magic != TRACE_MAGIC ||
+            header.version != TRACE_VERSION) {
+            std::cerr << "Error: " << path << " is not a trace of this version" << std::endl;
+            return false;
+        }
+        if (header.width != DISPLAY_WIDTH || header.height != DISPLAY_HEIGHT) {
+            std::cerr << "Error: " << path << " was recorded for a " << header.width << "x"
+                      << header.height << " panel" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Replay up to the next mark. Returns 1 with its label, 0 at the end of
+    // the trace, -1 if the trace is damaged.
+    int next(VirtualPanel& panel, std::string& label) {
+        panel.counters = BusCounters();
+        int code;
+        while ((code = getc(_file)) != EOF) {
+            switch (code) {
+            case TRACE_RESET_LOW: panel.setReset(false); break;
+            case TRACE_RESET_HIGH: panel.setReset(true); break;
+            case TRACE_COMMAND_MODE: panel.setDataMode(false); break;
+            case TRACE_DATA_MODE: panel.setDataMode(true); break;
+            case TRACE_SELECT: panel.select(); break;
+            case TRACE_DESELECT: panel.deselect(); break;
+            case TRACE_BYTE: {
+                int b = getc(_file);
+                if (b == EOF) return damaged();
+                panel.byte((uint8_t)b);
+                break;
+            }
+            case TRACE_WRITE: {
+                uint32_t len;
+                if (!u32(len)) return damaged();
+                uint8_t chunk[4096];
+                while (len > 0) {
+                    uint32_t n = len < sizeof(chunk) ? len : sizeof(chunk);
+                    if (fread(chunk, 1, n, _file) != n) return damaged();
+                    for (uint32_t i = 0; i < n; i++) {
+                        panel.byte(chunk[i]);
+                    }
+                    len -= n;
+                }
+                break;
+            }
+            case TRACE_REPEAT: {
+                uint8_t color[2];
+                uint32_t count;
+                if (fread(color, 1, 2, _file) != 2 || !u32(count)) return damaged();
+                for (uint32_t i = 0; i < count; i++) {
+                    panel.byte(color[1]);  // Big-endian on the wire
+                    panel.byte(color[0]);
+                }
+                break;
+            }
+            case TRACE_DELAY: {
+                uint32_t ms;
+                if (!u32(ms)) return damaged();
+                panel.counters.delayMs += ms;
+                break;
+            }
+            case TRACE_MARK: {
+                int len = getc(_file);
+                char text[TRACE_MAX_LABEL + 1];
+                if (len == EOF || fread(text, 1, len, _file) != (size_t)len) return damaged();
+                label.assign(text, len);
+                return 1;
+            }
+            default:
+                return damaged();
+            }
+        }
+        // Activity after the last mark counts as a final, unlabelled frame
+        if (panel.counters.bytes > 0 || panel.counters.delayMs > 0) {
+            label = "(end)";
+            return 1;
+        }
+        return 0;
+    }
+
+private:
+    FILE* _file;
+    const char* _path;
+
+    bool u32(uint32_t& value) {
+        uint8_t bytes[4];
+        if (fread(bytes, 1, 4, _file) != 4) return false;
+        value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+        return true;
+    }
+
+    int damaged() {
+        std::cerr << "Error: " << _path << " is truncated or damaged at byte " << ftell(_file)
+                  << std::endl;
+        return -1;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// PNG output (stored deflate blocks, so no zlib)
+// ---------------------------------------------------------------------------
+
+static uint32_t crc_table[256];
+
+static uint32_t crc32(uint32_t crc, const uint8_t* buf, size_t len) {
+    if (crc_table[1] == 0) {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            crc_table[n] = c;
+        }
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = crc_table[(crc ^ buf[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void put_u32_be(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+static void put_chunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+    put_u32_be(out, data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    put_u32_be(out, crc32(0, &out[start], out.size() - start));
+}
+
+static bool write_png(const char* path, const uint16_t* pixels) {
+    // Filter byte 0 and RGB888 per row
+    std::vector<uint8_t> raw;
+    raw.reserve(DISPLAY_HEIGHT * (1 + DISPLAY_WIDTH * 3));
+    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+        raw.push_back(0);
+        for (int x = 0; x < DISPLAY_WIDTH; x++) {
+            uint16_t c = pixels[y * DISPLAY_WIDTH + x];
+            raw.push_back((c >> 11) << 3 | (c >> 13));
+            raw.push_back(((c >> 5) & 0x3F) << 2 | ((c >> 9) & 0x3));
+            raw.push_back((c & 0x1F) << 3 | ((c >> 2) & 0x7));
+        }
+    }
+
+    std::vector<uint8_t> zlib;
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < raw.size(); i++) {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    for (size_t pos = 0; pos < raw.size();) {
+        size_t n = raw.size() - pos < 65535 ? raw.size() - pos : 65535;
+        zlib.push_back(pos + n == raw.size() ? 1 : 0);
+        zlib.push_back(n & 0xFF);
+        zlib.push_back(n >> 8);
+        zlib.push_back(~n & 0xFF);
+        zlib.push_back((~n >> 8) & 0xFF);
+        zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + n);
+        pos += n;
+    }
+    put_u32_be(zlib, (b << 16) | a);
+
+    std::vector<uint8_t> header;
+    put_u32_be(header, DISPLAY_WIDTH);
+    put_u32_be(header, DISPLAY_HEIGHT);
+    header.push_back(8);  // Bit depth
+    header.push_back(2);  // RGB
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    std::vector<uint8_t> png(signature, signature + 8);
+    put_chunk(png, "IHDR", header);
+    put_chunk(png, "IDAT", zlib);
+    put_chunk(png, "IEND", std::vector<uint8_t>());
+
+    FILE* file = fopen(path, "wb");
+    if (!file || fwrite(png.data(), 1, png.size(), file) != png.size()) {
+        std::cerr << "Error: cannot write " << path << std::endl;
+        if (file) fclose(file);
+        return false;
+    }
+    fclose(file);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Statistics
+// ---------------------------------------------------------------------------
+
+struct LabelStats {
+    std::string label;
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t maxBytes;
+    uint64_t windows;
+    uint64_t commands;
+    uint64_t otherBytes;   // Same frames of the compared trace
+    uint64_t mismatches;   // Frames whose pixels differ from the compared trace
+};
+
+static LabelStats& stats_for(std::vector<LabelStats>& all, const std::string& label) {
+    for (size_t i = 0; i < all.size(); i++) {
+        if (all[i].label == label) {
+            return all[i];
+        }
+    }
+    LabelStats fresh = {label, 0, 0, 0, 0, 0, 0, 0};
+    all.push_back(fresh);
+    return all.back();
+}
+
+static void print_usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " <trace> [--compare <trace>] [--png DIR] [--png-all]" << std::endl;
+    std::cerr << "  --compare TRACE  Replay TRACE alongside and report frames whose pixels" << std::endl;
+    std::cerr << "                   differ, and the bus cost of both (exit status 1 if any" << std::endl;
+    std::cerr << "                   pixels differ)" << std::endl;
+    std::cerr << "  --png DIR        Write the last frame of each run of equally labelled" << std::endl;
+    std::cerr << "                   frames to DIR as PNG" << std::endl;
+    std::cerr << "  --png-all        With --png, write every frame" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    const char* trace_path = nullptr;
+    const char* compare_path = nullptr;
+    const char* png_dir = nullptr;
+    bool png_all = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            compare_path = argv[++i];
+        } else if (strcmp(argv[i], "--png") == 0 && i + 1 < argc) {
+            png_dir = argv[++i];
+        } else if (strcmp(argv[i], "--png-all") == 0) {
+            png_all = true;
+        } else if (argv[i][0] != '-' && !trace_path) {
+            trace_path = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!trace_path) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    TraceReader trace;
+    TraceReader other_trace;
+    if (!trace.open(trace_path) || (compare_path && !other_trace.open(compare_path))) {
+        return 1;
+    }
+
+    static VirtualPanel panel;
+    static VirtualPanel other_panel;
+    static uint16_t shown[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+    static uint16_t other_shown[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+    std::vector<LabelStats> stats;
+    BusCounters total;
+    uint64_t frames = 0;
+    uint64_t mismatches = 0;
+    uint64_t other_extra = 0;
+
+    // One frame ahead, so --png can tell the last frame of a run
+    std::string label;
+    std::string next_label;
+    int status = trace.next(panel, label);
+    while (status == 1) {
+        BusCounters frame = panel.counters;
+        panel.render(shown);
+
+        LabelStats& s = stats_for(stats, label);
+        s.frames++;
+        s.bytes += frame.bytes;
+        s.windows += frame.windows;
+        s.commands += frame.commands;
+        if (frame.bytes > s.maxBytes) s.maxBytes = frame.bytes;
+        total.bytes += frame.bytes;
+        total.windows += frame.windows;
+        total.commands += frame.commands;
+        total.delayMs += frame.delayMs;
+
+        if (compare_path) {
+            std::string other_label;
+            int other_status = other_trace.next(other_panel, other_label);
+            if (other_status < 0) {
+                return 1;
+            }
+            if (other_status == 0) {
+                std::cout << "Frame " << frames << " (" << label << "): " << compare_path
+                          << " ends here" << std::endl;
+                mismatches++;
+                compare_path = nullptr;
+            } else {
+                other_panel.render(other_shown);
+                s.otherBytes += other_panel.counters.bytes;
+                int differ = 0;
+                int x0 = DISPLAY_WIDTH, y0 = DISPLAY_HEIGHT, x1 = -1, y1 = -1;
+                for (int i = 0; i < DISPLAY_WIDTH * DISPLAY_HEIGHT; i++) {
+                    if (shown[i] != other_shown[i]) {
+                        int x = i % DISPLAY_WIDTH;
+                        int y = i / DISPLAY_WIDTH;
+                        if (x < x0) x0 = x;
+                        if (x > x1) x1 = x;
+                        if (y < y0) y0 = y;
+                        if (y > y1) y1 = y;
+                        differ++;
+                    }
+                }
+                if (differ > 0 || other_label != label) {
+                    if (mismatches < REPLAY_MAX_REPORTED) {
+                        std::cout << "Frame " << frames << " (" << label;
+                        if (other_label != label) std::cout << " / " << other_label;
+                        std::cout << "): " << differ << " pixels differ";
+                        if (differ > 0) {
+                            std::cout << " in " << x0 << "," << y0 << " - " << x1 << "," << y1;
+                        }
+                        std::cout << std::endl;
+                    }
+                    s.mismatches++;
+                    mismatches++;
+                }
+            }
+        }
+
+        status = trace.next(panel, next_label);
+        bool run_ends = status != 1 || next_label != label;
+        if (png_dir && (png_all || run_ends)) {
+            // Labels become part of the file name
+            std::string name = label;
+            for (size_t i = 0; i < name.size(); i++) {
+                if (!isalnum((unsigned char)name[i]) && name[i] != '-') name[i] = '_';
+            }
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/%06llu-%s.png", png_dir,
+                     (unsigned long long)frames, name.c_str());
+            if (!write_png(path, shown)) {
+                return 1;
+            }
+        }
+        frames++;
+        label.swap(next_label);
+    }
+    if (status < 0) {
+        return 1;
+    }
+    if (compare_path) {
+        std::string other_label;
+        while (other_trace.next(other_panel, other_label) == 1) {
+            other_extra++;
+        }
+        if (other_extra > 0) {
+            std::cout << compare_path << " has " << other_extra << " more frames" << std::endl;
+            mismatches++;
+        }
+    }
+
+    std::cout << trace_path << ": " << frames << " frames, " << total.bytes << " bytes, "
+              << total.windows << " windows, " << total.commands << " commands, "
+              << total.delayMs << " ms of delays" << std::endl << std::endl;
+    if (compare_path) {
+        printf("%-24s %8s %10s %10s %10s %10s %10s\n",
+               "label", "frames", "bytes", "max", "windows", "other", "mismatch");
+    } else {
+        printf("%-24s %8s %10s %10s %10s %10s\n",
+               "label", "frames", "bytes", "max", "windows", "commands");
+    }
+    for (size_t i = 0; i < stats.size(); i++) {
+        const LabelStats& s = stats[i];
+        if (compare_path) {
+            printf("%-24s %8llu %10llu %10llu %10llu %10llu %10llu\n", s.label.c_str(),
+                   (unsigned long long)s.frames, (unsigned long long)(s.bytes / s.frames),
+                   (unsigned long long)s.maxBytes, (unsigned long long)(s.windows / s.frames),
+                   (unsigned long long)(s.otherBytes / s.frames), (unsigned long long)s.mismatches);
+        } else {
+            printf("%-24s %8llu %10llu %10llu %10llu %10llu\n", s.label.c_str(),
+                   (unsigned long long)s.frames, (unsigned long long)(s.bytes / s.frames),
+                   (unsigned long long)s.maxBytes, (unsigned long long)(s.windows / s.frames),
+                   (unsigned long long)(s.commands / s.frames));
+        }
+    }
+    if (compare_path || mismatches > 0) {
+        std::cout << std::endl << (mismatches > 0 ? "Frames differ: " : "All frames match")
+                  << (mismatches > 0 ? std::to_string(mismatches) : std::string()) << std::endl;
+    }
+    return mismatches > 0 ? 1 : 0;
+}